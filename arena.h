@@ -0,0 +1,94 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+
+using std::runtime_error;
+
+namespace snake {
+
+/*
+Memory that lives exactly as long as a match: the players and their snake
+bodies, each body at its full capacity so it never grows mid-match. It is
+one block, allocated up front and handed out by bumping an offset, and is
+given back all at once by reset() between matches, so a match costs no
+heap allocations once the block is big enough. Nothing is freed
+individually: everything allocated from it must be gone before reset().
+*/
+class MatchArena {
+    std::unique_ptr<std::byte[]> block;
+    std::size_t capacity;
+    std::size_t used;
+    std::size_t high_water; // most bytes ever in use
+
+public:
+    explicit MatchArena(std::size_t const bytes = 0) : capacity(0), used(0), high_water(0) {
+        reset(bytes);
+    }
+
+    MatchArena(const MatchArena&) = delete;
+    MatchArena& operator=(const MatchArena&) = delete;
+
+    // forgets everything allocated and makes sure the next match has at least bytes, only reallocating if it grew
+    void reset(std::size_t const bytes) {
+        if (bytes > capacity) {
+            block.reset(new std::byte[bytes]);
+            capacity = bytes;
+        }
+        used = 0;
+    }
+
+    void* allocate(std::size_t const bytes, std::size_t const alignment) {
+        const std::uintptr_t base = reinterpret_cast<std::uintptr_t>(block.get());
+        const std::size_t start = ((base + used + alignment - 1) & ~(static_cast<std::uintptr_t>(alignment) - 1)) - base;
+        if (start + bytes > capacity)
+            throw runtime_error("match arena exhausted");
+        used = start + bytes;
+        if (used > high_water)
+            high_water = used;
+        return block.get() + start;
+    }
+
+    std::size_t get_capacity() const {
+        return capacity;
+    }
+
+    std::size_t get_high_water() const {
+        return high_water;
+    }
+};
+
+// lets std::allocate_shared put an object and its control block in a MatchArena, deallocation is a no-op
+template <typename T>
+struct ArenaAllocator {
+    using value_type = T;
+
+    MatchArena* arena;
+
+    explicit ArenaAllocator(MatchArena& match_arena) : arena(&match_arena) {}
+
+    template <typename U>
+    ArenaAllocator(ArenaAllocator<U> const& other) : arena(other.arena) {}
+
+    T* allocate(std::size_t const n) {
+        return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, std::size_t) {}
+
+    template <typename U>
+    bool operator==(ArenaAllocator<U> const& other) const {
+        return arena == other.arena;
+    }
+
+    template <typename U>
+    bool operator!=(ArenaAllocator<U> const& other) const {
+        return arena != other.arena;
+    }
+};
+}
+
+#endif
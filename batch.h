@@ -0,0 +1,369 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "simulation.h"
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using std::vector;
+
+namespace snake {
+
+enum class SimdKernel {
+    Scalar, Sse2, Avx2
+};
+
+inline const char* kernel_name(SimdKernel const kernel) {
+    switch (kernel) {
+        case SimdKernel::Sse2: return "sse2";
+        case SimdKernel::Avx2: return "avx2";
+        default: return "scalar";
+    }
+}
+
+inline bool kernel_supported(SimdKernel const kernel) {
+#if defined(__x86_64__) || defined(__i386__)
+    if (kernel == SimdKernel::Avx2)
+        return __builtin_cpu_supports("avx2");
+    if (kernel == SimdKernel::Sse2)
+        return __builtin_cpu_supports("sse2");
+    return true;
+#else
+    return kernel == SimdKernel::Scalar;
+#endif
+}
+
+// the widest kernel this CPU runs
+inline SimdKernel best_kernel() {
+    if (kernel_supported(SimdKernel::Avx2))
+        return SimdKernel::Avx2;
+    if (kernel_supported(SimdKernel::Sse2))
+        return SimdKernel::Sse2;
+    return SimdKernel::Scalar;
+}
+
+namespace batch_detail {
+
+// GCC/clang vector extensions: arithmetic and comparisons work lane by lane, a comparison gives -1 or 0 per lane
+using Lanes1 = std::int32_t __attribute__((vector_size(4)));
+using Lanes4 = std::int32_t __attribute__((vector_size(16)));
+using Lanes8 = std::int32_t __attribute__((vector_size(32)));
+
+// the arrays a kernel reads and writes, indexed [player * games + game] for snakes and [game] for games
+struct KernelArrays {
+    std::int32_t const* commands;
+    std::int32_t* head_x;
+    std::int32_t* head_y;
+    std::int32_t* dir;
+    std::int32_t* length;
+    std::int32_t* size;
+    std::int32_t* popped;  // out: -1 if the tail left its cell this tick
+    std::int32_t* crashed; // out: -1 if the head hit the border or the other head
+    std::int32_t* growth_countdown;
+    std::int32_t const* status;
+    std::size_t games;
+    std::int32_t width, height, growth_interval;
+};
+
+// vectors only go through references, a 32 byte vector passed or returned by value makes GCC warn about the ABI
+template <typename V>
+[[gnu::always_inline]] inline void load(V& to, std::int32_t const* from) {
+    std::memcpy(&to, from, sizeof(V));
+}
+
+template <typename V>
+[[gnu::always_inline]] inline void store(std::int32_t* to, V const& from) {
+    std::memcpy(to, &from, sizeof(V));
+}
+
+// where mask is set from becomes to, elsewhere to stays as it is
+template <typename V>
+[[gnu::always_inline]] inline void store_masked(std::int32_t* to, V const& mask, V const& from) {
+    V old;
+    load(old, to);
+    const V merged = old ^ ((from ^ old) & mask);
+    store(to, merged);
+}
+
+/*
+Movement, growth and border/head-on collisions of games [first, last) for
+both players, sizeof(V) / 4 games at a time, the same arithmetic as
+Snake::change_direction and Snake::move with branches turned into masks
+(x ^ ((y ^ x) & mask) is y where mask is set, x elsewhere). Finished games
+are left as they are. Always inlined into one function per instruction
+set, which is what makes the vector extensions compile to SSE2 or AVX2.
+*/
+template <typename V>
+[[gnu::always_inline]] inline void move_kernel(KernelArrays const& a, std::size_t const first, std::size_t const last) {
+    constexpr std::size_t LANES = sizeof(V) / sizeof(std::int32_t);
+    const V zero{}, one = zero + 1;
+    for (std::size_t g = first; g + LANES <= last; g += LANES) {
+        V status, countdown;
+        load(status, a.status + g);
+        load(countdown, a.growth_countdown + g);
+        const V running = status == NO_WINNER;
+        const V grow = countdown == 0; // frame % growth_interval == 0
+        const V next_countdown = (countdown - 1) ^ (((countdown - 1) ^ (a.growth_interval - 1)) & grow);
+        store_masked(a.growth_countdown + g, running, next_countdown);
+        V heads_x[2], heads_y[2], crashes[2];
+        for (std::size_t p = 0; p < 2; ++p) {
+            const std::size_t at = p * a.games + g;
+            V dir, cmd, length, size, x, y;
+            load(dir, a.dir + at);
+            load(cmd, a.commands + at);
+            load(length, a.length + at);
+            load(size, a.size + at);
+            load(x, a.head_x + at);
+            load(y, a.head_y + at);
+            // a turn is taken unless it is None, not a direction, or straight back, Direction::Up..Right are 1..4
+            const V opposite = ((dir - 1) ^ 1) + 1;
+            const V accept = (cmd > 0) & (cmd <= 4) & (cmd != opposite);
+            dir ^= (cmd ^ dir) & accept;
+            length -= grow; // grow is -1 or 0
+            const V popped = size == length;
+            size += ~popped & one;
+            x += (dir == 3) - (dir == 4); // left -1, right +1
+            y += (dir == 1) - (dir == 2); // up -1, down +1
+            const V border = (x < one) | (x >= a.width - 1) | (y < one) | (y >= a.height - 1);
+            store_masked(a.dir + at, running, dir);
+            store_masked(a.length + at, running, length);
+            store_masked(a.size + at, running, size);
+            store_masked(a.head_x + at, running, x);
+            store_masked(a.head_y + at, running, y);
+            const V popped_running = popped & running;
+            store(a.popped + at, popped_running);
+            heads_x[p] = x;
+            heads_y[p] = y;
+            crashes[p] = border & running;
+        }
+        const V head_on = (heads_x[0] == heads_x[1]) & (heads_y[0] == heads_y[1]) & running;
+        crashes[0] |= head_on;
+        crashes[1] |= head_on;
+        store(a.crashed + g, crashes[0]);
+        store(a.crashed + a.games + g, crashes[1]);
+    }
+}
+
+inline void move_scalar(KernelArrays const& a, std::size_t const first, std::size_t const last) {
+    move_kernel<Lanes1>(a, first, last);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2"))) inline void move_sse2(KernelArrays const& a, std::size_t const first, std::size_t const last) {
+    move_kernel<Lanes4>(a, first, last);
+}
+
+__attribute__((target("avx2"))) inline void move_avx2(KernelArrays const& a, std::size_t const first, std::size_t const last) {
+    move_kernel<Lanes8>(a, first, last);
+}
+#endif
+}
+
+/*
+Many two player games stepped in lockstep, stored as structures of arrays
+so the per tick work of a whole batch can be done 4 (SSE2) or 8 (AVX2)
+games at a time. Each snake is a head position, direction, length, body
+size and a ring of board cell indexes with head and tail positions in it. A tick is
+two passes over the batch:
+  - a vector kernel (AVX2, SSE2, or the scalar fallback, picked at
+    runtime) turns and moves every head, grows the snakes that are due and
+    flags which tails leave and which heads hit the border or each other
+  - a scalar pass writes the new heads into the rings, vacates the tails
+    on each game's board and checks the heads against it for bodies
+The outcome is exactly Simulation's for two players: headless --batch
+checks every kernel against Simulation tick by tick. A game stops at its
+first crash (with two players that decides it) until it is restarted.
+The border is not stored on the boards, the kernel already checks it.
+*/
+class BatchSimulation {
+    std::size_t games;
+    int width, height;
+    std::int32_t growth_interval;
+    StartingPositions start;
+    SimdKernel kernel;
+    std::size_t ring_capacity; // per snake, a power of two at least the board area
+    std::size_t padded; // games rounded up to a whole number of AVX2 vectors, the arrays are this long
+
+    vector<std::int32_t> head_x, head_y, dir, length, size, popped, crashed; // [player * padded + game]
+    vector<std::uint32_t> head_index, tail_index; // [player * padded + game], positions in the ring, wrapping
+    vector<std::int32_t> ring; // [(player * padded + game) * ring_capacity + i], cell index y * width + x
+    vector<std::int32_t> growth_countdown, status; // [game], status is the winner, NO_WINNER while running
+    vector<std::uint32_t> frames; // [game]
+    vector<std::uint8_t> boards; // [game * width * height], 0 empty or the id of the player there
+    vector<std::int32_t> commands; // [player * padded + game], step() scratch
+
+    static constexpr std::size_t MAX_LANES = 8;
+
+    std::int32_t cell(std::int32_t const x, std::int32_t const y) const {
+        return y * width + x;
+    }
+
+    std::int32_t* snake_ring(std::size_t const snake) {
+        return ring.data() + snake * ring_capacity;
+    }
+
+    std::uint8_t* board(std::size_t const game) {
+        return boards.data() + game * static_cast<std::size_t>(width) * height;
+    }
+
+    void run_kernel(std::size_t const first, std::size_t const last) {
+        const batch_detail::KernelArrays arrays{
+            commands.data(), head_x.data(), head_y.data(), dir.data(), length.data(), size.data(), popped.data(), crashed.data(),
+            growth_countdown.data(), status.data(), padded, width, height, growth_interval
+        };
+#if defined(__x86_64__) || defined(__i386__)
+        if (kernel == SimdKernel::Avx2)
+            return batch_detail::move_avx2(arrays, first, last);
+        if (kernel == SimdKernel::Sse2)
+            return batch_detail::move_sse2(arrays, first, last);
+#endif
+        batch_detail::move_scalar(arrays, first, last);
+    }
+
+    // body collisions and the rings, after the kernel has moved the heads
+    void finish_tick(std::size_t const game) {
+        if (status[game] != NO_WINNER)
+            return;
+        std::uint8_t* cells = board(game);
+        const std::size_t mask = ring_capacity - 1;
+        std::int32_t heads[2];
+        for (std::size_t p = 0; p < 2; ++p) {
+            const std::size_t snake = p * padded + game;
+            std::int32_t* body = snake_ring(snake);
+            // tails leave before any head arrives, a head may follow a tail into its cell
+            if (popped[snake])
+                cells[body[tail_index[snake]++ & mask]] = CELL_EMPTY;
+            heads[p] = cell(head_x[snake], head_y[snake]);
+            body[++head_index[snake] & mask] = heads[p];
+        }
+        bool crash[2];
+        for (std::size_t p = 0; p < 2; ++p) {
+            // a border cell reads as empty here, the kernel has flagged it already
+            crash[p] = crashed[p * padded + game] || cells[heads[p]] != CELL_EMPTY;
+        }
+        ++frames[game];
+        if (crash[0] || crash[1]) {
+            status[game] = crash[0] && crash[1] ? DRAW : crash[0] ? PLAYER2 : PLAYER1;
+            return;
+        }
+        cells[heads[0]] = PLAYER1;
+        cells[heads[1]] = PLAYER2;
+    }
+
+public:
+    static constexpr std::size_t PLAYERS = 2;
+
+    BatchSimulation(std::size_t batch_games, int board_width, int board_height, unsigned tick_rate = FRAMES_PER_SECOND, SimdKernel simd = best_kernel()) :
+        games(batch_games),
+        width(board_width),
+        height(board_height),
+        growth_interval(static_cast<std::int32_t>(2 * tick_rate)),
+        start(calculate_starting_positions(board_width, board_height)),
+        kernel(simd),
+        ring_capacity(1),
+        padded((batch_games + MAX_LANES - 1) / MAX_LANES * MAX_LANES)
+    {
+        if (games == 0)
+            throw runtime_error("a batch needs at least 1 game");
+        if (width < 8 || height < 8)
+            throw runtime_error("board must be at least 8x8");
+        if (tick_rate == 0)
+            throw runtime_error("tick rate must be greater than 0");
+        if (!kernel_supported(kernel))
+            throw runtime_error(std::string("this CPU can't run the ") + kernel_name(kernel) + " kernel");
+        while (ring_capacity < body_capacity(width, height))
+            ring_capacity <<= 1;
+        for (vector<std::int32_t>* snake_array : { &head_x, &head_y, &dir, &length, &size, &popped, &crashed, &commands })
+            snake_array->assign(PLAYERS * padded, 0);
+        head_index.assign(PLAYERS * padded, 0);
+        tail_index.assign(PLAYERS * padded, 0);
+        ring.assign(PLAYERS * padded * ring_capacity, 0);
+        growth_countdown.assign(padded, 0);
+        status.assign(padded, DRAW); // padding games are never running
+        frames.assign(padded, 0);
+        boards.assign(games * static_cast<std::size_t>(width) * height, CELL_EMPTY);
+        for (std::size_t game = 0; game < games; ++game)
+            restart(game);
+    }
+
+    // puts game back at the start, as Simulation::reset with the players tournaments use
+    void restart(std::size_t const game) {
+        const Coordinates starts[PLAYERS] = { start.player1_start, start.player2_start };
+        const Direction start_dirs[PLAYERS] = { Direction::Right, Direction::Left };
+        std::uint8_t* cells = board(game);
+        std::memset(cells, CELL_EMPTY, static_cast<std::size_t>(width) * height);
+        for (std::size_t p = 0; p < PLAYERS; ++p) {
+            const std::size_t snake = p * padded + game;
+            head_x[snake] = starts[p].x;
+            head_y[snake] = starts[p].y;
+            dir[snake] = static_cast<std::int32_t>(start_dirs[p]);
+            length[snake] = start.initial_width / 5;
+            size[snake] = 1;
+            head_index[snake] = 0;
+            tail_index[snake] = 0;
+            snake_ring(snake)[0] = cell(starts[p].x, starts[p].y);
+            cells[cell(starts[p].x, starts[p].y)] = static_cast<std::uint8_t>(p + 1);
+        }
+        growth_countdown[game] = 0;
+        status[game] = NO_WINNER;
+        frames[game] = 0;
+    }
+
+    // advances every running game by one tick, game_commands is [player * games + game], Direction::None = no turn
+    void step(Direction const* game_commands) {
+        for (std::size_t p = 0; p < PLAYERS; ++p) {
+            for (std::size_t game = 0; game < games; ++game)
+                commands[p * padded + game] = static_cast<std::int32_t>(game_commands[p * games + game]);
+        }
+        run_kernel(0, padded);
+        for (std::size_t game = 0; game < games; ++game)
+            finish_tick(game);
+    }
+
+    std::size_t get_game_count() const {
+        return games;
+    }
+
+    SimdKernel get_kernel() const {
+        return kernel;
+    }
+
+    // NO_WINNER while the game is running, then DRAW or the winning player
+    int get_status(std::size_t const game) const {
+        return status[game];
+    }
+
+    unsigned long get_frame_count(std::size_t const game) const {
+        return frames[game];
+    }
+
+    Coordinates get_head(std::size_t const game, std::size_t const player) const {
+        const std::size_t snake = player * padded + game;
+        return { head_x[snake], head_y[snake] };
+    }
+
+    Direction get_direction(std::size_t const game, std::size_t const player) const {
+        return static_cast<Direction>(dir[player * padded + game]);
+    }
+
+    int get_length(std::size_t const game, std::size_t const player) const {
+        return length[player * padded + game];
+    }
+
+    // head first, as Snake::get_body
+    void get_body(std::size_t const game, std::size_t const player, vector<Coordinates>& body) const {
+        const std::size_t snake = player * padded + game;
+        std::int32_t const* cells = ring.data() + snake * ring_capacity;
+        body.clear();
+        for (std::int32_t i = 0; i < size[snake]; ++i) {
+            const std::int32_t at = cells[(head_index[snake] - i) & (ring_capacity - 1)];
+            body.push_back({ at % width, at / width });
+        }
+    }
+};
+}
+
+#endif
@@ -0,0 +1,734 @@
+#include "batch.h"
+#include "bots.h"
+#include "input_queue.h"
+#include "simulation.h"
+#include "stats.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <map>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <type_traits>
+#include <unistd.h>
+#include "screen.h" // last, ncurses.h defines macros such as move() and clear()
+
+using namespace snake;
+
+using std::exception;
+
+// every write() to the benchmark's pseudo terminal is counted, whoever makes it: ncurses calls write() itself and
+// this definition takes the place of libc's
+static std::atomic<int> counted_fd{ -1 };
+static std::atomic<std::uint64_t> counted_writes{ 0 }, counted_bytes{ 0 };
+
+extern "C" ssize_t write(int fd, const void* buf, size_t count) {
+    if (fd == counted_fd.load(std::memory_order_relaxed)) {
+        counted_writes.fetch_add(1, std::memory_order_relaxed);
+        counted_bytes.fetch_add(count, std::memory_order_relaxed);
+    }
+    return syscall(SYS_write, fd, buf, count);
+}
+
+namespace {
+
+// stops the optimizer from throwing away a benchmark's result
+template <typename T>
+void do_not_optimize(T const& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+template <typename F>
+double nanoseconds_per_op(unsigned long const iterations, F&& op) {
+    auto start_time = std::chrono::steady_clock::now();
+    for (unsigned long i = 0; i < iterations; ++i)
+        op(i);
+    auto finish_time = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(finish_time - start_time).count() / iterations;
+}
+
+void report(const char* name, std::size_t length, double ns) {
+    printf("%-28s length %-7zu %10.1f ns/op\n", name, length, ns);
+}
+
+// the same head-in/tail-out pattern Snake::move produces, on a 1000 cell wide board
+Coordinates nth_position(unsigned long n) {
+    return { static_cast<int>(n % 1000), static_cast<int>(n / 1000 % 1000) };
+}
+
+// -------- Snake::move + full body scan: std::deque vs ring buffer --------
+
+std::size_t scan(std::deque<Coordinates> const& body, Coordinates const& target) {
+    std::size_t hits = 0;
+    for (Coordinates const& pos : body)
+        hits += pos == target;
+    return hits;
+}
+
+// Coordinates/PackedCoordinates have no padding, compare them as one 64/32 bit word so the loop vectorizes
+template <typename Stored>
+using CoordinateWord = std::conditional_t<sizeof(Stored) == 8, std::uint64_t, std::uint32_t>;
+
+template <typename Stored>
+std::size_t scan(RingBuffer<Coordinates, Stored> const& body, Coordinates const& target) {
+    using Word = CoordinateWord<Stored>;
+    static_assert(sizeof(Word) == sizeof(Stored));
+    const Stored needle_coordinates(target);
+    Word needle;
+    memcpy(&needle, &needle_coordinates, sizeof(Word));
+    typename RingBuffer<Coordinates, Stored>::Segment segments[2];
+    const std::size_t n = body.segments(segments);
+    std::size_t hits = 0;
+    for (std::size_t s = 0; s < n; ++s) {
+        Word const* words = reinterpret_cast<Word const*>(segments[s].data);
+        for (std::size_t i = 0; i < segments[s].size; ++i)
+            hits += words[i] == needle;
+    }
+    return hits;
+}
+
+template <typename Body>
+void bench_body(const char* name, Body body, std::size_t const length, unsigned long const iterations) {
+    for (std::size_t i = 0; i < length; ++i)
+        body.push_front(nth_position(i));
+    unsigned long n = length;
+    const double ns = nanoseconds_per_op(iterations, [&](unsigned long) {
+        const Coordinates head = nth_position(n++);
+        body.pop_back();
+        body.push_front(head);
+        do_not_optimize(scan(body, head));
+    });
+    report(name, length, ns);
+}
+
+void bench_snake_move(std::size_t const length, unsigned long const iterations) {
+    // a real Snake on a board large enough to never hit anything
+    Snake snake({1, 1}, Direction::Right, static_cast<int>(length), length + 1);
+    snake.change_direction(Direction::Down);
+    int turn = 0;
+    for (std::size_t i = 0; i < length; ++i)
+        snake.move(); // grow to full length before timing
+    const double ns = nanoseconds_per_op(iterations, [&](unsigned long i) {
+        if (i % 500 == 0)
+            snake.change_direction(++turn % 2 ? Direction::Down : Direction::Right);
+        const SnakeMove change = snake.move();
+        do_not_optimize(scan(snake.get_body(), change.head));
+    });
+    report("Snake::move+scan", length, ns);
+}
+
+void snake_move_benchmarks() {
+    for (std::size_t length : { 10, 100, 1000, 10000, 100000 }) {
+        const unsigned long iterations = 20000000 / length + 1000;
+        bench_body("deque move+scan", std::deque<Coordinates>(), length, iterations);
+        bench_body("ring move+scan", RingBuffer<Coordinates>(length), length, iterations);
+        bench_body("packed ring move+scan", RingBuffer<Coordinates, PackedCoordinates>(length), length, iterations);
+        bench_snake_move(length, iterations);
+    }
+}
+
+// -------- N player ticks: shared occupancy board vs pairwise body scans --------
+
+// what collision checks cost without a shared board: every moving head against every body, O(players^2 * length)
+template <typename SimulationType>
+std::size_t pairwise_collisions(SimulationType const& simulation) {
+    std::size_t hits = 0;
+    for (std::size_t i = 0; i < simulation.get_player_count(); ++i) {
+        if (!simulation.is_alive(i))
+            continue;
+        const Coordinates head = simulation.get_player(i).get_snake().get_head();
+        for (std::size_t j = 0; j < simulation.get_player_count(); ++j) {
+            SnakeBody const& body = simulation.get_player(j).get_body();
+            for (auto it = body.begin() + (i == j ? 1 : 0); it != body.end(); ++it)
+                hits += *it == head;
+        }
+    }
+    return hits;
+}
+
+struct PlayerTicks {
+    double seconds;
+    unsigned long player_ticks; // moving players summed over every tick
+    std::size_t peak_tiles; // ChunkedBoard only
+};
+
+// random bots, a new match whenever one ends. Players start in the middle 512x256 of a bigger board
+template <typename SimulationType = Simulation>
+PlayerTicks run_players(std::size_t const players, unsigned long const ticks, bool const pairwise, int const width = 512, int const height = 256) {
+    const int view_x = 512, view_y = 256;
+    vector<RandomBot> bots;
+    for (std::size_t i = 0; i < players; ++i)
+        bots.emplace_back(i + 1);
+    SimulationType simulation(width, height, make_bot_players(width, height, players, view_x, view_y));
+    Direction commands[MAX_PLAYERS];
+    unsigned long player_ticks = 0;
+    std::size_t peak_tiles = 0;
+    auto start_time = std::chrono::steady_clock::now();
+    for (unsigned long tick = 0; tick < ticks; ++tick) {
+        for (std::size_t i = 0; i < players; ++i)
+            commands[i] = bots[i].next_command();
+        player_ticks += simulation.get_alive_count();
+        if (simulation.step(commands) != NO_WINNER)
+            simulation.reset(make_bot_players(width, height, players, view_x, view_y));
+        if constexpr (std::is_same_v<SimulationType, ArenaSimulation>)
+            peak_tiles = std::max(peak_tiles, simulation.get_board().get_tile_count());
+        if (pairwise)
+            do_not_optimize(pairwise_collisions(simulation));
+    }
+    auto finish_time = std::chrono::steady_clock::now();
+    return { std::chrono::duration<double>(finish_time - start_time).count(), player_ticks, peak_tiles };
+}
+
+void players_benchmarks() {
+    for (std::size_t players : { 2, 4, 8, 16 }) {
+        const unsigned long ticks = 2000000;
+        const PlayerTicks board = run_players(players, ticks, false);
+        const PlayerTicks pairwise = run_players(players, ticks, true); // same seeds, same matches
+        printf("players %-3zu  board %8.1f ns/tick %6.1f ns/player-tick   + pairwise scan %8.1f ns/tick %6.1f ns/player-tick\n",
+            players,
+            board.seconds * 1e9 / ticks, board.seconds * 1e9 / board.player_ticks,
+            (pairwise.seconds - board.seconds) * 1e9 / ticks, (pairwise.seconds - board.seconds) * 1e9 / board.player_ticks);
+    }
+}
+
+// -------- dense Board vs sparse ChunkedBoard as the arena grows --------
+
+void arena_benchmarks() {
+    const std::size_t players = 4;
+    const unsigned long ticks = 2000000;
+    const PlayerTicks dense = run_players(players, ticks, false);
+    printf("Board         %-13s %6.1f ns/player-tick  %8.1f KB\n",
+        "512x256", dense.seconds * 1e9 / dense.player_ticks, 512 * 256 * 1.125 / 1024); // a byte per cell + occupied bits
+    const struct { int width, height; const char* name; } arenas[] = {
+        { 512, 256, "512x256" }, { 16384, 16384, "16384x16384" }, { 100000, 100000, "100000x100000" }
+    };
+    for (auto const& arena : arenas) {
+        const PlayerTicks sparse = run_players<ArenaSimulation>(players, ticks, false, arena.width, arena.height);
+        printf("ChunkedBoard  %-13s %6.1f ns/player-tick  %8.1f KB peak in %zu tiles, dense would be %.1f MB\n",
+            arena.name, sparse.seconds * 1e9 / sparse.player_ticks,
+            sparse.peak_tiles * ChunkedBoard::TILE_SIZE * ChunkedBoard::TILE_SIZE / 1024.0, sparse.peak_tiles,
+            static_cast<double>(arena.width) * arena.height / (1 << 20));
+    }
+}
+
+// -------- compile time configured simulations vs the runtime configured one --------
+
+template <typename Config>
+void bench_static_config(const char* name, std::size_t const players, unsigned long const ticks) {
+    const int width = Config::WIDTH, height = Config::HEIGHT;
+    // alternate the two and keep the fastest of each, whichever runs second otherwise pays for the first's heap
+    PlayerTicks runtime{}, fixed{};
+    for (int round = 0; round < 3; ++round) {
+        const PlayerTicks r = run_players<Simulation>(players, ticks, false, width, height);
+        const PlayerTicks f = run_players<BasicSimulation<Config>>(players, ticks, false, width, height);
+        // same seeds, a walled static game plays exactly the same matches as the runtime one
+        if (!Config::WRAPS && f.player_ticks != r.player_ticks)
+            throw runtime_error(std::string(name) + ": static and runtime configurations played different games");
+        if (round == 0 || r.seconds < runtime.seconds)
+            runtime = r;
+        if (round == 0 || f.seconds < fixed.seconds)
+            fixed = f;
+    }
+    printf("%-12s players %-3zu runtime %6.1f ns/tick   static%s %6.1f ns/tick   (%.2fx)\n",
+        name, players, runtime.seconds * 1e9 / ticks, Config::WRAPS ? " wrapped" : "        ", fixed.seconds * 1e9 / ticks,
+        runtime.seconds / fixed.seconds);
+}
+
+void config_benchmarks() {
+    const unsigned long ticks = 2000000;
+    bench_static_config<StaticConfig<202, 62, 2>>("202x62", 2, ticks);
+    bench_static_config<StaticConfig<202, 62, 2, FRAMES_PER_SECOND, true>>("202x62", 2, ticks);
+    bench_static_config<StaticConfig<512, 256, 4>>("512x256", 4, ticks);
+    bench_static_config<StaticConfig<512, 256, 16>>("512x256", 16, ticks);
+    bench_static_config<StaticConfig<512, 256, 16, FRAMES_PER_SECOND, true>>("512x256", 16, ticks);
+}
+
+// -------- lockstep batches: one Simulation per game vs BatchSimulation kernels --------
+
+void batch_benchmarks() {
+    const std::size_t games = 1024;
+    const int width = 42, height = 22;
+    const unsigned long rounds = 4000;
+    static constexpr std::size_t COMMAND_ROUNDS = 64;
+    SplitMix64 rng(1);
+    vector<Direction> commands(COMMAND_ROUNDS * 2 * games); // drawn in advance, only the simulations are timed
+    for (Direction& command : commands)
+        command = rng.next() % 8 == 0 ? static_cast<Direction>(1 + rng.next() % 4) : Direction::None;
+
+    // the object per snake layout: each game a Simulation, restarted in place when it ends
+    const StartingPositions start = calculate_starting_positions(width, height);
+    vector<Simulation> simulations;
+    vector<shared_ptr<Player>> players;
+    for (std::size_t game = 0; game < games; ++game) {
+        players.push_back(make_shared<Player>(PLAYER1, start.player1_start, Direction::Right, 0, 0, 0, 0, start.initial_width / 5, body_capacity(width, height)));
+        players.push_back(make_shared<Player>(PLAYER2, start.player2_start, Direction::Left, 0, 0, 0, 0, start.initial_width / 5, body_capacity(width, height)));
+        simulations.emplace_back(width, height, players[2 * game], players[2 * game + 1]);
+    }
+    const double simulation_ns = nanoseconds_per_op(rounds, [&](unsigned long round) {
+        Direction const* round_commands = commands.data() + round % COMMAND_ROUNDS * 2 * games;
+        for (std::size_t game = 0; game < games; ++game) {
+            if (simulations[game].step(round_commands[game], round_commands[games + game]) == NO_WINNER)
+                continue;
+            players[2 * game]->get_snake().restore(Direction::Right, Direction::Right, start.initial_width / 5, &start.player1_start, &start.player1_start + 1);
+            players[2 * game + 1]->get_snake().restore(Direction::Left, Direction::Left, start.initial_width / 5, &start.player2_start, &start.player2_start + 1);
+            simulations[game].restart();
+        }
+    }) / games;
+    printf("%-12s %zu games %dx%d  %6.1f ns/game-tick\n", "Simulation", games, width, height, simulation_ns);
+
+    for (SimdKernel kernel : { SimdKernel::Scalar, SimdKernel::Sse2, SimdKernel::Avx2 }) {
+        if (!kernel_supported(kernel))
+            continue;
+        BatchSimulation batch(games, width, height, FRAMES_PER_SECOND, kernel);
+        const double ns = nanoseconds_per_op(rounds, [&](unsigned long round) {
+            batch.step(commands.data() + round % COMMAND_ROUNDS * 2 * games);
+            for (std::size_t game = 0; game < games; ++game) {
+                if (batch.get_status(game) != NO_WINNER)
+                    batch.restart(game);
+            }
+        }) / games;
+        printf("Batch %-6s %zu games %dx%d  %6.1f ns/game-tick  (%.2fx)\n", kernel_name(kernel), games, width, height, ns, simulation_ns / ns);
+    }
+}
+
+// -------- frame output: ncurses vs Screen's ansi backend, drawing the same game to a pseudo terminal --------
+
+struct OutputRun {
+    std::uint64_t first_frame_bytes, first_frame_writes;
+    double ns_per_frame, bytes_per_frame, writes_per_frame;
+    LatencyHistogram frame_time;
+};
+
+// draws a 4 player game of random moves frame by frame the way GameWindow does: the whole board once, then the
+// popped tails, new heads & collisions of every tick, only where a cell's color changed
+OutputRun run_output(Screen& screen, int const width, int const height, unsigned long const frames) {
+    static constexpr int BACKGROUND_PAIR = 5, BORDER_PAIR = 6, COLLISION_PAIR = 7; // 1 to 4 are the players
+    const std::size_t player_count = 4;
+    vector<shared_ptr<Player>> players = make_bot_players(width, height, player_count);
+    const vector<StartingPosition> starts = calculate_starting_positions(width, height, player_count);
+    const int start_length = players[0]->get_snake().get_length();
+    Simulation simulation(width, height, players, FRAMES_PER_SECOND);
+    vector<std::uint8_t> drawn(static_cast<std::size_t>(width) * height, 0);
+    SplitMix64 rng(1);
+
+    auto draw = [&](Coordinates const pos, int const pair) {
+        std::uint8_t& cell = drawn[static_cast<std::size_t>(pos.y) * width + pos.x];
+        if (cell != pair) {
+            screen.cell(pos.y, pos.x, ' ', pair);
+            cell = static_cast<std::uint8_t>(pair);
+        }
+    };
+    auto pair_of = [&](std::uint8_t const owner) {
+        return owner == CELL_EMPTY ? BACKGROUND_PAIR : owner == CELL_BORDER ? BORDER_PAIR : owner;
+    };
+    auto draw_board = [&] {
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x)
+                draw({ x, y }, pair_of(simulation.get_board().owner({ x, y })));
+        }
+    };
+
+    counted_writes = 0;
+    counted_bytes = 0;
+    draw_board();
+    screen.flush();
+    OutputRun run{ counted_bytes.load(), counted_writes.load(), 0, 0, 0, {} };
+
+    counted_writes = 0;
+    counted_bytes = 0;
+    Direction commands[MAX_PLAYERS];
+    for (unsigned long frame = 0; frame < frames; ++frame) {
+        const auto start_time = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < player_count; ++i)
+            commands[i] = rng.next() % 8 == 0 ? static_cast<Direction>(1 + rng.next() % 4) : Direction::None;
+        if (simulation.step(commands) != NO_WINNER) {
+            for (std::size_t i = 0; i < player_count; ++i)
+                players[i]->get_snake().restore(starts[i].dir, starts[i].dir, start_length, &starts[i].pos, &starts[i].pos + 1);
+            simulation.restart();
+            std::fill(drawn.begin(), drawn.end(), 0); // a new game repaints everything
+            draw_board();
+        } else if (frame % (10 * FRAMES_PER_SECOND) == 0) {
+            draw_board();
+        } else {
+            for (std::size_t i = 0; i < player_count; ++i) {
+                const SnakeMove move = simulation.get_move(i);
+                if (move.tail_popped)
+                    draw(move.tail, BACKGROUND_PAIR);
+            }
+            for (std::size_t i = 0; i < player_count; ++i)
+                draw(simulation.get_move(i).head, pair_of(simulation.get_board().owner(simulation.get_move(i).head)));
+        }
+        for (Coordinates const pos : simulation.get_collisions())
+            draw(pos, COLLISION_PAIR);
+        screen.flush();
+        run.frame_time.record(std::chrono::steady_clock::now() - start_time);
+    }
+    run.ns_per_frame = run.frame_time.mean_ns();
+    run.bytes_per_frame = static_cast<double>(counted_bytes.load()) / frames;
+    run.writes_per_frame = static_cast<double>(counted_writes.load()) / frames;
+    return run;
+}
+
+// a pseudo terminal of a board's size with ncurses started on it and a thread reading everything written to it
+struct PseudoTerminal {
+    int master, slave;
+    std::thread reader;
+    std::FILE* terminal_out;
+    std::FILE* terminal_in;
+    SCREEN* terminal;
+    Screen screen;
+
+    PseudoTerminal(int const width, int const height) {
+        master = posix_openpt(O_RDWR | O_NOCTTY);
+        if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+            throw runtime_error("can't open a pseudo terminal");
+        slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+        struct winsize size{};
+        size.ws_row = height;
+        size.ws_col = width;
+        if (slave < 0 || ioctl(slave, TIOCSWINSZ, &size) != 0)
+            throw runtime_error("can't open a pseudo terminal");
+        reader = std::thread([this] {
+            char buffer[1 << 16];
+            while (read(master, buffer, sizeof(buffer)) > 0) {}
+        });
+
+        terminal_out = fdopen(slave, "w");
+        terminal_in = fdopen(dup(slave), "r");
+        terminal = newterm("xterm-256color", terminal_out, terminal_in);
+        if (terminal == nullptr)
+            throw runtime_error("ncurses doesn't know xterm-256color");
+        set_term(terminal);
+        start_color();
+        static const short colors[] = { COLOR_GREEN, COLOR_BLUE, COLOR_YELLOW, COLOR_MAGENTA };
+        for (int pair = 1; pair <= 4; ++pair)
+            screen.define_pair(pair, colors[pair - 1], colors[pair - 1]);
+        screen.define_pair(5, COLOR_WHITE, COLOR_BLACK);
+        screen.define_pair(6, COLOR_BLACK, COLOR_WHITE);
+        screen.define_pair(7, COLOR_WHITE, COLOR_RED);
+        wrefresh(stdscr); // ncurses' own start up, not part of any frame
+        screen.resize(width, height);
+    }
+
+    PseudoTerminal(const PseudoTerminal&) = delete;
+    PseudoTerminal& operator=(const PseudoTerminal&) = delete;
+
+    ~PseudoTerminal() {
+        endwin();
+        delscreen(terminal);
+        std::fclose(terminal_in);
+        std::fclose(terminal_out);
+        reader.join(); // its read() fails once the last descriptor of the slave side is closed
+        close(master);
+    }
+};
+
+void output_benchmarks() {
+    const int width = 202, height = 62;
+    const unsigned long frames = 20000;
+
+    PseudoTerminal terminal(width, height);
+    counted_fd = terminal.slave;
+    const OutputRun curses = run_output(terminal.screen, width, height, frames);
+    terminal.screen.set_backend(OutputBackend::Ansi, terminal.slave);
+    const OutputRun ansi = run_output(terminal.screen, width, height, frames);
+    for (auto const& [name, run] : { std::pair<const char*, OutputRun const*>{ "ncurses", &curses }, { "ansi", &ansi } }) {
+        printf("%-8s %dx%d  first frame %7llu bytes %5llu write()   then %8.1f ns/frame %7.1f bytes/frame %6.2f write()/frame\n",
+            name, width, height, static_cast<unsigned long long>(run->first_frame_bytes), static_cast<unsigned long long>(run->first_frame_writes),
+            run->ns_per_frame, run->bytes_per_frame, run->writes_per_frame);
+    }
+    counted_fd = -1;
+}
+
+
+// -------- regression suite: mean & p99 of the hot paths, written out and compared with a baseline --------
+
+struct Measurement {
+    double mean_ns, p99_ns;
+};
+
+using Measurements = std::map<std::string, Measurement>;
+
+inline constexpr int MEASURE_ROUNDS = 3;
+
+// runs a measurement MEASURE_ROUNDS times and keeps the lowest mean and p99, a round that was preempted otherwise
+// reads as a regression
+template <typename F>
+Measurement best_of_rounds(F&& run) {
+    Measurement best{};
+    for (int round = 0; round < MEASURE_ROUNDS; ++round) {
+        const Measurement measurement = run();
+        best.mean_ns = round == 0 ? measurement.mean_ns : std::min(best.mean_ns, measurement.mean_ns);
+        best.p99_ns = round == 0 ? measurement.p99_ns : std::min(best.p99_ns, measurement.p99_ns);
+    }
+    return best;
+}
+
+// times batches of batch_size calls, op(i) for i = 0, 1, 2 ..., so ops much shorter than a clock read still get a p99
+template <typename F>
+Measurement measure(unsigned long const batches, unsigned long const batch_size, F&& op) {
+    unsigned long i = 0;
+    return best_of_rounds([&] {
+        LatencyHistogram batch_time;
+        for (unsigned long batch = 0; batch < batches; ++batch) {
+            const auto start_time = std::chrono::steady_clock::now();
+            for (unsigned long n = 0; n < batch_size; ++n)
+                op(i++);
+            batch_time.record(std::chrono::steady_clock::now() - start_time);
+        }
+        return Measurement{ batch_time.mean_ns() / batch_size, static_cast<double>(batch_time.percentile_ns(99)) / batch_size };
+    });
+}
+
+void print_measurement(std::string const& name, Measurement const& measurement) {
+    printf("%-26s mean %10.1f ns  p99 %10.1f ns\n", name.c_str(), measurement.mean_ns, measurement.p99_ns);
+}
+
+// steers a snake back and forth across the rows of its band, one row lower at each end, so it never runs out of room
+Direction serpentine(Player const& player, int const width) {
+    const Coordinates head = player.get_body().front();
+    switch (player.get_direction()) {
+        case Direction::Right: return head.x == width - 2 ? Direction::Down : Direction::None;
+        case Direction::Left: return head.x == 1 ? Direction::Down : Direction::None;
+        default: return head.x == 1 ? Direction::Right : Direction::Left;
+    }
+}
+
+/*
+A tick with snakes of the given length. Collisions are one lookup in the
+board whatever the lengths, this checks it stays that way: both snakes
+snake through bands of rows tall enough for length + timed ticks cells,
+grow to full length first and are then timed as they carry on, every
+round further down.
+*/
+Measurement bench_tick_at_length(std::size_t const length, unsigned long const ticks) {
+    const int width = 1026;
+    const int band = static_cast<int>((length + MEASURE_ROUNDS * ticks) / (width - 2)) + 2;
+    const int height = 2 * band + 2;
+    const std::size_t capacity = body_capacity(width, height);
+    const int lengths[] = { static_cast<int>(length), 10 };
+    vector<shared_ptr<Player>> players;
+    for (int i = 0; i < 2; ++i)
+        players.push_back(make_shared<Player>(i + 1, Coordinates{ 1, 1 + i * band }, Direction::Right, 0, 0, 0, 0, lengths[i], capacity));
+    Simulation simulation(width, height, players, 1u << 30); // growing only to the initial length
+    Direction commands[MAX_PLAYERS] = {};
+    auto step = [&] {
+        for (std::size_t i = 0; i < 2; ++i)
+            commands[i] = serpentine(*players[i], width);
+        if (simulation.step(commands) != NO_WINNER)
+            throw runtime_error("a serpentine snake crashed");
+    };
+    for (std::size_t tick = 0; tick < length; ++tick)
+        step();
+    const unsigned long batch_size = 64;
+    return measure(ticks / batch_size, batch_size, [&](unsigned long) { step(); });
+}
+
+/*
+A turn handed from the keyboard to the game loop while both are busy: a
+thread pushes key presses into an SpscQueue the moment the previous one
+was taken, the game loop's side pops them, queues each in a TurnBuffer,
+applies it with Snake::change_direction and moves. Measured from the push
+to the move, the cost of the handoff between cores included.
+*/
+Measurement bench_turn_handoff(unsigned long const turns) {
+    return best_of_rounds([turns] {
+        SpscQueue<KeyEvent, 64> queue;
+        std::atomic<unsigned long> taken{ 0 };
+        std::thread keyboard([&] {
+            for (unsigned long i = 0; i < turns; ++i) {
+                while (taken.load(std::memory_order_acquire) != i)
+                    std::this_thread::yield(); // or a single core would only switch threads when a time slice ends
+                while (!queue.try_push({ static_cast<int>(i % 2), std::chrono::steady_clock::now() }))
+                    std::this_thread::yield();
+            }
+        });
+        Snake snake({ 1, 1 }, Direction::Right, 100, 128);
+        TurnBuffer buffer;
+        LatencyHistogram latency;
+        for (unsigned long i = 0; i < turns; ++i) {
+            KeyEvent event;
+            while (!queue.try_pop(event))
+                std::this_thread::yield();
+            taken.store(i + 1, std::memory_order_release);
+            buffer.push({ event.ch == 0 ? Direction::Down : Direction::Right, event.time }, snake.get_direction());
+            TurnBuffer::Turn turn;
+            if (buffer.pop(turn))
+                snake.change_direction(turn.dir);
+            do_not_optimize(snake.move());
+            latency.record(std::chrono::steady_clock::now() - event.time);
+        }
+        keyboard.join();
+        return Measurement{ latency.mean_ns(), static_cast<double>(latency.percentile_ns(99)) };
+    });
+}
+
+/*
+What Game::update does in a tick, without a terminal: player 1's turns
+come through a TurnBuffer (a random key press every few ticks), player 2
+is a FloodFillBot, then the simulation steps. A new match starts when one
+ends, as in the game.
+*/
+Measurement bench_game_tick(unsigned long const ticks) {
+    const int width = 202, height = 62;
+    auto players = make_bot_players(width, height, 2);
+    Simulation simulation(width, height, players);
+    TurnBuffer turns;
+    RandomBot keys(1);
+    FloodFillBot bot;
+    bot.prepare(simulation);
+    Direction commands[MAX_PLAYERS] = {};
+    return measure(ticks, 1, [&](unsigned long) {
+        turns.push({ keys.next_command(), std::chrono::steady_clock::now() }, simulation.get_player1().get_direction());
+        TurnBuffer::Turn turn;
+        commands[0] = turns.pop(turn) ? turn.dir : Direction::None;
+        commands[1] = simulation.is_alive(1) ? bot.next_command(simulation, PLAYER2) : Direction::None;
+        if (simulation.step(commands) != NO_WINNER) {
+            turns.clear();
+            simulation.reset(make_bot_players(width, height, 2));
+        }
+    });
+}
+
+Measurements regression_benchmarks() {
+    Measurements results;
+    auto add = [&](std::string const& name, Measurement const& measurement) {
+        results[name] = measurement;
+        print_measurement(name, measurement);
+    };
+    for (std::size_t length : { 10, 100, 1000, 10000, 100000 }) {
+        Snake snake({ 1, 1 }, Direction::Right, static_cast<int>(length), length + 1);
+        for (std::size_t i = 0; i < length; ++i)
+            snake.move(); // full length before timing
+        add("snake_move/" + std::to_string(length), measure(20000, 256, [&](unsigned long i) {
+            if (i % 500 == 0)
+                snake.change_direction(i / 500 % 2 ? Direction::Right : Direction::Down);
+            do_not_optimize(snake.move());
+        }));
+    }
+    add("turn_handoff", bench_turn_handoff(200000));
+    for (std::size_t length : { 10, 1000, 100000 })
+        add("tick_at_length/" + std::to_string(length), bench_tick_at_length(length, 60000));
+    add("game_tick", bench_game_tick(200000));
+
+    const int width = 202, height = 62;
+    PseudoTerminal terminal(width, height);
+    // frames of a 4 player game through each backend. ncurses draws to the pseudo terminal, the ansi frames go to
+    // /dev/null: on a single core the terminal's reader being scheduled would swamp composing a frame
+    const int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd < 0)
+        throw runtime_error("can't open /dev/null");
+    for (OutputBackend const backend : { OutputBackend::Ncurses, OutputBackend::Ansi }) {
+        terminal.screen.set_backend(backend, backend == OutputBackend::Ansi ? null_fd : terminal.slave);
+        add(backend == OutputBackend::Ansi ? "render_frame/ansi" : "render_frame/ncurses", best_of_rounds([&] {
+            const OutputRun run = run_output(terminal.screen, width, height, 5000);
+            return Measurement{ run.ns_per_frame, static_cast<double>(run.frame_time.percentile_ns(99)) };
+        }));
+    }
+    close(null_fd);
+    return results;
+}
+
+// one "name mean_ns p99_ns" line per benchmark, # starts a comment
+void write_results(std::string const& path, Measurements const& results) {
+    std::FILE* out = std::fopen(path.c_str(), "w");
+    if (out == nullptr)
+        throw runtime_error("could not write " + path);
+    std::fprintf(out, "# benchmark\tmean_ns\tp99_ns\n");
+    for (auto const& [name, measurement] : results)
+        std::fprintf(out, "%s\t%.1f\t%.1f\n", name.c_str(), measurement.mean_ns, measurement.p99_ns);
+    std::fclose(out);
+}
+
+Measurements read_results(std::string const& path) {
+    std::FILE* in = std::fopen(path.c_str(), "r");
+    if (in == nullptr)
+        throw runtime_error("could not read " + path);
+    Measurements results;
+    char line[256], name[128];
+    Measurement measurement;
+    while (std::fgets(line, sizeof(line), in) != nullptr) {
+        if (line[0] != '#' && std::sscanf(line, "%127s %lf %lf", name, &measurement.mean_ns, &measurement.p99_ns) == 3)
+            results[name] = measurement;
+    }
+    std::fclose(in);
+    return results;
+}
+
+// a benchmark regressed if its mean got more than tolerance slower than the baseline's, or its p99 twice that
+bool compare_with_baseline(Measurements const& results, Measurements const& baseline, double const tolerance) {
+    unsigned regressions = 0;
+    printf("%-26s %12s %12s %12s %12s\n", "vs baseline", "mean", "change", "p99", "change");
+    for (auto const& [name, base] : baseline) {
+        const auto found = results.find(name);
+        if (found == results.end()) {
+            printf("%-26s missing\n", name.c_str());
+            ++regressions;
+            continue;
+        }
+        Measurement const& now = found->second;
+        const double mean_change = now.mean_ns / base.mean_ns - 1, p99_change = now.p99_ns / base.p99_ns - 1;
+        const bool regressed = mean_change > tolerance || p99_change > 2 * tolerance;
+        printf("%-26s %9.1f ns %+11.1f%% %9.1f ns %+11.1f%%%s\n", name.c_str(), now.mean_ns, 100 * mean_change,
+            now.p99_ns, 100 * p99_change, regressed ? "  REGRESSION" : "");
+        regressions += regressed;
+    }
+    printf("%u regressions (tolerance %.0f%% mean, %.0f%% p99)\n", regressions, 100 * tolerance, 200 * tolerance);
+    return regressions == 0;
+}
+}
+
+int main(int argc, char** argv) {
+    try {
+        // [GROUP] [--results FILE] [--baseline FILE] [--tolerance PERCENT], the options are for the regress group
+        const char* only = nullptr;
+        std::string results_path, baseline_path;
+        double tolerance = 0.3;
+        for (int i = 1; i < argc; ++i) {
+            const bool has_value = i + 1 < argc;
+            if (!strcmp(argv[i], "--results") && has_value)
+                results_path = argv[++i];
+            else if (!strcmp(argv[i], "--baseline") && has_value)
+                baseline_path = argv[++i];
+            else if (!strcmp(argv[i], "--tolerance") && has_value)
+                tolerance = atof(argv[++i]) / 100;
+            else if (argv[i][0] != '-' && only == nullptr)
+                only = argv[i];
+            else
+                throw runtime_error(std::string("unknown argument: ") + argv[i]);
+        }
+        if (!only || !strcmp(only, "snake_move"))
+            snake_move_benchmarks();
+        if (!only || !strcmp(only, "players"))
+            players_benchmarks();
+        if (!only || !strcmp(only, "arena"))
+            arena_benchmarks();
+        if (!only || !strcmp(only, "config"))
+            config_benchmarks();
+        if (!only || !strcmp(only, "batch"))
+            batch_benchmarks();
+        if (!only || !strcmp(only, "output"))
+            output_benchmarks();
+        if (!only || !strcmp(only, "regress")) {
+            const Measurements results = regression_benchmarks();
+            if (!results_path.empty())
+                write_results(results_path, results);
+            if (!baseline_path.empty() && !compare_with_baseline(results, read_results(baseline_path), tolerance))
+                return 1;
+        }
+    } catch (const exception& err) {
+        fprintf(stderr, "bench: %s\n", err.what());
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,437 @@
+#ifndef BOARD_H
+#define BOARD_H
+
+#include "core.h"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+using std::vector;
+
+namespace snake {
+
+inline constexpr std::uint8_t CELL_EMPTY  = 0;    // nobody is here
+inline constexpr std::uint8_t CELL_BORDER = 0xFF; // the wall around the board
+inline constexpr std::uint8_t CELL_FOOD   = 0xFE; // a pellet, only in copies drawn from (a board keeps it CELL_EMPTY)
+// any other value is the id of the player whose snake occupies the cell
+
+/*
+One bit per cell, each row padded to whole 64 bit words so that rows can be
+processed a word (64 cells) at a time with shifts, ands and popcounts.
+Padding bits past the right edge are always 0.
+*/
+class BitBoard {
+    int width, height, words_per_row;
+    vector<std::uint64_t> words;
+
+public:
+    BitBoard() : width(0), height(0), words_per_row(0) {}
+
+    BitBoard(int w, int h) {
+        reset(w, h);
+    }
+
+    void reset(int w, int h) {
+        width = w;
+        height = h;
+        words_per_row = (w + 63) / 64;
+        words.assign(static_cast<std::size_t>(words_per_row) * h, 0);
+    }
+
+    void clear() {
+        std::fill(words.begin(), words.end(), 0);
+    }
+
+    void set(Coordinates const& pos) {
+        row(pos.y)[pos.x >> 6] |= std::uint64_t(1) << (pos.x & 63);
+    }
+
+    void reset_bit(Coordinates const& pos) {
+        row(pos.y)[pos.x >> 6] &= ~(std::uint64_t(1) << (pos.x & 63));
+    }
+
+    bool test(Coordinates const& pos) const {
+        return (row(pos.y)[pos.x >> 6] >> (pos.x & 63)) & 1;
+    }
+
+    std::uint64_t* row(int const y) {
+        return words.data() + static_cast<std::size_t>(y) * words_per_row;
+    }
+
+    std::uint64_t const* row(int const y) const {
+        return words.data() + static_cast<std::size_t>(y) * words_per_row;
+    }
+
+    // mask of the bits in word i of a row that are on the board
+    std::uint64_t row_mask(int const i) const {
+        const int bits = width - i * 64;
+        return bits >= 64 ? ~std::uint64_t(0) : (std::uint64_t(1) << bits) - 1;
+    }
+
+    std::size_t count() const {
+        std::size_t total = 0;
+        for (std::uint64_t word : words)
+            total += __builtin_popcountll(word);
+        return total;
+    }
+
+    int get_width() const {
+        return width;
+    }
+
+    int get_height() const {
+        return height;
+    }
+
+    int get_words_per_row() const {
+        return words_per_row;
+    }
+};
+
+/*
+Logical model of the playing field, one byte per cell, row major. The border
+is stored in the grid itself, so "is this cell occupied, and by whom" is a
+single load whether the answer is a wall, a snake or nothing. The grid is
+kept up to date incrementally by Simulation as heads are pushed and tails
+are popped, it never has to be rebuilt from the snake bodies. A bit-packed
+copy of "occupied or not" is kept alongside for word-parallel searches.
+*/
+class Board {
+    int width, height; // full board dimensions, border included
+    vector<std::uint8_t> cells;
+    BitBoard occupied_bits;
+
+    std::size_t index(Coordinates const& pos) const {
+        return static_cast<std::size_t>(pos.y) * width + pos.x;
+    }
+
+public:
+    Board(int w, int h) {
+        reset(w, h);
+    }
+
+    void reset(int w, int h) {
+        width = w;
+        height = h;
+        cells.assign(static_cast<std::size_t>(width) * height, CELL_EMPTY);
+        occupied_bits.reset(width, height);
+        for (int x = 0; x < width; ++x) {
+            cells[index({x, 0})] = CELL_BORDER;
+            cells[index({x, height - 1})] = CELL_BORDER;
+            occupied_bits.set({x, 0});
+            occupied_bits.set({x, height - 1});
+        }
+        for (int y = 0; y < height; ++y) {
+            cells[index({0, y})] = CELL_BORDER;
+            cells[index({width - 1, y})] = CELL_BORDER;
+            occupied_bits.set({0, y});
+            occupied_bits.set({width - 1, y});
+        }
+    }
+
+    bool in_bounds(Coordinates const& pos) const {
+        return pos.x >= 0 && pos.y >= 0 && pos.x < width && pos.y < height;
+    }
+
+    std::uint8_t owner(Coordinates const& pos) const {
+        // anything off the board is treated as wall
+        return in_bounds(pos) ? cells[index(pos)] : CELL_BORDER;
+    }
+
+    bool is_free(Coordinates const& pos) const {
+        return owner(pos) == CELL_EMPTY;
+    }
+
+    void occupy(Coordinates const& pos, std::uint8_t const id) {
+        // the border is never overwritten
+        if (owner(pos) != CELL_BORDER) {
+            cells[index(pos)] = id;
+            occupied_bits.set(pos);
+        }
+    }
+
+    void vacate(Coordinates const& pos) {
+        if (owner(pos) != CELL_BORDER) {
+            cells[index(pos)] = CELL_EMPTY;
+            occupied_bits.reset_bit(pos);
+        }
+    }
+
+    BitBoard const& occupied() const {
+        return occupied_bits;
+    }
+
+    // every cell's owner, row major
+    std::uint8_t const* data() const {
+        return cells.data();
+    }
+
+    int get_width() const {
+        return width;
+    }
+
+    int get_height() const {
+        return height;
+    }
+};
+
+/*
+Board with its dimensions fixed at compile time, for StaticConfig (see
+config.h). The grid is a std::array held inline, so a simulation on the
+stack keeps its grid there too and no lookup loads the width from memory.
+There is no bit-packed copy, searches go through load_occupied() as they
+do on a ChunkedBoard.
+*/
+template <int Width, int Height>
+class FixedBoard {
+    static_assert(Width >= 3 && Height >= 3, "a board needs room inside its border");
+
+    std::array<std::uint8_t, static_cast<std::size_t>(Width) * Height> cells;
+
+    static constexpr std::size_t index(Coordinates const& pos) {
+        return static_cast<std::size_t>(pos.y) * Width + pos.x;
+    }
+
+public:
+    FixedBoard() {
+        clear();
+    }
+
+    // the dimensions can't change, w & h are only there to match Board
+    FixedBoard(int, int) : FixedBoard() {}
+
+    void reset(int, int) {
+        clear();
+    }
+
+    void clear() {
+        cells.fill(CELL_EMPTY);
+        for (int x = 0; x < Width; ++x) {
+            cells[index({x, 0})] = CELL_BORDER;
+            cells[index({x, Height - 1})] = CELL_BORDER;
+        }
+        for (int y = 0; y < Height; ++y) {
+            cells[index({0, y})] = CELL_BORDER;
+            cells[index({Width - 1, y})] = CELL_BORDER;
+        }
+    }
+
+    static constexpr bool in_bounds(Coordinates const& pos) {
+        return pos.x >= 0 && pos.y >= 0 && pos.x < Width && pos.y < Height;
+    }
+
+    std::uint8_t owner(Coordinates const& pos) const {
+        // anything off the board is treated as wall
+        return in_bounds(pos) ? cells[index(pos)] : CELL_BORDER;
+    }
+
+    bool is_free(Coordinates const& pos) const {
+        return owner(pos) == CELL_EMPTY;
+    }
+
+    void occupy(Coordinates const& pos, std::uint8_t const id) {
+        // the border is never overwritten
+        if (owner(pos) != CELL_BORDER)
+            cells[index(pos)] = id;
+    }
+
+    void vacate(Coordinates const& pos) {
+        if (owner(pos) != CELL_BORDER)
+            cells[index(pos)] = CELL_EMPTY;
+    }
+
+    // sets the bits of a window of the board (origin = its top left cell) that are occupied, walls included
+    void load_occupied(BitBoard& bits, Coordinates const& origin) const {
+        bits.clear();
+        for (int y = 0; y < bits.get_height(); ++y) {
+            for (int x = 0; x < bits.get_width(); ++x) {
+                if (owner({ origin.x + x, origin.y + y }) != CELL_EMPTY)
+                    bits.set({ x, y });
+            }
+        }
+    }
+
+    static constexpr int get_width() {
+        return Width;
+    }
+
+    static constexpr int get_height() {
+        return Height;
+    }
+};
+
+/*
+The same interface as Board for arenas far bigger than the screen (up to
+2^31 cells a side). The grid is cut into 64x64 tiles and only tiles with
+at least one snake cell in them are allocated, so memory follows the
+snakes, not the arena's area. The border is not stored: any cell on the
+edge or off the board simply reads as CELL_BORDER. A tile is released
+(kept on a short spare list for the next allocation) once its last cell is
+vacated. Lookups hash the tile coordinates, with the last tile found
+cached since consecutive lookups are almost always in the same tile.
+*/
+class ChunkedBoard {
+public:
+    static constexpr int TILE_SHIFT = 6;
+    static constexpr int TILE_SIZE = 1 << TILE_SHIFT; // cells per tile side
+    static constexpr int TILE_MASK = TILE_SIZE - 1;
+
+private:
+    struct Tile {
+        std::array<std::uint8_t, TILE_SIZE * TILE_SIZE> cells;
+        int used; // cells not CELL_EMPTY
+    };
+
+    static constexpr std::size_t MAX_SPARE_TILES = 64;
+    static constexpr std::uint64_t NO_TILE = ~std::uint64_t(0);
+
+    int width, height; // full board dimensions, border included
+    std::unordered_map<std::uint64_t, std::unique_ptr<Tile>> tiles;
+    vector<std::unique_ptr<Tile>> spare_tiles;
+    mutable std::uint64_t cached_key;
+    mutable Tile* cached_tile;
+
+    static std::uint64_t tile_key(Coordinates const& pos) {
+        return (static_cast<std::uint64_t>(pos.y >> TILE_SHIFT) << 32) | static_cast<std::uint32_t>(pos.x >> TILE_SHIFT);
+    }
+
+    static std::size_t cell_index(Coordinates const& pos) {
+        return (static_cast<std::size_t>(pos.y & TILE_MASK) << TILE_SHIFT) | (pos.x & TILE_MASK);
+    }
+
+    Tile* find_tile(Coordinates const& pos) const {
+        const std::uint64_t key = tile_key(pos);
+        if (key != cached_key) {
+            const auto it = tiles.find(key);
+            cached_key = key;
+            cached_tile = it == tiles.end() ? nullptr : it->second.get();
+        }
+        return cached_tile;
+    }
+
+    bool on_border(Coordinates const& pos) const {
+        return pos.x <= 0 || pos.y <= 0 || pos.x >= width - 1 || pos.y >= height - 1;
+    }
+
+public:
+    ChunkedBoard(int w, int h) : width(0), height(0), cached_key(NO_TILE), cached_tile(nullptr) {
+        reset(w, h);
+    }
+
+    void reset(int w, int h) {
+        width = w;
+        height = h;
+        for (auto& entry : tiles) {
+            if (spare_tiles.size() < MAX_SPARE_TILES)
+                spare_tiles.push_back(std::move(entry.second));
+        }
+        tiles.clear();
+        cached_key = NO_TILE;
+        cached_tile = nullptr;
+    }
+
+    bool in_bounds(Coordinates const& pos) const {
+        return pos.x >= 0 && pos.y >= 0 && pos.x < width && pos.y < height;
+    }
+
+    std::uint8_t owner(Coordinates const& pos) const {
+        // anything on the edge or off the board is treated as wall
+        if (on_border(pos))
+            return CELL_BORDER;
+        Tile const* tile = find_tile(pos);
+        return tile ? tile->cells[cell_index(pos)] : CELL_EMPTY;
+    }
+
+    bool is_free(Coordinates const& pos) const {
+        return owner(pos) == CELL_EMPTY;
+    }
+
+    void occupy(Coordinates const& pos, std::uint8_t const id) {
+        if (on_border(pos))
+            return;
+        Tile* tile = find_tile(pos);
+        if (tile == nullptr) {
+            std::unique_ptr<Tile> fresh;
+            if (spare_tiles.empty()) {
+                fresh = std::make_unique<Tile>();
+            } else {
+                fresh = std::move(spare_tiles.back());
+                spare_tiles.pop_back();
+            }
+            fresh->cells.fill(CELL_EMPTY);
+            fresh->used = 0;
+            tile = fresh.get();
+            tiles.emplace(tile_key(pos), std::move(fresh));
+            cached_key = tile_key(pos);
+            cached_tile = tile;
+        }
+        std::uint8_t& cell = tile->cells[cell_index(pos)];
+        tile->used += cell == CELL_EMPTY;
+        cell = id;
+    }
+
+    void vacate(Coordinates const& pos) {
+        if (on_border(pos))
+            return;
+        Tile* tile = find_tile(pos);
+        if (tile == nullptr || tile->cells[cell_index(pos)] == CELL_EMPTY)
+            return;
+        tile->cells[cell_index(pos)] = CELL_EMPTY;
+        if (--tile->used == 0) {
+            const auto it = tiles.find(tile_key(pos));
+            if (spare_tiles.size() < MAX_SPARE_TILES)
+                spare_tiles.push_back(std::move(it->second));
+            tiles.erase(it);
+            cached_key = NO_TILE;
+            cached_tile = nullptr;
+        }
+    }
+
+    // sets the bits of a window of the board (origin = its top left cell) that are occupied, walls included
+    void load_occupied(BitBoard& bits, Coordinates const& origin) const {
+        bits.clear();
+        for (int y = 0; y < bits.get_height(); ++y) {
+            for (int x = 0; x < bits.get_width(); ) {
+                const Coordinates pos{ origin.x + x, origin.y + y };
+                if (on_border(pos)) {
+                    bits.set({ x, y });
+                    ++x;
+                    continue;
+                }
+                // the rest of this tile's row in one go
+                const int run = std::min({ bits.get_width() - x, TILE_SIZE - (pos.x & TILE_MASK), width - 1 - pos.x });
+                if (Tile const* tile = find_tile(pos)) {
+                    std::uint8_t const* cells = tile->cells.data() + cell_index(pos);
+                    for (int i = 0; i < run; ++i) {
+                        if (cells[i] != CELL_EMPTY)
+                            bits.set({ x + i, y });
+                    }
+                }
+                x += run;
+            }
+        }
+    }
+
+    std::size_t get_tile_count() const {
+        return tiles.size();
+    }
+
+    // bytes held by tiles in use and spare, not counting the hash table itself
+    std::size_t get_tile_bytes() const {
+        return (tiles.size() + spare_tiles.size()) * sizeof(Tile);
+    }
+
+    int get_width() const {
+        return width;
+    }
+
+    int get_height() const {
+        return height;
+    }
+};
+}
+
+#endif
@@ -0,0 +1,306 @@
+#ifndef BOTS_H
+#define BOTS_H
+
+#include "simulation.h"
+#include "stats.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+
+namespace snake {
+
+// stand-in for a keyboard: turns in a random direction roughly once every 8 ticks
+class RandomBot {
+    SplitMix64 rng;
+
+public:
+    explicit RandomBot(std::uint64_t seed) : rng(seed) {}
+
+    Direction next_command() {
+        const std::uint64_t roll = rng.next();
+        if ((roll & 7) != 0)
+            return Direction::None;
+        static constexpr Direction turns[] = { Direction::Up, Direction::Down, Direction::Left, Direction::Right };
+        return turns[(roll >> 3) & 3];
+    }
+};
+
+/*
+Picks the move that leaves its snake the most room. For each of the (up to
+3) legal moves it flood fills the free cells reachable from the cell it
+would move into and counts them. The fill runs on BitBoards, 64 cells per
+word: each row is seeded from the rows above and below, then filled left
+and right through its free cells with a word-parallel occluded fill.
+Passes alternate top-down and bottom-up until nothing changes, so the
+number of passes depends on how twisty the free space is, not how big.
+Only rows within one of the area reached so far are visited.
+
+Each decision has a time budget. The clock is checked between candidate
+moves and every few passes of a fill; once the budget is spent the best
+move found so far is used (an unfinished fill counts what it had reached).
+
+On a ChunkedBoard arena (or a FixedBoard) only a WINDOW x WINDOW square around the head is
+searched, with everything outside it counted as wall.
+*/
+class FloodFillBot {
+    using clock = std::chrono::steady_clock;
+
+    std::chrono::microseconds budget;
+    BitBoard free_cells, reachable;
+    BitBoard window_cells; // occupied cells around the head, arenas only
+    LatencyHistogram decision_time;
+    unsigned long budget_overruns;
+
+    static constexpr int PASSES_PER_CLOCK_CHECK = 4;
+    static constexpr int MAX_WORDS_PER_ROW = 64; // boards up to 4096 cells wide
+    static constexpr int WINDOW = 256; // cells searched around the head on an arena
+
+    void load_free_cells(BitBoard const& occupied) {
+        if (occupied.get_words_per_row() > MAX_WORDS_PER_ROW)
+            throw runtime_error("board too wide for FloodFillBot");
+        if (free_cells.get_width() != occupied.get_width() || free_cells.get_height() != occupied.get_height()) {
+            free_cells.reset(occupied.get_width(), occupied.get_height());
+            reachable.reset(occupied.get_width(), occupied.get_height());
+        }
+        const int words = occupied.get_words_per_row();
+        for (int y = 0; y < occupied.get_height(); ++y) {
+            std::uint64_t const* src = occupied.row(y);
+            std::uint64_t* dst = free_cells.row(y);
+            for (int i = 0; i < words; ++i)
+                dst[i] = ~src[i] & occupied.row_mask(i);
+        }
+    }
+
+    // the whole board is searched, returns the window's top left cell
+    Coordinates load_free_cells(Board const& board, Coordinates const&) {
+        load_free_cells(board.occupied());
+        return { 0, 0 };
+    }
+
+    // boards without a bit-packed copy (ChunkedBoard, FixedBoard) load a window around the head
+    template <typename BoardType>
+    Coordinates load_free_cells(BoardType const& board, Coordinates const& head) {
+        const int width = std::min(WINDOW, board.get_width()), height = std::min(WINDOW, board.get_height());
+        const Coordinates origin{
+            std::clamp(head.x - width / 2, 0, board.get_width() - width),
+            std::clamp(head.y - height / 2, 0, board.get_height() - height)
+        };
+        if (window_cells.get_width() != width || window_cells.get_height() != height)
+            window_cells.reset(width, height);
+        board.load_occupied(window_cells, origin);
+        load_free_cells(window_cells);
+        return origin;
+    }
+
+    // Kogge-Stone occluded fill: spread seed bits towards higher bits through runs of free bits, 6 steps per word
+    static std::uint64_t fill_up(std::uint64_t seed, std::uint64_t free) {
+        seed &= free;
+        seed |= free & (seed << 1);  free &= free << 1;
+        seed |= free & (seed << 2);  free &= free << 2;
+        seed |= free & (seed << 4);  free &= free << 4;
+        seed |= free & (seed << 8);  free &= free << 8;
+        seed |= free & (seed << 16); free &= free << 16;
+        seed |= free & (seed << 32);
+        return seed;
+    }
+
+    static std::uint64_t fill_down(std::uint64_t seed, std::uint64_t free) {
+        seed &= free;
+        seed |= free & (seed >> 1);  free &= free >> 1;
+        seed |= free & (seed >> 2);  free &= free >> 2;
+        seed |= free & (seed >> 4);  free &= free >> 4;
+        seed |= free & (seed >> 8);  free &= free >> 8;
+        seed |= free & (seed >> 16); free &= free >> 16;
+        seed |= free & (seed >> 32);
+        return seed;
+    }
+
+    // grows row y from its neighbours, then fills it left & right as far as the free cells allow
+    bool grow_row(int const y, int const words, int const height) {
+        std::uint64_t* row = reachable.row(y);
+        std::uint64_t const* above = y > 0 ? reachable.row(y - 1) : nullptr;
+        std::uint64_t const* below = y < height - 1 ? reachable.row(y + 1) : nullptr;
+        std::uint64_t const* free_row = free_cells.row(y);
+        std::uint64_t grown[MAX_WORDS_PER_ROW];
+        std::uint64_t any = 0;
+        for (int i = 0; i < words; ++i) {
+            std::uint64_t seed = row[i];
+            if (above)
+                seed |= above[i];
+            if (below)
+                seed |= below[i];
+            grown[i] = seed & free_row[i];
+            any |= grown[i];
+        }
+        if (any == 0)
+            return false;
+        std::uint64_t carry = 0; // bit 63 of the previous word reached bit 0 of this one
+        for (int i = 0; i < words; ++i) {
+            grown[i] = fill_up(grown[i] | carry, free_row[i]);
+            carry = grown[i] >> 63;
+        }
+        carry = 0; // bit 0 of the next word reached bit 63 of this one
+        for (int i = words - 1; i >= 0; --i) {
+            grown[i] = fill_down(grown[i] | (carry << 63), free_row[i]);
+            carry = grown[i] & 1;
+        }
+        bool changed = false;
+        for (int i = 0; i < words; ++i) {
+            if (grown[i] != row[i]) {
+                row[i] = grown[i];
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+    // number of free cells reachable from start (start included)
+    std::size_t flood_fill(Coordinates const& start, clock::time_point const deadline) {
+        const int words = reachable.get_words_per_row();
+        const int height = reachable.get_height();
+        reachable.clear();
+        reachable.set(start);
+        int top = start.y, bottom = start.y; // rows reached so far
+        for (int pass = 1; ; ++pass) {
+            bool changed = false;
+            // alternate sweeping down and up, rows are updated in place and the sweep keeps going while
+            // rows keep growing, so one pass carries a fill along a whole column
+            const bool downwards = pass % 2 == 1;
+            for (int y = downwards ? std::max(top - 1, 0) : std::min(bottom + 1, height - 1);
+                 downwards ? y <= std::min(bottom + 1, height - 1) : y >= std::max(top - 1, 0);
+                 y += downwards ? 1 : -1) {
+                if (grow_row(y, words, height)) {
+                    changed = true;
+                    top = std::min(top, y);
+                    bottom = std::max(bottom, y);
+                }
+            }
+            if (!changed)
+                break;
+            if (pass % PASSES_PER_CLOCK_CHECK == 0 && clock::now() > deadline)
+                break; // out of time, count what has been reached so far
+        }
+        return reachable.count();
+    }
+
+public:
+    explicit FloodFillBot(std::chrono::microseconds time_budget = std::chrono::microseconds(1000)) :
+        budget(time_budget),
+        budget_overruns(0)
+    {}
+
+    // sizes the search for simulation's board, so the first decision of a match doesn't allocate
+    template <typename Config>
+    void prepare(BasicSimulation<Config> const& simulation) {
+        load_free_cells(simulation.get_board(), simulation.get_player(0).get_snake().get_head());
+    }
+
+    template <typename Config>
+    Direction next_command(BasicSimulation<Config> const& simulation, int const player_id) {
+        const auto start_time = clock::now();
+        const auto deadline = start_time + budget;
+        Player const& me = simulation.get_player(player_id - 1);
+        const Coordinates head = me.get_body().front();
+        const Direction current = me.get_direction();
+        auto const& board = simulation.get_board();
+        const Coordinates origin = load_free_cells(board, head);
+
+        // going straight is tried first, so it wins ties and is never skipped for lack of time
+        static constexpr Direction turns[] = { Direction::Up, Direction::Down, Direction::Left, Direction::Right };
+        Direction candidates[4];
+        int candidate_count = 0;
+        if (current != Direction::None)
+            candidates[candidate_count++] = current;
+        for (Direction dir : turns) {
+            if (dir != current && dir != get_opposite(current))
+                candidates[candidate_count++] = dir;
+        }
+
+        Direction best = Direction::None;
+        double best_score = -1;
+        for (int c = 0; c < candidate_count; ++c) {
+            const Direction dir = candidates[c];
+            const Coordinates next = Config::Border::next_position(head, dir);
+            if (!board.is_free(next))
+                continue;
+            if (best != Direction::None && clock::now() > deadline)
+                break;
+            double score = static_cast<double>(flood_fill({ next.x - origin.x, next.y - origin.y }, deadline));
+            // a cell another moving head can also reach next tick risks a head on crash
+            for (std::size_t i = 0; i < simulation.get_player_count(); ++i) {
+                if (i == static_cast<std::size_t>(player_id - 1) || !simulation.is_alive(i))
+                    continue;
+                const Coordinates other_head = simulation.get_player(i).get_snake().get_head();
+                if (std::abs(next.x - other_head.x) + std::abs(next.y - other_head.y) == 1) {
+                    score /= 2;
+                    break;
+                }
+            }
+            if (score > best_score) {
+                best_score = score;
+                best = dir;
+            }
+        }
+
+        const auto elapsed = clock::now() - start_time;
+        decision_time.record(elapsed);
+        if (elapsed > budget)
+            ++budget_overruns;
+        return best; // None (keep going, and crash) if every move is blocked
+    }
+
+    LatencyHistogram const& get_decision_time() const {
+        return decision_time;
+    }
+
+    unsigned long get_budget_overruns() const {
+        return budget_overruns;
+    }
+};
+
+enum class BotKind {
+    Random, FloodFill
+};
+
+// a computer player of either kind, so any side of a match can be driven by either
+class Bot {
+    BotKind kind;
+    RandomBot random_bot;
+    FloodFillBot flood_fill_bot;
+
+public:
+    Bot(BotKind bot_kind, std::uint64_t seed, std::chrono::microseconds budget = std::chrono::microseconds(1000)) :
+        kind(bot_kind),
+        random_bot(seed),
+        flood_fill_bot(budget)
+    {}
+
+    template <typename Config>
+    Direction next_command(BasicSimulation<Config> const& simulation, int const player_id) {
+        if (kind == BotKind::FloodFill)
+            return flood_fill_bot.next_command(simulation, player_id);
+        return random_bot.next_command();
+    }
+
+    template <typename Config>
+    void prepare(BasicSimulation<Config> const& simulation) {
+        if (kind == BotKind::FloodFill)
+            flood_fill_bot.prepare(simulation);
+    }
+
+    void reseed(std::uint64_t seed) {
+        random_bot = RandomBot(seed);
+    }
+
+    BotKind get_kind() const {
+        return kind;
+    }
+
+    FloodFillBot const& get_flood_fill_bot() const {
+        return flood_fill_bot;
+    }
+};
+}
+
+#endif
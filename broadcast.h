@@ -0,0 +1,610 @@
+#ifndef BROADCAST_H
+#define BROADCAST_H
+
+#include "simulation.h"
+#include "stats.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+using std::runtime_error;
+using std::vector;
+
+namespace snake {
+
+inline constexpr char BROADCAST_MAGIC[4] = { 'S', 'N', 'K', 'B' };
+inline constexpr std::uint16_t BROADCAST_VERSION = 1;
+inline constexpr std::uint32_t KEYFRAME_INTERVAL = 64; // ticks between keyframes, how far a late reader may have to wait
+inline constexpr std::uint64_t NO_KEYFRAME = ~0ull;
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "the feed's positions are shared between processes");
+
+/*
+Spectator feed layout, a POSIX shared memory object: a BroadcastHeader,
+then a ring of records. Positions are byte offsets into the endless stream
+of records, a record at position p is at ring offset p % ring_bytes. Every
+record is a multiple of 8 bytes and never wraps: one that doesn't fit
+before the end of the ring is preceded by a padding record up to the end.
+
+  RecordHeader
+  keyframes only: KeyframeSize
+  scores      ScoreEntry[scores], the scoreboard entries that changed (all of them in a keyframe)
+  collisions  PackedCoordinates[collisions], collisions since the last record (all of them in a keyframe)
+  delta:      CellChange[cells], the cells heads and tails moved through this tick
+  keyframe:   u8[width * height], every cell's owner as Board::owner, row major
+
+The writer reserves the bytes it is about to overwrite (reserved), writes
+the record and then commits it (committed). A reader applies committed
+records straight from the mapping, then checks reserved: if the writer
+has since reached the bytes it read, they may be torn and the reader has
+fallen a whole ring behind. It then starts again from the newest keyframe,
+which replaces its whole board. So the writer never waits for anyone and
+any number of readers can map the feed read only.
+*/
+struct BroadcastHeader {
+    char magic[4];
+    std::uint16_t version;
+    std::uint16_t header_size;
+    std::uint64_t ring_bytes;
+    alignas(64) std::atomic<std::uint64_t> reserved;  // end of the record being written
+    alignas(64) std::atomic<std::uint64_t> committed; // end of the last complete record
+    std::atomic<std::uint64_t> keyframe;              // where the newest keyframe starts, NO_KEYFRAME before the first
+};
+
+enum class RecordKind : std::uint8_t {
+    Padding, Keyframe, Delta
+};
+
+struct RecordHeader {
+    std::uint32_t size; // the whole record, header included
+    RecordKind kind;
+    std::uint8_t game_over;
+    std::int8_t winner; // as Simulation::get_winner
+    std::uint8_t player_count;
+    std::uint32_t match; // counts from 1, every match starts with a keyframe
+    std::uint32_t tick;  // frames since the match started
+    std::uint16_t scores, collisions;
+    std::uint32_t cells;
+};
+
+struct KeyframeSize {
+    std::int32_t width, height;
+};
+
+struct ScoreEntry {
+    std::int32_t id, score; // Scoreboard ids: NO_WINNER, DRAW, then the players
+};
+
+struct CellChange {
+    std::int16_t x, y;
+    std::uint8_t owner, unused;
+};
+
+static_assert(sizeof(RecordHeader) == 24 && sizeof(KeyframeSize) == 8 && sizeof(ScoreEntry) == 8 && sizeof(CellChange) == 6,
+    "the feed's layout is shared between processes");
+
+inline std::uint64_t record_size(RecordKind const kind, std::size_t const scores, std::size_t const collisions, std::size_t const cells) {
+    const std::uint64_t bytes = sizeof(RecordHeader) + scores * sizeof(ScoreEntry) + collisions * sizeof(PackedCoordinates) +
+        (kind == RecordKind::Keyframe ? sizeof(KeyframeSize) + cells : cells * sizeof(CellChange));
+    return (bytes + 7) & ~7ull;
+}
+
+// names are given without the leading slash shm_open wants
+inline std::string shared_memory_name(std::string const& name) {
+    return name.empty() || name[0] != '/' ? "/" + name : name;
+}
+
+struct BroadcastStats {
+    unsigned long records = 0, keyframes = 0;
+    std::uint64_t bytes = 0, padding = 0;
+    LatencyHistogram publish_time; // writing one tick's record
+
+    void print(std::FILE* out) const {
+        std::fprintf(out, "broadcast records %lu (%lu keyframes), %llu bytes, %llu padding\n", records, keyframes,
+            static_cast<unsigned long long>(bytes), static_cast<unsigned long long>(padding));
+        publish_time.print(out, "broadcast publish");
+    }
+};
+
+// publishes a match into the feed, only the writer's own thread ever touches it
+class BroadcastWriter {
+    using clock = std::chrono::steady_clock;
+
+    std::string name;
+    int fd;
+    void* memory;
+    std::size_t mapped_bytes;
+    BroadcastHeader* header;
+    std::uint8_t* ring;
+    std::uint64_t ring_bytes;
+    std::uint64_t position; // end of the last record committed
+    std::uint32_t match;
+    std::uint32_t last_keyframe_tick;
+    bool keyframe_due;
+    int width, height; // of the last keyframe
+    std::size_t collisions_sent;
+    std::array<std::int32_t, MAX_PLAYERS + 2> sent_scores; // by Scoreboard id + 1, -1 = never sent
+    BroadcastStats stats;
+
+    // returns where to write a record of size bytes, skipping the end of the ring if it doesn't fit there
+    std::uint8_t* reserve(std::uint64_t const size) {
+        std::uint64_t offset = position % ring_bytes;
+        if (offset + size > ring_bytes) {
+            const std::uint64_t rest = ring_bytes - offset;
+            header->reserved.store(position + rest, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            const std::uint32_t padding_size = static_cast<std::uint32_t>(rest);
+            std::memcpy(ring + offset, &padding_size, sizeof(padding_size));
+            ring[offset + sizeof(padding_size)] = static_cast<std::uint8_t>(RecordKind::Padding);
+            commit(position + rest);
+            stats.padding += rest;
+            offset = 0;
+        }
+        header->reserved.store(position + size, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        return ring + offset;
+    }
+
+    void commit(std::uint64_t const end) {
+        header->committed.store(end, std::memory_order_release);
+        position = end;
+    }
+
+    template <typename T>
+    static std::uint8_t* put(std::uint8_t* out, T const& value) {
+        std::memcpy(out, &value, sizeof(T));
+        return out + sizeof(T);
+    }
+
+    template <typename Config>
+    RecordHeader make_header(RecordKind const kind, std::uint64_t const size, BasicSimulation<Config> const& simulation, int const winner) const {
+        RecordHeader record{};
+        record.size = static_cast<std::uint32_t>(size);
+        record.kind = kind;
+        record.game_over = winner != NO_WINNER;
+        record.winner = static_cast<std::int8_t>(winner);
+        record.player_count = static_cast<std::uint8_t>(simulation.get_player_count());
+        record.match = match;
+        record.tick = static_cast<std::uint32_t>(simulation.get_frame_count());
+        return record;
+    }
+
+    template <typename Config>
+    void write_keyframe(BasicSimulation<Config> const& simulation, Scoreboard const& scoreboard, int const winner) {
+        vector<Coordinates> const& collisions = simulation.get_collisions();
+        const std::size_t cells = static_cast<std::size_t>(simulation.get_width()) * simulation.get_height();
+        const std::uint64_t size = record_size(RecordKind::Keyframe, scoreboard.size(), collisions.size(), cells);
+        if (size > ring_bytes / 4)
+            throw runtime_error("board too large for the broadcast ring");
+        std::uint8_t* out = reserve(size);
+        const std::uint64_t start = position;
+        RecordHeader record = make_header(RecordKind::Keyframe, size, simulation, winner);
+        record.scores = static_cast<std::uint16_t>(scoreboard.size());
+        record.collisions = static_cast<std::uint16_t>(collisions.size());
+        record.cells = static_cast<std::uint32_t>(cells);
+        out = put(out, record);
+        out = put(out, KeyframeSize{ simulation.get_width(), simulation.get_height() });
+        for (auto const& [id, score] : scoreboard) {
+            out = put(out, ScoreEntry{ id, score });
+            sent_scores[id + 1] = score;
+        }
+        for (Coordinates const& pos : collisions)
+            out = put(out, PackedCoordinates(pos));
+        std::memcpy(out, simulation.get_board().data(), cells);
+        commit(start + size);
+        header->keyframe.store(start, std::memory_order_release);
+        width = simulation.get_width();
+        height = simulation.get_height();
+        collisions_sent = collisions.size();
+        last_keyframe_tick = record.tick;
+        keyframe_due = false;
+        ++stats.records;
+        ++stats.keyframes;
+        stats.bytes += size;
+    }
+
+    template <typename Config>
+    void write_delta(BasicSimulation<Config> const& simulation, Scoreboard const& scoreboard, int const winner) {
+        vector<Coordinates> const& collisions = simulation.get_collisions();
+        auto const& board = simulation.get_board();
+        std::size_t scores = 0, cells = 0;
+        for (auto const& [id, score] : scoreboard)
+            scores += sent_scores[id + 1] != score;
+        for (std::size_t i = 0; i < simulation.get_player_count(); ++i)
+            cells += 1 + simulation.get_move(i).tail_popped;
+        const std::uint64_t size = record_size(RecordKind::Delta, scores, collisions.size() - collisions_sent, cells);
+        std::uint8_t* out = reserve(size);
+        const std::uint64_t start = position;
+        RecordHeader record = make_header(RecordKind::Delta, size, simulation, winner);
+        record.scores = static_cast<std::uint16_t>(scores);
+        record.collisions = static_cast<std::uint16_t>(collisions.size() - collisions_sent);
+        record.cells = static_cast<std::uint32_t>(cells);
+        out = put(out, record);
+        for (auto const& [id, score] : scoreboard) {
+            if (sent_scores[id + 1] != score) {
+                out = put(out, ScoreEntry{ id, score });
+                sent_scores[id + 1] = score;
+            }
+        }
+        for (std::size_t i = collisions_sent; i < collisions.size(); ++i)
+            out = put(out, PackedCoordinates(collisions[i]));
+        // whatever the board says now, a tail may have been vacated and taken by another head in the same tick
+        for (std::size_t i = 0; i < simulation.get_player_count(); ++i) {
+            const SnakeMove move = simulation.get_move(i);
+            if (move.tail_popped)
+                out = put(out, CellChange{ static_cast<std::int16_t>(move.tail.x), static_cast<std::int16_t>(move.tail.y), board.owner(move.tail), 0 });
+            out = put(out, CellChange{ static_cast<std::int16_t>(move.head.x), static_cast<std::int16_t>(move.head.y), board.owner(move.head), 0 });
+        }
+        commit(start + size);
+        collisions_sent = collisions.size();
+        ++stats.records;
+        stats.bytes += size;
+    }
+
+public:
+    // the ring holds at least ring_size bytes and 4 keyframes of a max_width x max_height board
+    BroadcastWriter(std::string const& feed_name, int const max_width, int const max_height, std::uint64_t const ring_size = 1 << 20) :
+        name(shared_memory_name(feed_name)),
+        fd(-1),
+        memory(MAP_FAILED),
+        mapped_bytes(0),
+        position(0),
+        match(0),
+        last_keyframe_tick(0),
+        keyframe_due(true),
+        width(0),
+        height(0),
+        collisions_sent(0)
+    {
+        if (max_width > MAX_PACKED_COORDINATE || max_height > MAX_PACKED_COORDINATE)
+            throw runtime_error("board too large to broadcast");
+        const std::uint64_t keyframe = record_size(RecordKind::Keyframe, MAX_PLAYERS + 2, MAX_PLAYERS,
+            static_cast<std::size_t>(max_width) * max_height);
+        ring_bytes = (std::max(ring_size, 4 * keyframe) + 7) & ~7ull;
+        mapped_bytes = sizeof(BroadcastHeader) + ring_bytes;
+        fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
+        if (fd < 0)
+            throw runtime_error("can't create the broadcast " + name);
+        if (ftruncate(fd, static_cast<off_t>(mapped_bytes)) != 0 ||
+            (memory = mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+            close(fd);
+            shm_unlink(name.c_str());
+            throw runtime_error("can't map the broadcast " + name);
+        }
+        header = new (memory) BroadcastHeader{};
+        header->version = BROADCAST_VERSION;
+        header->header_size = sizeof(BroadcastHeader);
+        header->ring_bytes = ring_bytes;
+        header->keyframe.store(NO_KEYFRAME, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        std::memcpy(header->magic, BROADCAST_MAGIC, sizeof(header->magic)); // last, readers check it
+        ring = static_cast<std::uint8_t*>(memory) + sizeof(BroadcastHeader);
+        sent_scores.fill(-1);
+    }
+
+    BroadcastWriter(const BroadcastWriter&) = delete;
+    BroadcastWriter& operator=(const BroadcastWriter&) = delete;
+
+    // readers that have it mapped keep their mapping, the name is gone
+    ~BroadcastWriter() {
+        munmap(memory, mapped_bytes);
+        close(fd);
+        shm_unlink(name.c_str());
+    }
+
+    // the next publish() is a keyframe of the new match
+    void begin_match() {
+        ++match;
+        keyframe_due = true;
+    }
+
+    // after every tick. jumped: the simulation didn't just step (rollback), so its moves don't say what changed
+    template <typename Config>
+    void publish(BasicSimulation<Config> const& simulation, Scoreboard const& scoreboard, int const winner, bool const jumped = false) {
+        const auto start = clock::now();
+        if (keyframe_due || jumped || simulation.get_width() != width || simulation.get_height() != height ||
+            simulation.get_collisions().size() < collisions_sent) {
+            write_keyframe(simulation, scoreboard, winner);
+        } else {
+            write_delta(simulation, scoreboard, winner);
+            // the periodic keyframe follows the tick's delta, so a reader that kept up can check its board against it
+            if (simulation.get_frame_count() - last_keyframe_tick >= KEYFRAME_INTERVAL)
+                write_keyframe(simulation, scoreboard, winner);
+        }
+        stats.publish_time.record(clock::now() - start);
+    }
+
+    std::string const& get_name() const {
+        return name;
+    }
+
+    BroadcastStats const& get_stats() const {
+        return stats;
+    }
+};
+
+struct SpectatorStats {
+    unsigned long records = 0;
+    unsigned long resyncs = 0; // boards (re)built from the newest keyframe: joining, and after falling a ring behind
+    unsigned long lapped = 0;  // times the writer overwrote records before they were read
+    unsigned long keyframes_checked = 0, keyframe_mismatches = 0; // keyframes read in order, compared to the board the deltas built
+
+    void print(std::FILE* out) const {
+        std::fprintf(out, "spectator records %lu, resyncs %lu, lapped %lu, keyframes checked %lu, mismatches %lu\n",
+            records, resyncs, lapped, keyframes_checked, keyframe_mismatches);
+    }
+};
+
+// a read only view of a feed, rebuilt from the records in place in the mapping
+class BroadcastReader {
+    int fd;
+    void* memory;
+    std::size_t mapped_bytes;
+    BroadcastHeader const* header;
+    std::uint8_t const* ring;
+    std::uint64_t ring_bytes;
+    std::uint64_t position; // the next record to read
+    bool synced;
+    int width, height;
+    vector<std::uint8_t> cells; // row major owners
+    vector<Coordinates> collisions;
+    std::array<std::int32_t, MAX_PLAYERS + 2> scores; // by Scoreboard id + 1
+    std::size_t player_count;
+    std::uint32_t match, tick;
+    int winner;
+    bool game_over;
+    int keyframe_check; // set by apply(): -1 no keyframe checked, else whether it matched, counted once the record is known intact
+    SpectatorStats stats;
+
+    // whether the writer has reserved any of the bytes from start on since they were read
+    bool overwritten(std::uint64_t const start) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return header->reserved.load(std::memory_order_relaxed) - start > ring_bytes;
+    }
+
+    template <typename T>
+    static T get(std::uint8_t const*& data) {
+        T value;
+        std::memcpy(&value, data, sizeof(T));
+        data += sizeof(T);
+        return value;
+    }
+
+    // false if the record doesn't make sense, which is only expected of one the writer was overwriting meanwhile
+    bool apply(RecordHeader const& record, std::uint8_t const* data, bool const check) {
+        data += sizeof(RecordHeader);
+        if (record.kind == RecordKind::Keyframe) {
+            const KeyframeSize size = get<KeyframeSize>(data);
+            if (size.width <= 0 || size.height <= 0 || size.width > MAX_PACKED_COORDINATE || size.height > MAX_PACKED_COORDINATE ||
+                record.cells != static_cast<std::uint32_t>(size.width) * static_cast<std::uint32_t>(size.height) ||
+                record.size != record_size(RecordKind::Keyframe, record.scores, record.collisions, record.cells))
+                return false;
+            std::uint8_t const* owners = data + record.scores * sizeof(ScoreEntry) + record.collisions * sizeof(PackedCoordinates);
+            if (check && record.match == match && size.width == width && size.height == height)
+                keyframe_check = std::memcmp(owners, cells.data(), cells.size()) == 0;
+            width = size.width;
+            height = size.height;
+            cells.assign(owners, owners + record.cells);
+            collisions.clear();
+        } else if (record.kind != RecordKind::Delta ||
+                   record.size != record_size(RecordKind::Delta, record.scores, record.collisions, record.cells)) {
+            return false;
+        }
+        for (std::uint16_t i = 0; i < record.scores; ++i) {
+            const ScoreEntry entry = get<ScoreEntry>(data);
+            if (entry.id < NO_WINNER || entry.id > static_cast<int>(MAX_PLAYERS))
+                return false;
+            scores[entry.id + 1] = entry.score;
+        }
+        for (std::uint16_t i = 0; i < record.collisions; ++i)
+            collisions.push_back(static_cast<Coordinates>(get<PackedCoordinates>(data)));
+        if (record.kind == RecordKind::Delta) {
+            for (std::uint32_t i = 0; i < record.cells; ++i) {
+                const CellChange change = get<CellChange>(data);
+                if (change.x < 0 || change.y < 0 || change.x >= width || change.y >= height)
+                    return false;
+                cells[static_cast<std::size_t>(change.y) * width + change.x] = change.owner;
+            }
+        }
+        player_count = std::min<std::size_t>(record.player_count, MAX_PLAYERS);
+        match = record.match;
+        tick = record.tick;
+        winner = record.winner;
+        game_over = record.game_over != 0;
+        return true;
+    }
+
+    // the board as of the newest keyframe, false if there is none yet
+    bool resync() {
+        for (int attempt = 0; attempt < 8; ++attempt) {
+            const std::uint64_t start = header->keyframe.load(std::memory_order_acquire);
+            if (start == NO_KEYFRAME)
+                return false;
+            std::uint8_t const* data = ring + start % ring_bytes;
+            RecordHeader record;
+            std::memcpy(&record, data, sizeof(record));
+            const bool valid = record.kind == RecordKind::Keyframe && start % ring_bytes + record.size <= ring_bytes && apply(record, data, false);
+            if (overwritten(start))
+                continue; // a newer keyframe took its place while it was read
+            if (!valid)
+                throw runtime_error("corrupt broadcast keyframe");
+            position = start + record.size;
+            synced = true;
+            ++stats.resyncs;
+            return true;
+        }
+        return false; // the writer is lapping faster than a keyframe can be read, try again next update
+    }
+
+public:
+    explicit BroadcastReader(std::string const& feed_name) :
+        fd(-1),
+        memory(MAP_FAILED),
+        mapped_bytes(0),
+        position(0),
+        synced(false),
+        width(0),
+        height(0),
+        player_count(0),
+        match(0),
+        tick(0),
+        winner(NO_WINNER),
+        game_over(false),
+        keyframe_check(-1)
+    {
+        const std::string name = shared_memory_name(feed_name);
+        fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0)
+            throw runtime_error("no broadcast called " + name + " (is the game running with --broadcast?)");
+        struct stat status;
+        if (fstat(fd, &status) != 0 || static_cast<std::size_t>(status.st_size) < sizeof(BroadcastHeader) ||
+            (memory = mmap(nullptr, static_cast<std::size_t>(status.st_size), PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+            close(fd);
+            throw runtime_error("can't map the broadcast " + name);
+        }
+        mapped_bytes = static_cast<std::size_t>(status.st_size);
+        header = static_cast<BroadcastHeader const*>(memory);
+        ring = static_cast<std::uint8_t const*>(memory) + sizeof(BroadcastHeader);
+        ring_bytes = header->ring_bytes;
+        if (std::memcmp(header->magic, BROADCAST_MAGIC, sizeof(header->magic)) != 0 || header->version != BROADCAST_VERSION ||
+            header->header_size != sizeof(BroadcastHeader) || ring_bytes == 0 || ring_bytes % 8 != 0 ||
+            sizeof(BroadcastHeader) + ring_bytes > mapped_bytes) {
+            munmap(memory, mapped_bytes);
+            close(fd);
+            throw runtime_error(name + " is not a snake broadcast of this version");
+        }
+        collisions.reserve(MAX_PLAYERS);
+        scores.fill(0);
+    }
+
+    BroadcastReader(const BroadcastReader&) = delete;
+    BroadcastReader& operator=(const BroadcastReader&) = delete;
+
+    ~BroadcastReader() {
+        munmap(memory, mapped_bytes);
+        close(fd);
+    }
+
+    // applies everything published since the last call, returns false if nothing was
+    bool update() {
+        bool changed = false;
+        for (;;) {
+            if (!synced) {
+                if (!resync())
+                    return changed;
+                changed = true;
+                continue;
+            }
+            const std::uint64_t end = header->committed.load(std::memory_order_acquire);
+            if (end == position)
+                return changed;
+            if (end - position > ring_bytes) {
+                synced = false;
+                ++stats.lapped;
+                continue;
+            }
+            const std::uint64_t offset = position % ring_bytes;
+            std::uint8_t const* data = ring + offset;
+            RecordHeader record{};
+            std::memcpy(&record, data, sizeof(record.size) + sizeof(record.kind));
+            keyframe_check = -1;
+            bool valid = record.size >= 8 && record.size % 8 == 0 && offset + record.size <= ring_bytes;
+            if (valid && record.kind != RecordKind::Padding) {
+                std::memcpy(&record, data, sizeof(record));
+                valid = record.size >= sizeof(RecordHeader) && apply(record, data, true);
+            }
+            if (overwritten(position)) {
+                synced = false;
+                ++stats.lapped;
+                continue;
+            }
+            if (!valid)
+                throw runtime_error("corrupt broadcast record");
+            if (keyframe_check >= 0) {
+                ++stats.keyframes_checked;
+                stats.keyframe_mismatches += keyframe_check == 0;
+            }
+            position += record.size;
+            ++stats.records;
+            changed = true;
+        }
+    }
+
+    int get_width() const {
+        return width;
+    }
+
+    int get_height() const {
+        return height;
+    }
+
+    // as Board::owner
+    std::uint8_t owner(Coordinates const& pos) const {
+        if (pos.x < 0 || pos.y < 0 || pos.x >= width || pos.y >= height)
+            return CELL_BORDER;
+        return cells[static_cast<std::size_t>(pos.y) * width + pos.x];
+    }
+
+    // the board row major, as Board::data
+    std::uint8_t const* data() const {
+        return cells.data();
+    }
+
+    vector<Coordinates> const& get_collisions() const {
+        return collisions;
+    }
+
+    std::size_t get_player_count() const {
+        return player_count;
+    }
+
+    int get_score(int const id) const {
+        return scores[id + 1];
+    }
+
+    Scoreboard get_scoreboard() const {
+        Scoreboard scoreboard;
+        for (int id = NO_WINNER; id <= static_cast<int>(player_count); ++id)
+            scoreboard[id] = get_score(id);
+        return scoreboard;
+    }
+
+    std::uint32_t get_match() const {
+        return match;
+    }
+
+    std::uint32_t get_tick() const {
+        return tick;
+    }
+
+    int get_winner() const {
+        return winner;
+    }
+
+    bool is_game_over() const {
+        return game_over;
+    }
+
+    bool is_synced() const {
+        return synced;
+    }
+
+    SpectatorStats const& get_stats() const {
+        return stats;
+    }
+};
+}
+
+#endif
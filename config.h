@@ -0,0 +1,63 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include "board.h"
+#include "core.h"
+#include <cstddef>
+#include <type_traits>
+
+namespace snake {
+
+/*
+BasicSimulation is instantiated with a configuration type. A configuration
+names the board type, how heads cross the border and which of the board
+dimensions, player count and tick rate are fixed at compile time
+(IS_STATIC). RuntimeConfig takes them all from constructor arguments, as
+the game does since its board is the terminal. StaticConfig bakes them
+into the type, so the tick loop runs a constant number of players, grows
+snakes on a constant interval and indexes a FixedBoard with a constant
+row length, and the compiler can unroll and fold all of it.
+*/
+template <typename Board_>
+struct RuntimeConfig {
+    using BoardType = Board_;
+    using Border = WalledBorder;
+    static constexpr bool IS_STATIC = false;
+    static constexpr bool WRAPS = false;
+};
+
+// a head leaving the playing area on one side comes back in on the other, the border is drawn but never entered
+template <int Width, int Height>
+struct WrappedBorder {
+    static constexpr Coordinates next_position(Coordinates const pos, Direction const dir) {
+        Coordinates next = snake::next_position(pos, dir);
+        if (next.x == 0)
+            next.x = Width - 2;
+        else if (next.x == Width - 1)
+            next.x = 1;
+        if (next.y == 0)
+            next.y = Height - 2;
+        else if (next.y == Height - 1)
+            next.y = 1;
+        return next;
+    }
+};
+
+// Width & Height are the full board dimensions, border included
+template <int Width, int Height, std::size_t Players, unsigned TickRate = FRAMES_PER_SECOND, bool Wraps = false>
+struct StaticConfig {
+    static_assert(Players >= 2 && Players <= MAX_PLAYERS, "a match needs 2 to MAX_PLAYERS players");
+    static_assert(TickRate > 0, "tick rate must be greater than 0");
+
+    using BoardType = FixedBoard<Width, Height>;
+    using Border = std::conditional_t<Wraps, WrappedBorder<Width, Height>, WalledBorder>;
+    static constexpr bool IS_STATIC = true;
+    static constexpr bool WRAPS = Wraps;
+    static constexpr int WIDTH = Width;
+    static constexpr int HEIGHT = Height;
+    static constexpr std::size_t PLAYERS = Players;
+    static constexpr unsigned TICK_RATE = TickRate;
+};
+}
+
+#endif
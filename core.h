@@ -0,0 +1,310 @@
+#ifndef CORE_H
+#define CORE_H
+
+#include "ring_buffer.h"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <map>
+#include <memory>
+
+using std::shared_ptr;
+using std::make_shared;
+
+namespace snake {
+
+inline constexpr int NO_WINNER = -1;
+inline constexpr int DRAW      =  0;
+inline constexpr int PLAYER1   =  1;
+inline constexpr int PLAYER2   =  2;
+inline constexpr std::size_t MAX_PLAYERS = 16; // ids 1 to 16
+inline constexpr unsigned FRAMES_PER_SECOND = 20;
+
+using Scoreboard = std::map<int, int>;
+
+enum class Direction {
+    None, Up, Down, Left, Right
+};
+
+struct Coordinates {
+    int x, y;
+    friend bool operator==(Coordinates const& lhs, Coordinates const& rhs);
+    bool operator<(Coordinates const& rhs) {
+        if (y != rhs.y) return y < rhs.y;
+        else return x < rhs.x;
+    }
+};
+
+inline bool operator==(Coordinates const& lhs, Coordinates const& rhs){
+    if ((lhs.x == rhs.x) && (lhs.y == rhs.y)) {
+        return true;
+    }
+    return false;
+}
+
+// half size Coordinates for boards up to 32767 cells wide/high
+struct PackedCoordinates {
+    std::int16_t x, y;
+    PackedCoordinates() = default;
+    explicit PackedCoordinates(Coordinates const& pos) : x(static_cast<std::int16_t>(pos.x)), y(static_cast<std::int16_t>(pos.y)) {}
+    explicit operator Coordinates() const {
+        return { x, y };
+    }
+};
+
+inline bool operator==(PackedCoordinates const& lhs, PackedCoordinates const& rhs){
+    return lhs.x == rhs.x && lhs.y == rhs.y;
+}
+
+inline constexpr int MAX_PACKED_COORDINATE = INT16_MAX;
+
+// snake bodies are ring buffers, allocated once when the snake is created on any board up to
+// INITIAL_BODY_CAPACITY cells, on bigger (sparse) arenas they start at that and double as the snake grows
+inline constexpr std::size_t INITIAL_BODY_CAPACITY = std::size_t(1) << 16;
+#ifdef SNAKE_PACKED_COORDINATES
+using SnakeBody = RingBuffer<Coordinates, PackedCoordinates>;
+inline constexpr bool PACKED_SNAKE_BODY = true;
+#else
+using SnakeBody = RingBuffer<Coordinates>;
+inline constexpr bool PACKED_SNAKE_BODY = false;
+#endif
+
+inline constexpr std::size_t DIRECTION_COUNT = 5;
+
+// indexed by Direction, anything out of range (a corrupt replay or network byte) reads as None
+inline constexpr Direction OPPOSITE_DIRECTIONS[DIRECTION_COUNT] = {
+    Direction::None, Direction::Down, Direction::Up, Direction::Right, Direction::Left
+};
+inline constexpr Coordinates DIRECTION_DELTAS[DIRECTION_COUNT] = {
+    { 0, 0 }, { 0, -1 }, { 0, 1 }, { -1, 0 }, { 1, 0 }
+};
+
+constexpr std::size_t direction_index(Direction const dir) {
+    const auto index = static_cast<std::size_t>(dir);
+    return index < DIRECTION_COUNT ? index : 0;
+}
+
+constexpr Direction get_opposite(Direction const dir) {
+    return OPPOSITE_DIRECTIONS[direction_index(dir)];
+}
+
+// the cell next to pos in direction dir, pos itself for Direction::None
+constexpr Coordinates next_position(Coordinates pos, Direction const dir) {
+    const Coordinates delta = DIRECTION_DELTAS[direction_index(dir)];
+    pos.x += delta.x;
+    pos.y += delta.y;
+    return pos;
+}
+
+// SplitMix64, a tiny PRNG that is cheap to seed (std::mt19937 takes microseconds to construct)
+class SplitMix64 {
+    std::uint64_t state;
+
+public:
+    explicit SplitMix64(std::uint64_t seed) : state(seed) {}
+
+    std::uint64_t next() {
+        std::uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    // the whole generator, SplitMix64(get_state()) carries on where this one is
+    std::uint64_t get_state() const {
+        return state;
+    }
+};
+
+// where a head goes on a board with a wall around it, see config.h for boards that wrap instead
+struct WalledBorder {
+    static constexpr Coordinates next_position(Coordinates const pos, Direction const dir) {
+        return snake::next_position(pos, dir);
+    }
+};
+
+// what one call to Snake::move changed, so a board can be updated incrementally
+struct SnakeMove {
+    Coordinates head; // new head
+    Coordinates tail; // cell that was vacated, only valid if tail_popped
+    bool tail_popped;
+};
+
+class Snake {
+    SnakeBody snake_body;
+    Direction current_dir, next_dir;
+    int length;
+
+    template <typename Border>
+    Coordinates get_next_pos() {
+        current_dir = next_dir;
+        return Border::next_position(get_head(), current_dir);
+    }
+
+public:
+    // body_capacity is the longest the body can ever get, the board area is always enough
+    // with an arena the body takes all of it from there straight away, otherwise it grows on the heap as needed
+    Snake(Coordinates start_pos, Direction start_dir, int len, std::size_t body_capacity, MatchArena* arena = nullptr) :
+        snake_body(arena != nullptr ? SnakeBody(body_capacity, *arena) : SnakeBody(std::min(body_capacity, INITIAL_BODY_CAPACITY), body_capacity)),
+        current_dir(start_dir), next_dir(start_dir), length(len)
+    {
+        snake_body.push_front(start_pos);
+    }
+
+    Coordinates get_head() const {
+        return snake_body.front();
+    }
+
+    SnakeBody const& get_body() const {
+        // body includes head
+        return snake_body;
+    }
+
+    Direction get_direction() const {
+        return current_dir;
+    }
+
+    Direction get_next_direction() const {
+        return next_dir;
+    }
+
+    int get_length() const {
+        return length;
+    }
+
+    // replace the whole state of the snake (e.g. from a replay snapshot), body is given head first
+    template <typename BodyIterator>
+    void restore(Direction current, Direction next, int len, BodyIterator body_begin, BodyIterator body_end) {
+        current_dir = current;
+        next_dir = next;
+        length = len;
+        snake_body.clear();
+        for (BodyIterator it = body_end; it != body_begin; ) {
+            --it;
+            snake_body.push_front(*it); // tail first, so the head ends up at the front
+        }
+    }
+
+    // only called from the game loop thread, key presses reach it through an input queue
+    void change_direction(Direction next) {
+        if (next != get_opposite(current_dir)) { 
+            next_dir = next;
+            // splitting direction into current and next prevents the user pressing very quickly
+            // and changing direction twice so that the snake turns in on itself and crashes in 1 move
+        }
+    }
+
+    template <typename Border = WalledBorder>
+    SnakeMove move() { // does not increase length of snake
+        SnakeMove change{};
+        if(snake_body.size() == length) {
+            change.tail = snake_body.back();
+            change.tail_popped = true;
+            snake_body.pop_back();
+        }
+        change.head = get_next_pos<Border>();
+        snake_body.push_front(change.head);
+        return change;
+    }
+
+    // the tail stays put on the next move, as it does when the growth timer fires (food mode eats instead)
+    void grow() {
+        ++length;
+    }
+
+    template <typename Border = WalledBorder>
+    SnakeMove move(int const frames_elapsed, unsigned const growth_interval = 2*FRAMES_PER_SECOND) {// increases length of snake
+        if ((frames_elapsed % growth_interval) == 0) {
+            // 2 * ticks per second, every 2 seconds increase length by 1
+            ++length;
+        }
+        return move<Border>(); // move the snake like usual
+    }
+};
+
+class Player {
+    int identifier; // Player 1, Player 2 etc.
+    Snake my_snake;
+    // each direction's key and its shifted (caps lock) version, worked out once rather than on every key press
+    struct KeyBinding {
+        int key, shifted;
+        Direction dir;
+    };
+    std::array<KeyBinding, 4> bindings;
+
+public:
+    Player(
+        int num,
+        Coordinates snake_start_pos,
+        Direction snake_start_dir,
+        int up,
+        int down,
+        int left,
+        int right,
+        int snake_len = 10,
+        std::size_t body_capacity = 4096,
+        MatchArena* arena = nullptr
+        ) :
+        identifier(num),
+        my_snake(snake_start_pos, snake_start_dir, snake_len, body_capacity, arena),
+        bindings{ {
+            { up, toupper(up), Direction::Up },
+            { down, toupper(down), Direction::Down },
+            { left, toupper(left), Direction::Left },
+            { right, toupper(right), Direction::Right }
+        } }
+    {}
+    
+    // which way input_ch steers this player, Direction::None if it isn't one of their keys
+    Direction key_direction(int const input_ch) const {
+        for (KeyBinding const& binding : bindings) {
+            if (input_ch == binding.key || input_ch == binding.shifted)
+                return binding.dir;
+        }
+        return Direction::None;
+    }
+
+    void handle_key_press(int const input_ch) {
+        change_direction(key_direction(input_ch));
+    }
+
+    void change_direction(Direction const dir) {
+        // Direction::None means "no command this tick"
+        if (dir != Direction::None)
+            my_snake.change_direction(dir);
+    }
+
+    template <typename Border = WalledBorder>
+    SnakeMove update() {
+        return my_snake.move<Border>();
+    }
+
+    template <typename Border = WalledBorder>
+    SnakeMove update(int const frames_elapsed, unsigned const growth_interval = 2*FRAMES_PER_SECOND) {
+        return my_snake.move<Border>(frames_elapsed, growth_interval);
+    }
+
+    SnakeBody const& get_body() const {
+        return my_snake.get_body();
+    }
+
+    Direction get_direction() const {
+        return my_snake.get_direction();
+    }
+
+    Snake const& get_snake() const {
+        return my_snake;
+    }
+
+    Snake& get_snake() {
+        return my_snake;
+    }
+
+    int id() const {
+        return identifier;
+    }
+};
+}
+
+#endif
@@ -0,0 +1,244 @@
+#ifndef ENV_H
+#define ENV_H
+
+#include "simulation.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using std::vector;
+
+namespace snake {
+
+struct EnvConfig {
+    int width = 22, height = 22; // full board dimensions, border included
+    std::size_t players = 2;
+    std::size_t batch = 1024; // independent games stepped by each call
+    unsigned tick_rate = FRAMES_PER_SECOND; // snakes grow every 2 * tick_rate ticks, as in the game
+    unsigned long max_ticks = 10000; // a game still running after this many ticks ends with no reward
+    std::size_t threads = 1; // more than 1 splits each batch over a WorkStealingPool
+};
+
+/*
+A batch of independent games for training agents, stepped together by one
+call. The games are ordinary BasicSimulations, so movement, growth and
+crash rules are exactly the ones the terminal game plays by.
+
+All buffers belong to the caller and are contiguous, nothing is allocated
+per step:
+  actions       [batch][players] int8, a Direction (0 = keep going, 1 up,
+                2 down, 3 left, 4 right), anything else counts as 0
+  observations  [batch][players][height][width] uint8, one plane per
+                player over the whole board (border included): 0 empty,
+                1 that player's body, 2 its head
+  rewards       [batch][players] float, -1 on the tick a snake crashes, +1
+                to the winner on the tick the game ends, otherwise 0
+  dones         [batch] uint8, 1 when the game ended this step
+
+A game that ends is restarted straight away, its observation is then the
+first one of the new game. Observations are updated incrementally (only
+the cells a head or tail moved through are written) as long as step() is
+given the same observation buffer as the previous reset()/step(); a
+different buffer is written in full.
+*/
+template <typename Config>
+class BasicVectorEnv {
+    using SimulationType = BasicSimulation<Config>;
+
+    struct EnvGame {
+        vector<shared_ptr<Player>> players; // shared with simulation, kept to put the snakes back for a restart
+        SimulationType simulation;
+
+        EnvGame(EnvConfig const& config, vector<shared_ptr<Player>> const& match_players) :
+            players(match_players),
+            simulation(config.width, config.height, match_players, config.tick_rate)
+        {}
+    };
+
+    static constexpr std::size_t TASKS_PER_THREAD = 4;
+
+    EnvConfig config;
+    vector<StartingPosition> starts;
+    int start_length;
+    std::size_t plane_size; // cells per observation plane
+    vector<EnvGame> games;
+    std::unique_ptr<WorkStealingPool> pool; // only with more than 1 thread
+    std::size_t games_per_task;
+
+    // the buffers of the step() in progress, read by the pool's tasks
+    std::int8_t const* step_actions;
+    std::uint8_t* step_observations;
+    float* step_rewards;
+    std::uint8_t* step_dones;
+    bool step_incremental;
+    std::uint8_t const* last_observations; // written by the last reset()/step(), nullptr before the first
+
+    std::uint8_t* planes(std::uint8_t* observations, std::size_t const game) const {
+        return observations + game * config.players * plane_size;
+    }
+
+    std::size_t cell(Coordinates const& pos) const {
+        return static_cast<std::size_t>(pos.y) * config.width + pos.x;
+    }
+
+    void write_observation(std::size_t const game, std::uint8_t* observations) const {
+        SimulationType const& simulation = games[game].simulation;
+        std::uint8_t* plane = planes(observations, game);
+        std::memset(plane, 0, config.players * plane_size);
+        for (std::size_t i = 0; i < config.players; ++i, plane += plane_size) {
+            for (Coordinates pos : simulation.get_player(i).get_body())
+                plane[cell(pos)] = 1;
+            plane[cell(simulation.get_player(i).get_snake().get_head())] = 2;
+        }
+    }
+
+    void restart(EnvGame& game) {
+        for (std::size_t i = 0; i < config.players; ++i) {
+            Coordinates const* start = &starts[i].pos;
+            game.players[i]->get_snake().restore(starts[i].dir, starts[i].dir, start_length, start, start + 1);
+        }
+        game.simulation.restart();
+    }
+
+    void step_game(std::size_t const game_index) {
+        EnvGame& game = games[game_index];
+        SimulationType& simulation = game.simulation;
+        const std::size_t players = config.players;
+        std::int8_t const* actions = step_actions + game_index * players;
+        float* rewards = step_rewards + game_index * players;
+
+        Direction commands[MAX_PLAYERS];
+        Coordinates old_heads[MAX_PLAYERS];
+        bool was_alive[MAX_PLAYERS];
+        for (std::size_t i = 0; i < players; ++i) {
+            const auto action = static_cast<std::uint8_t>(actions[i]);
+            commands[i] = action < DIRECTION_COUNT ? static_cast<Direction>(action) : Direction::None;
+            old_heads[i] = simulation.get_player(i).get_snake().get_head();
+            was_alive[i] = simulation.is_alive(i);
+            rewards[i] = 0;
+        }
+        const int winner = simulation.step(commands);
+
+        std::uint8_t* plane = planes(step_observations, game_index);
+        for (std::size_t i = 0; i < players; ++i, plane += plane_size) {
+            if (!was_alive[i])
+                continue;
+            if (!simulation.is_alive(i))
+                rewards[i] = -1;
+            if (!step_incremental)
+                continue;
+            // the old head becomes body before the tail leaves, a 1 cell snake's tail is its old head
+            const SnakeMove move = simulation.get_move(i);
+            plane[cell(old_heads[i])] = 1;
+            if (move.tail_popped)
+                plane[cell(move.tail)] = 0;
+            plane[cell(move.head)] = 2;
+        }
+        if (winner > DRAW)
+            rewards[winner - 1] = 1;
+
+        const bool done = winner != NO_WINNER || simulation.get_frame_count() >= config.max_ticks;
+        step_dones[game_index] = done;
+        if (done)
+            restart(game);
+        if (done || !step_incremental)
+            write_observation(game_index, step_observations);
+    }
+
+    void step_games(std::size_t const first, std::size_t const last) {
+        for (std::size_t i = first; i < last; ++i)
+            step_game(i);
+    }
+
+public:
+    explicit BasicVectorEnv(EnvConfig const& env_config) :
+        config(env_config),
+        plane_size(static_cast<std::size_t>(env_config.width) * env_config.height),
+        games_per_task(env_config.batch),
+        step_actions(nullptr),
+        step_observations(nullptr),
+        step_rewards(nullptr),
+        step_dones(nullptr),
+        step_incremental(false),
+        last_observations(nullptr)
+    {
+        if (config.batch == 0)
+            throw runtime_error("an environment needs at least 1 game");
+        if (config.width < 8 || config.height < 8)
+            throw runtime_error("board must be at least 8x8");
+        if (config.max_ticks == 0)
+            throw runtime_error("max ticks must be greater than 0");
+        const vector<shared_ptr<Player>> first_players = make_bot_players(config.width, config.height, config.players);
+        starts = calculate_starting_positions(config.width, config.height, config.players);
+        start_length = first_players[0]->get_snake().get_length();
+        games.reserve(config.batch);
+        for (std::size_t i = 0; i < config.batch; ++i)
+            games.emplace_back(config, i == 0 ? first_players : make_bot_players(config.width, config.height, config.players));
+        if (config.threads > 1) {
+            pool = std::make_unique<WorkStealingPool>(config.threads);
+            const std::size_t tasks = pool->size() * TASKS_PER_THREAD;
+            games_per_task = (games.size() + tasks - 1) / tasks;
+        }
+    }
+
+    // restarts every game and writes every observation
+    void reset(std::uint8_t* observations) {
+        for (std::size_t i = 0; i < games.size(); ++i) {
+            restart(games[i]);
+            write_observation(i, observations);
+        }
+        last_observations = observations;
+    }
+
+    // advances every game by one tick, see the class comment for the buffer layouts
+    void step(std::int8_t const* actions, std::uint8_t* observations, float* rewards, std::uint8_t* dones) {
+        step_actions = actions;
+        step_observations = observations;
+        step_rewards = rewards;
+        step_dones = dones;
+        step_incremental = observations == last_observations;
+        if (!pool) {
+            step_games(0, games.size());
+        } else {
+            for (std::size_t first = 0; first < games.size(); first += games_per_task) {
+                // two words of captures fit std::function's small buffer, so no closure is allocated
+                pool->submit([this, first] {
+                    step_games(first, std::min(games.size(), first + games_per_task));
+                });
+            }
+            pool->wait_idle();
+        }
+        last_observations = observations;
+    }
+
+    EnvConfig const& get_config() const {
+        return config;
+    }
+
+    // elements in each buffer
+    std::size_t action_count() const {
+        return config.batch * config.players;
+    }
+
+    std::size_t observation_size() const {
+        return config.batch * config.players * plane_size;
+    }
+
+    std::size_t reward_count() const {
+        return config.batch * config.players;
+    }
+
+    SimulationType const& get_game(std::size_t const index) const {
+        return games[index].simulation;
+    }
+};
+
+using VectorEnv = BasicVectorEnv<RuntimeConfig<Board>>;
+}
+
+#endif
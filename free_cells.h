@@ -0,0 +1,119 @@
+#ifndef FREE_CELLS_H
+#define FREE_CELLS_H
+
+#include "core.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using std::vector;
+
+namespace snake {
+
+/*
+The empty cells of a board as an indexed set, so a uniformly random one
+can be picked in O(1) however full the board is: picking by rejection
+needs 1 / (free fraction) tries on average, 20 on a board 95% full and
+unbounded as it fills up. The cells are kept densely in an array, in no
+particular order, and a map from each cell of the board to its place in
+that array lets take() remove any cell in O(1) by moving the last one into
+its place. Both are sized once for the board, so taking and releasing
+cells as heads and tails move never allocates.
+*/
+class FreeCells {
+    static constexpr std::uint32_t TAKEN = UINT32_MAX;
+
+    int width, height;
+    vector<std::uint32_t> cells;    // the free cells as board indices, y * width + x
+    vector<std::uint32_t> position; // where each board cell is in cells, TAKEN if it isn't free
+
+    std::size_t index(Coordinates const& pos) const {
+        return static_cast<std::size_t>(pos.y) * width + pos.x;
+    }
+
+    bool in_bounds(Coordinates const& pos) const {
+        return pos.x >= 0 && pos.y >= 0 && pos.x < width && pos.y < height;
+    }
+
+public:
+    FreeCells() : width(0), height(0) {}
+
+    // the CELL_EMPTY cells of board, which has a dense owner() lookup (Board or FixedBoard)
+    template <typename BoardType>
+    void rebuild(BoardType const& board) {
+        width = board.get_width();
+        height = board.get_height();
+        const std::size_t area = static_cast<std::size_t>(width) * height;
+        position.assign(area, TAKEN);
+        cells.clear();
+        cells.reserve(area);
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                if (board.owner({ x, y }) == CELL_EMPTY) {
+                    position[index({ x, y })] = static_cast<std::uint32_t>(cells.size());
+                    cells.push_back(static_cast<std::uint32_t>(index({ x, y })));
+                }
+            }
+        }
+    }
+
+    // the same cells in the order given (board indices, as get_cells()), so a restored set samples the same as
+    // the one saved. rebuild() must have sized the set for the board first
+    template <typename Iterator>
+    void assign(Iterator const begin, Iterator const end) {
+        position.assign(position.size(), TAKEN);
+        cells.assign(begin, end);
+        for (std::size_t i = 0; i < cells.size(); ++i)
+            position[cells[i]] = static_cast<std::uint32_t>(i);
+    }
+
+    bool contains(Coordinates const& pos) const {
+        return in_bounds(pos) && position[index(pos)] != TAKEN;
+    }
+
+    // removes pos if it is free, returns false if it wasn't
+    bool take(Coordinates const& pos) {
+        if (!contains(pos))
+            return false;
+        const std::size_t cell = index(pos);
+        const std::uint32_t at = position[cell];
+        const std::uint32_t last = cells.back();
+        cells[at] = last;
+        position[last] = at;
+        cells.pop_back();
+        position[cell] = TAKEN;
+        return true;
+    }
+
+    // adds pos, an empty cell of the board, back, cells off the board or already free are ignored
+    void release(Coordinates const& pos) {
+        if (!in_bounds(pos) || position[index(pos)] != TAKEN)
+            return;
+        position[index(pos)] = static_cast<std::uint32_t>(cells.size());
+        cells.push_back(static_cast<std::uint32_t>(index(pos)));
+    }
+
+    // a uniformly random free cell, there must be one. Multiplying by the size and keeping the high half maps
+    // the random number onto 0..size-1 without a division or retries
+    Coordinates sample(SplitMix64& rng) const {
+        const std::uint64_t at = static_cast<std::uint64_t>((static_cast<unsigned __int128>(rng.next()) * cells.size()) >> 64);
+        const std::uint32_t cell = cells[at];
+        return { static_cast<int>(cell % static_cast<std::uint32_t>(width)), static_cast<int>(cell / static_cast<std::uint32_t>(width)) };
+    }
+
+    std::size_t size() const {
+        return cells.size();
+    }
+
+    // board indices in the order sample() picks from
+    vector<std::uint32_t> const& get_cells() const {
+        return cells;
+    }
+
+    bool empty() const {
+        return cells.empty();
+    }
+};
+}
+
+#endif
@@ -0,0 +1,1336 @@
+#include "batch.h"
+#include "broadcast.h"
+#include "env.h"
+#include "history.h"
+#include "input_queue.h"
+#include "netplay.h"
+#include "server.h"
+#include "tournament.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <new>
+#include <poll.h>
+#include <string>
+#include <sys/wait.h>
+#include <thread>
+#include <type_traits>
+
+using namespace snake;
+
+using std::exception;
+
+namespace {
+
+// every allocation the process makes, for --alloc-check
+std::atomic<unsigned long> allocation_count{ 0 };
+
+void* counted_allocation(std::size_t size, std::size_t const alignment) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    size = std::max<std::size_t>(size, 1);
+    void* memory = alignment <= alignof(std::max_align_t) ? std::malloc(size)
+                                                          : std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+    if (memory == nullptr)
+        throw std::bad_alloc();
+    return memory;
+}
+}
+
+void* operator new(std::size_t size) { return counted_allocation(size, 0); }
+void* operator new[](std::size_t size) { return counted_allocation(size, 0); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return counted_allocation(size, static_cast<std::size_t>(alignment)); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return counted_allocation(size, static_cast<std::size_t>(alignment)); }
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::size_t, std::align_val_t) noexcept { std::free(memory); }
+
+namespace {
+
+struct Options {
+    unsigned long ticks = 10000000;
+    int width = 200;
+    int height = 60;
+    unsigned seed = 1;
+    std::size_t players = 2; // --ticks runs only, players 3 and up are the same kind of bot as player 2
+    unsigned long tournament_matches = 0; // 0 = run --ticks ticks instead of a tournament
+    std::size_t threads = std::thread::hardware_concurrency();
+    bool scaling = false;
+    BotKind p1_bot = BotKind::Random, p2_bot = BotKind::Random;
+    unsigned bot_budget_us = 1000;
+    std::string record_path; // tournament matches are appended to this replay archive
+    std::string replay_path; // re-simulate every match in this archive and check it is deterministic
+    int rollback_delay = -1; // >= 0: play rollback matches over a loopback link with up to this many ticks of latency
+    bool arena = false; // --ticks on a sparse ChunkedBoard, players start in the middle as if on a default sized board
+    std::size_t batch_games = 0; // > 0: check BatchSimulation against Simulation on this many games at once, with every kernel
+    std::size_t env_batch = 0; // > 0: step a VectorEnv of this many games with random actions for --ticks environment steps
+    unsigned long alloc_check_matches = 0; // > 0: play this many matches and fail if any tick allocates
+    unsigned long broadcast_matches = 0; // > 0: broadcast this many matches and check what spectators rebuild from the feed
+    unsigned long history_matches = 0; // > 0: log this many matches from two processes and check the lifetime totals
+    std::size_t food = 0; // > 0: fill the board past 95% in food mode with this many pellets, checking the free cell set
+    std::size_t server_sessions = 0; // > 0: ramp a GameServer up to this many socket sessions, reporting its deadline misses
+};
+
+BotKind parse_bot(const char* name) {
+    if (!strcmp(name, "random"))
+        return BotKind::Random;
+    if (!strcmp(name, "flood"))
+        return BotKind::FloodFill;
+    throw runtime_error(std::string("unknown bot: ") + name + " (expected random or flood)");
+}
+
+Options parse_options(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = i + 1 < argc;
+        if (!strcmp(argv[i], "--ticks") && has_value) {
+            options.ticks = strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--width") && has_value) {
+            options.width = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--height") && has_value) {
+            options.height = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && has_value) {
+            options.seed = strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--players") && has_value) {
+            options.players = strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--tournament") && has_value) {
+            options.tournament_matches = strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--threads") && has_value) {
+            options.threads = strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--batch") && has_value) {
+            options.batch_games = strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--env") && has_value) {
+            options.env_batch = strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--alloc-check") && has_value) {
+            options.alloc_check_matches = strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--broadcast") && has_value) {
+            options.broadcast_matches = strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--history") && has_value) {
+            options.history_matches = strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--food") && has_value) {
+            options.food = strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--server") && has_value) {
+            options.server_sessions = strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(argv[i], "--arena")) {
+            options.arena = true;
+        } else if (!strcmp(argv[i], "--scaling")) {
+            options.scaling = true;
+        } else if (!strcmp(argv[i], "--p1") && has_value) {
+            options.p1_bot = parse_bot(argv[++i]);
+        } else if (!strcmp(argv[i], "--p2") && has_value) {
+            options.p2_bot = parse_bot(argv[++i]);
+        } else if (!strcmp(argv[i], "--record") && has_value) {
+            options.record_path = argv[++i];
+        } else if (!strcmp(argv[i], "--replay") && has_value) {
+            options.replay_path = argv[++i];
+        } else if (!strcmp(argv[i], "--rollback") && has_value) {
+            options.rollback_delay = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--bot-budget") && has_value) {
+            options.bot_budget_us = strtoul(argv[++i], nullptr, 10);
+        } else {
+            throw runtime_error(std::string("unknown argument: ") + argv[i]);
+        }
+    }
+    if (options.width < 8 || options.height < 8)
+        throw runtime_error("board must be at least 8x8");
+    if (options.threads == 0)
+        options.threads = 1;
+    if (options.players < 2 || options.players > MAX_PLAYERS)
+        throw runtime_error("--players must be between 2 and " + std::to_string(MAX_PLAYERS));
+    if (options.arena && (options.tournament_matches > 0 || options.rollback_delay >= 0 || !options.replay_path.empty()))
+        throw runtime_error("--arena only works with --ticks");
+    if (options.batch_games > 0 && (options.arena || options.players != 2 || options.env_batch > 0 || options.tournament_matches > 0 || options.rollback_delay >= 0 || !options.replay_path.empty()))
+        throw runtime_error("--batch only works with --ticks and two players");
+    if (options.env_batch > 0 && (options.arena || options.tournament_matches > 0 || options.rollback_delay >= 0 || !options.replay_path.empty()))
+        throw runtime_error("--env only works with --ticks");
+    if (options.alloc_check_matches > 0 && (options.arena || options.batch_games > 0 || options.env_batch > 0 || options.tournament_matches > 0 || options.rollback_delay >= 0 || !options.replay_path.empty()))
+        throw runtime_error("--alloc-check can't be combined with other modes");
+    if (options.broadcast_matches > 0 && (options.arena || options.alloc_check_matches > 0 || options.batch_games > 0 || options.env_batch > 0 || options.tournament_matches > 0 || options.rollback_delay >= 0 || !options.replay_path.empty()))
+        throw runtime_error("--broadcast can't be combined with other modes");
+    if (options.history_matches > 0 && (options.arena || options.broadcast_matches > 0 || options.alloc_check_matches > 0 || options.batch_games > 0 || options.env_batch > 0 || options.tournament_matches > 0 || options.rollback_delay >= 0 || !options.replay_path.empty()))
+        throw runtime_error("--history can't be combined with other modes");
+    if (options.food > 0 && (options.arena || options.history_matches > 0 || options.broadcast_matches > 0 || options.alloc_check_matches > 0 || options.batch_games > 0 || options.env_batch > 0 || options.tournament_matches > 0 || options.rollback_delay >= 0 || !options.replay_path.empty()))
+        throw runtime_error("--food can't be combined with other modes");
+    if (options.food > 0 && (options.height % 2 != 0 || options.width < 6))
+        throw runtime_error("--food needs an even --height, each snake goes round a cycle through its half of the board");
+    if (options.server_sessions > 0 && (options.arena || options.food > 0 || options.history_matches > 0 || options.broadcast_matches > 0 || options.alloc_check_matches > 0 || options.batch_games > 0 || options.env_batch > 0 || options.tournament_matches > 0 || options.rollback_delay >= 0 || !options.replay_path.empty()))
+        throw runtime_error("--server can't be combined with other modes");
+    if (options.players != 2 && (options.server_sessions > 0 || options.tournament_matches > 0 || options.rollback_delay >= 0 || !options.replay_path.empty()))
+        throw runtime_error("tournaments, replays, rollback matches and servers are two player only");
+    return options;
+}
+
+// an arena starts its players as on a default sized board, see calculate_starting_positions
+vector<shared_ptr<Player>> make_players(Options const& options) {
+    const Options defaults;
+    return options.arena ? make_bot_players(options.width, options.height, options.players, defaults.width, defaults.height)
+                         : make_bot_players(options.width, options.height, options.players);
+}
+
+// as many ticks as possible on one thread, one match after another
+template <typename SimulationType>
+void run_ticks(Options const& options) {
+    vector<Bot> bots;
+    for (std::size_t i = 0; i < options.players; ++i)
+        bots.emplace_back(i == 0 ? options.p1_bot : options.p2_bot, options.seed * options.players + i + 1, std::chrono::microseconds(options.bot_budget_us));
+    Scoreboard scoreboard{ { NO_WINNER, 0 }, { DRAW, 0 } };
+    for (std::size_t i = 1; i <= options.players; ++i)
+        scoreboard[static_cast<int>(i)] = 0;
+    SimulationType simulation(options.width, options.height, make_players(options));
+    std::size_t peak_tiles = 0;
+
+    unsigned long matches = 0;
+    Direction commands[MAX_PLAYERS];
+    auto start_time = std::chrono::steady_clock::now();
+    for (unsigned long tick = 0; tick < options.ticks; ++tick) {
+        for (std::size_t i = 0; i < options.players; ++i)
+            commands[i] = simulation.is_alive(i) ? bots[i].next_command(simulation, static_cast<int>(i) + 1) : Direction::None;
+        const int winner = simulation.step(commands);
+        if constexpr (std::is_same_v<SimulationType, ArenaSimulation>)
+            peak_tiles = std::max(peak_tiles, simulation.get_board().get_tile_count());
+        if (winner != NO_WINNER) {
+            ++scoreboard.at(winner);
+            ++matches;
+            simulation.reset(make_players(options));
+        }
+    }
+    auto finish_time = std::chrono::steady_clock::now();
+    const double seconds = std::chrono::duration<double>(finish_time - start_time).count();
+
+    printf("board        %dx%d\n", options.width, options.height);
+    printf("ticks        %lu\n", options.ticks);
+    if (options.players == 2) {
+        printf("matches      %lu (green %d, blue %d, draw %d)\n",
+            matches, scoreboard.at(PLAYER1), scoreboard.at(PLAYER2), scoreboard.at(DRAW));
+    } else {
+        printf("matches      %lu (draw %d, wins", matches, scoreboard.at(DRAW));
+        for (std::size_t i = 1; i <= options.players; ++i)
+            printf(" %d", scoreboard.at(static_cast<int>(i)));
+        printf(")\n");
+    }
+    printf("seconds      %.3f\n", seconds);
+    printf("ticks/sec    %.0f\n", seconds > 0 ? options.ticks / seconds : 0.0);
+    if constexpr (std::is_same_v<SimulationType, ArenaSimulation>) {
+        const double dense_mb = static_cast<double>(options.width) * options.height / (1 << 20);
+        printf("arena tiles  %zu now, %zu peak (%.1f MB, a dense board would be %.1f MB)\n",
+            simulation.get_board().get_tile_count(), peak_tiles, peak_tiles * sizeof(std::uint8_t[ChunkedBoard::TILE_SIZE * ChunkedBoard::TILE_SIZE]) / double(1 << 20), dense_mb);
+    }
+    if (options.p1_bot == BotKind::FloodFill || options.p2_bot == BotKind::FloodFill) {
+        LatencyHistogram decisions;
+        for (Bot const& bot : bots)
+            decisions.merge(bot.get_flood_fill_bot().get_decision_time());
+        decisions.print(stdout, "bot decision");
+    }
+}
+
+// differential test: every game of a BatchSimulation against its own Simulation fed the same random commands, compared
+// after every tick, for each kernel this CPU runs. Returns false on any difference
+bool verify_batch(Options const& options) {
+    const std::size_t games = options.batch_games;
+    const StartingPositions start = calculate_starting_positions(options.width, options.height);
+    const std::size_t area = body_capacity(options.width, options.height);
+    unsigned long total_mismatches = 0;
+    vector<Coordinates> batch_body;
+    for (SimdKernel kernel : { SimdKernel::Scalar, SimdKernel::Sse2, SimdKernel::Avx2 }) {
+        if (!kernel_supported(kernel)) {
+            printf("%-7s not supported by this CPU, skipped\n", kernel_name(kernel));
+            continue;
+        }
+        BatchSimulation batch(games, options.width, options.height, FRAMES_PER_SECOND, kernel);
+        vector<Simulation> references;
+        vector<RandomBot> bots;
+        for (std::size_t game = 0; game < games; ++game) {
+            references.emplace_back(options.width, options.height, make_bot_player(PLAYER1, start, area), make_bot_player(PLAYER2, start, area));
+            bots.emplace_back(options.seed * 2 * games + 2 * game + 1);
+            bots.emplace_back(options.seed * 2 * games + 2 * game + 2);
+        }
+        vector<Direction> commands(2 * games);
+        unsigned long ticks = 0, matches = 0, mismatches = 0;
+        const unsigned long rounds = std::max(1ul, options.ticks / games);
+        for (unsigned long round = 0; round < rounds; ++round) {
+            for (std::size_t game = 0; game < games; ++game) {
+                commands[game] = bots[2 * game].next_command();
+                commands[games + game] = bots[2 * game + 1].next_command();
+                references[game].step(commands[game], commands[games + game]);
+            }
+            batch.step(commands.data());
+            for (std::size_t game = 0; game < games; ++game) {
+                Simulation& reference = references[game];
+                bool same = batch.get_status(game) == reference.get_winner() && batch.get_frame_count(game) == reference.get_frame_count();
+                for (std::size_t p = 0; p < 2 && same; ++p) {
+                    Snake const& snake = reference.get_player(p).get_snake();
+                    same = batch.get_head(game, p) == snake.get_head() && batch.get_direction(game, p) == snake.get_direction()
+                        && batch.get_length(game, p) == snake.get_length();
+                }
+                if (same && reference.is_over()) {
+                    // whole bodies once a game is over, then both start again
+                    for (std::size_t p = 0; p < 2 && same; ++p) {
+                        batch.get_body(game, p, batch_body);
+                        SnakeBody const& body = reference.get_player(p).get_body();
+                        same = batch_body.size() == body.size() && std::equal(batch_body.begin(), batch_body.end(), body.begin());
+                    }
+                    ticks += reference.get_frame_count();
+                    ++matches;
+                    reference.reset(make_bot_player(PLAYER1, start, area), make_bot_player(PLAYER2, start, area));
+                    batch.restart(game);
+                }
+                if (!same) {
+                    ++mismatches;
+                    reference.reset(make_bot_player(PLAYER1, start, area), make_bot_player(PLAYER2, start, area));
+                    batch.restart(game);
+                }
+            }
+        }
+        printf("%-7s games %zu, %lu matches, %lu ticks, mismatches %lu\n", kernel_name(kernel), games, matches, ticks, mismatches);
+        total_mismatches += mismatches;
+    }
+    return total_mismatches == 0;
+}
+
+// a VectorEnv stepped with random actions, drawn in advance so only the environment is timed
+void run_env(Options const& options) {
+    EnvConfig config;
+    config.width = options.width;
+    config.height = options.height;
+    config.players = options.players;
+    config.batch = options.env_batch;
+    config.threads = options.threads;
+    VectorEnv env(config);
+
+    static constexpr std::size_t ACTION_BATCHES = 64;
+    SplitMix64 rng(options.seed);
+    vector<std::int8_t> actions(ACTION_BATCHES * env.action_count());
+    for (std::int8_t& action : actions)
+        action = static_cast<std::int8_t>(rng.next() % 8 == 0 ? 1 + rng.next() % 4 : 0); // a turn every 8 ticks or so
+    vector<std::uint8_t> observations(env.observation_size());
+    vector<float> rewards(env.reward_count());
+    vector<std::uint8_t> dones(config.batch);
+
+    env.reset(observations.data());
+    const unsigned long calls = std::max(1ul, options.ticks / config.batch);
+    unsigned long games = 0;
+    auto start_time = std::chrono::steady_clock::now();
+    for (unsigned long call = 0; call < calls; ++call) {
+        env.step(actions.data() + call % ACTION_BATCHES * env.action_count(), observations.data(), rewards.data(), dones.data());
+        for (std::uint8_t done : dones)
+            games += done;
+    }
+    auto finish_time = std::chrono::steady_clock::now();
+    const double seconds = std::chrono::duration<double>(finish_time - start_time).count();
+    const unsigned long steps = calls * config.batch;
+
+    printf("board        %dx%d, %zu players, %zu games per step, %zu threads\n",
+        options.width, options.height, options.players, config.batch, std::max<std::size_t>(1, config.threads));
+    printf("env steps    %lu (%lu calls)\n", steps, calls);
+    printf("games ended  %lu (%.1f steps each)\n", games, games > 0 ? static_cast<double>(steps) / games : 0.0);
+    printf("seconds      %.3f\n", seconds);
+    printf("steps/sec    %.0f\n", seconds > 0 ? steps / seconds : 0.0);
+}
+
+// ticks that allocated and where the first one was
+struct AllocationCheck {
+    unsigned long ticks = 0, allocating_ticks = 0, allocations = 0;
+    unsigned long first_match = 0, first_tick = 0;
+
+    template <typename Tick>
+    void tick(unsigned long const match, unsigned long const tick_number, Tick&& run_tick) {
+        const unsigned long before = allocation_count.load(std::memory_order_relaxed);
+        run_tick();
+        const unsigned long allocated = allocation_count.load(std::memory_order_relaxed) - before;
+        ++ticks;
+        if (allocated == 0)
+            return;
+        if (allocating_ticks++ == 0) {
+            first_match = match;
+            first_tick = tick_number;
+        }
+        allocations += allocated;
+    }
+
+    void print(const char* name) const {
+        printf("%-12s %lu ticks, %lu allocated (%lu allocations)", name, ticks, allocating_ticks, allocations);
+        if (allocating_ticks > 0)
+            printf(", the first in match %lu at tick %lu", first_match, first_tick);
+        printf("\n");
+    }
+};
+
+/*
+Matches set up and played the way the terminal game plays them: players and
+bodies from a MatchArena released in bulk between matches, flood fill and
+random bots, player 1 steered through a TurnBuffer like a human, and the
+replay recorder running on two player matches. Everything a match needs is
+allocated while it is set up; a tick that allocates anything fails the
+check. VectorEnv and BatchSimulation steps, restarts included, are held to
+the same rule. Returns false if any tick allocated.
+*/
+bool check_allocations(Options const& options) {
+    static constexpr unsigned long MAX_MATCH_TICKS = 20000; // called off after this, well within what the recorder reserves
+    const std::size_t capacity = body_capacity(options.width, options.height);
+    MatchArena arena;
+    Simulation simulation(options.width, options.height, make_bot_players(options.width, options.height, 2));
+    vector<Bot> bots;
+    for (std::size_t i = 0; i < MAX_PLAYERS; ++i)
+        bots.emplace_back(i % 2 == 1 ? BotKind::FloodFill : BotKind::Random, options.seed * MAX_PLAYERS + i, std::chrono::microseconds(options.bot_budget_us));
+    RandomBot typist(options.seed);
+    TurnBuffer keyboard;
+    ReplayRecorder recorder;
+    vector<shared_ptr<Player>> players;
+    Direction commands[MAX_PLAYERS];
+    AllocationCheck matches;
+    unsigned long setup_allocations = 0;
+
+    for (unsigned long match = 0; match < options.alloc_check_matches; ++match) {
+        const std::size_t count = match % 2 == 0 ? 2 : options.players;
+        const bool recording = count == 2;
+        const unsigned long before_setup = allocation_count.load(std::memory_order_relaxed);
+        simulation.release_players();
+        players.clear();
+        arena.reset(match_arena_bytes(count, capacity));
+        players = make_bot_players(options.width, options.height, count, 0, 0, &arena);
+        simulation.reset(players);
+        for (std::size_t i = 1; i < count; ++i)
+            bots[i].prepare(simulation);
+        keyboard.clear();
+        if (recording) {
+            recorder.begin({ options.width, options.height, players[0]->get_snake().get_head(), players[1]->get_snake().get_head(),
+                players[0]->get_snake().get_length(), FRAMES_PER_SECOND });
+        }
+        setup_allocations += allocation_count.load(std::memory_order_relaxed) - before_setup;
+
+        for (unsigned long tick = 0; tick < MAX_MATCH_TICKS && !simulation.is_over(); ++tick) {
+            matches.tick(match, tick, [&] {
+                keyboard.push({ typist.next_command(), std::chrono::steady_clock::now() }, players[0]->get_direction());
+                TurnBuffer::Turn turn;
+                commands[0] = keyboard.pop(turn) && simulation.is_alive(0) ? turn.dir : Direction::None;
+                for (std::size_t i = 1; i < count; ++i)
+                    commands[i] = simulation.is_alive(i) ? bots[i].next_command(simulation, static_cast<int>(i) + 1) : Direction::None;
+                if (recording)
+                    recorder.record_tick(simulation, commands[0], commands[1]);
+                simulation.step(commands);
+            });
+        }
+        if (recording)
+            recorder.finish(static_cast<std::uint32_t>(simulation.get_frame_count()), simulation.get_winner());
+    }
+
+    EnvConfig config;
+    config.width = options.width;
+    config.height = options.height;
+    config.players = options.players;
+    config.batch = 16;
+    VectorEnv env(config);
+    vector<std::int8_t> actions(env.action_count());
+    vector<std::uint8_t> observations(env.observation_size());
+    vector<float> rewards(env.reward_count());
+    vector<std::uint8_t> dones(config.batch);
+    SplitMix64 rng(options.seed);
+    env.reset(observations.data());
+    AllocationCheck env_steps;
+    const unsigned long steps = std::max(1ul, matches.ticks / config.batch);
+    for (unsigned long step = 0; step < steps; ++step) {
+        for (std::int8_t& action : actions)
+            action = static_cast<std::int8_t>(rng.next() % 8 == 0 ? 1 + rng.next() % 4 : 0);
+        env_steps.tick(0, step, [&] {
+            env.step(actions.data(), observations.data(), rewards.data(), dones.data());
+        });
+    }
+
+    BatchSimulation batch(config.batch, options.width, options.height);
+    vector<Direction> batch_commands(2 * config.batch);
+    AllocationCheck batch_steps;
+    for (unsigned long step = 0; step < steps; ++step) {
+        for (Direction& command : batch_commands)
+            command = rng.next() % 8 == 0 ? static_cast<Direction>(1 + rng.next() % 4) : Direction::None;
+        batch_steps.tick(0, step, [&] {
+            batch.step(batch_commands.data());
+            for (std::size_t game = 0; game < config.batch; ++game) {
+                if (batch.get_status(game) != NO_WINNER)
+                    batch.restart(game);
+            }
+        });
+    }
+
+    const std::string player_counts = options.players == 2 ? "2" : "2 and " + std::to_string(options.players);
+    printf("board        %dx%d, %s player matches, arena %zu KB (%zu KB used at most)\n", options.width, options.height,
+        player_counts.c_str(), arena.get_capacity() >> 10, arena.get_high_water() >> 10);
+    printf("matches      %lu, %lu allocations setting them up\n", options.alloc_check_matches, setup_allocations);
+    matches.print("match ticks");
+    env_steps.print("env steps");
+    batch_steps.print("batch steps");
+    return matches.allocating_ticks == 0 && env_steps.allocating_ticks == 0 && batch_steps.allocating_ticks == 0;
+}
+
+// whether a reader that has read everything published agrees with the simulation it was published from
+bool same_as(BroadcastReader const& reader, Simulation const& simulation, Scoreboard const& scoreboard, std::uint32_t const match) {
+    if (!reader.is_synced() || reader.get_match() != match || reader.get_tick() != simulation.get_frame_count() ||
+        reader.get_width() != simulation.get_width() || reader.get_height() != simulation.get_height() ||
+        reader.get_winner() != simulation.get_winner() || reader.get_collisions() != simulation.get_collisions())
+        return false;
+    for (auto const& [id, score] : scoreboard) {
+        if (reader.get_score(id) != score)
+            return false;
+    }
+    return std::memcmp(reader.data(), simulation.get_board().data(), static_cast<std::size_t>(simulation.get_width()) * simulation.get_height()) == 0;
+}
+
+// a spectator in another process: reads the feed as fast as it can until told to stop, exits non-zero if it read nothing
+// or a keyframe disagreed with the board its deltas built
+[[noreturn]] void spectate_in_child(std::string const& name, int const stop_fd) {
+    int status = 1;
+    try {
+        BroadcastReader reader(name);
+        pollfd stop{ stop_fd, POLLIN, 0 };
+        while (poll(&stop, 1, 0) == 0)
+            reader.update();
+        reader.update();
+        SpectatorStats const& stats = reader.get_stats();
+        printf("child        ");
+        stats.print(stdout);
+        status = stats.keyframe_mismatches == 0 && stats.records > 0 ? 0 : 1;
+    } catch (const exception& err) {
+        fprintf(stderr, "headless: spectator: %s\n", err.what());
+    }
+    fflush(stdout);
+    _exit(status);
+}
+
+/*
+Matches of random bots broadcast into a ring only 4 keyframes long, read by
+a spectator that keeps up (reads every tick), one that falls behind
+(reads every 1009 ticks, so the writer laps it), one that joins part way
+through the first match and one in a child process, polling on its own.
+After every read the readers in this process are compared with the
+simulation (board, collisions, scores, winner), and every reader checks
+each keyframe it reads in order against the board its deltas built.
+Returns false on any difference.
+*/
+bool check_broadcast(Options const& options) {
+    static constexpr unsigned long LAGGING_READS = 1009, LATE_JOIN_TICK = 300, MAX_MATCH_TICKS = 20000;
+    const std::string name = "/snake-headless-" + std::to_string(getpid());
+    BroadcastWriter writer(name, options.width, options.height, 0);
+    int stop_pipe[2];
+    if (pipe(stop_pipe) != 0)
+        throw runtime_error("can't create a pipe");
+    fflush(stdout);
+    const pid_t child = fork();
+    if (child < 0)
+        throw runtime_error("can't fork a spectator");
+    if (child == 0) {
+        close(stop_pipe[1]);
+        spectate_in_child(name, stop_pipe[0]);
+    }
+    close(stop_pipe[0]);
+
+    BroadcastReader follower(name), lagging(name);
+    std::unique_ptr<BroadcastReader> late;
+    Simulation simulation(options.width, options.height, make_bot_players(options.width, options.height, options.players));
+    vector<RandomBot> bots;
+    for (std::size_t i = 0; i < options.players; ++i)
+        bots.emplace_back(options.seed * options.players + i + 1);
+    Scoreboard scoreboard{ { NO_WINNER, 0 }, { DRAW, 0 } };
+    for (std::size_t i = 1; i <= options.players; ++i)
+        scoreboard[static_cast<int>(i)] = 0;
+    Direction commands[MAX_PLAYERS];
+    unsigned long ticks = 0, mismatches = 0;
+    for (unsigned long match = 1; match <= options.broadcast_matches; ++match) {
+        if (match > 1)
+            simulation.reset(make_bot_players(options.width, options.height, options.players));
+        writer.begin_match();
+        for (unsigned long tick = 0; tick < MAX_MATCH_TICKS && !simulation.is_over(); ++tick) {
+            for (std::size_t i = 0; i < options.players; ++i)
+                commands[i] = simulation.is_alive(i) ? bots[i].next_command() : Direction::None;
+            const int winner = simulation.step(commands);
+            if (winner != NO_WINNER)
+                ++scoreboard.at(winner);
+            writer.publish(simulation, scoreboard, winner);
+            ++ticks;
+            if (ticks == LATE_JOIN_TICK)
+                late = std::make_unique<BroadcastReader>(name);
+            BroadcastReader* readers[] = { &follower, ticks % LAGGING_READS == 0 ? &lagging : nullptr, late.get() };
+            for (BroadcastReader* reader : readers) {
+                if (reader != nullptr && reader->update() && !same_as(*reader, simulation, scoreboard, static_cast<std::uint32_t>(match)))
+                    ++mismatches;
+            }
+        }
+    }
+    lagging.update();
+    mismatches += !same_as(lagging, simulation, scoreboard, static_cast<std::uint32_t>(options.broadcast_matches));
+    close(stop_pipe[1]);
+    int child_status = 0;
+    waitpid(child, &child_status, 0);
+
+    printf("board        %dx%d, %zu players, %lu matches, %lu ticks\n", options.width, options.height, options.players, options.broadcast_matches, ticks);
+    writer.get_stats().print(stdout);
+    const std::pair<const char*, BroadcastReader const*> readers[] = { { "follower", &follower }, { "lagging", &lagging }, { "late", late.get() } };
+    unsigned long keyframe_mismatches = 0;
+    for (auto const& [reader_name, reader] : readers) {
+        if (reader == nullptr)
+            continue;
+        printf("%-12s ", reader_name);
+        reader->get_stats().print(stdout);
+        keyframe_mismatches += reader->get_stats().keyframe_mismatches;
+    }
+    printf("mismatches   %lu with the simulation, %lu keyframes, child %s\n", mismatches, keyframe_mismatches,
+        WIFEXITED(child_status) && WEXITSTATUS(child_status) == 0 ? "ok" : "FAILED");
+    return mismatches == 0 && keyframe_mismatches == 0 && WIFEXITED(child_status) && WEXITSTATUS(child_status) == 0;
+}
+
+// the index'th logged match of a --history run, made up rather than played: millions of real matches would take minutes
+MatchSummary history_match(Options const& options, std::uint64_t const index) {
+    SplitMix64 rng(options.seed * 0x100000001b3ull + index);
+    MatchSummary match;
+    match.player_count = 2 + rng.next() % (options.players - 1);
+    match.winner = static_cast<int>(rng.next() % (match.player_count + 2)) - 1;
+    match.ticks = static_cast<std::uint32_t>(10 + rng.next() % 5000);
+    for (std::size_t i = 0; i < match.player_count; ++i)
+        match.lengths[i] = static_cast<std::uint32_t>(3 + rng.next() % 200);
+    match.collision_count = match.winner == NO_WINNER ? 0 : 1 + rng.next() % match.player_count;
+    for (std::size_t i = 0; i < match.collision_count; ++i)
+        match.collisions[i] = { static_cast<int>(rng.next() % options.width), static_cast<int>(rng.next() % options.height) };
+    return match;
+}
+
+/*
+Logs matches to a fresh history from this process and a child process at
+the same time, so they take turns through the file lock and each keeps
+writing after the other has compacted the file. Then checks that the
+lifetime totals a new MatchHistory loads from segment headers, and a scan
+of every record left, both equal the totals of everything logged, that
+compaction got the log under HISTORY_COMPACT_AT sealed segments, and that
+a torn write at the end is ignored and cut off by the next append.
+Returns false on any difference.
+*/
+bool check_history(Options const& options) {
+    using clock = std::chrono::steady_clock;
+    const std::string path = "/tmp/snake-headless-history-" + std::to_string(getpid()) + ".bin";
+    ::unlink(path.c_str());
+    const std::uint64_t matches = options.history_matches, child_matches = matches / 4;
+    MatchTotals expected{};
+    std::uint64_t logged_bytes = 0;
+    for (std::uint64_t i = 0; i < matches; ++i) {
+        const MatchSummary match = history_match(options, i);
+        expected.add(match.winner, match.ticks);
+        logged_bytes += sizeof(HistoryRecord) + match.player_count * sizeof(std::uint32_t) + match.collision_count * 2 * sizeof(std::int32_t);
+    }
+
+    // the child logs the first quarter, this process the rest, both at once
+    fflush(stdout);
+    const pid_t child = fork();
+    if (child < 0)
+        throw runtime_error("can't fork a second writer");
+    if (child == 0) {
+        int status = 0;
+        try {
+            MatchHistory history(path);
+            for (std::uint64_t i = 0; i < child_matches; ++i)
+                history.append(history_match(options, i));
+        } catch (const exception& err) {
+            fprintf(stderr, "headless: history writer: %s\n", err.what());
+            status = 1;
+        }
+        _exit(status);
+    }
+    HistoryStats writer_stats;
+    auto start_time = clock::now();
+    {
+        MatchHistory history(path);
+        for (std::uint64_t i = child_matches; i < matches; ++i)
+            history.append(history_match(options, i));
+        writer_stats = history.get_stats();
+    }
+    int child_status = 0;
+    waitpid(child, &child_status, 0);
+    const double append_seconds = std::chrono::duration<double>(clock::now() - start_time).count();
+    const bool child_ok = WIFEXITED(child_status) && WEXITSTATUS(child_status) == 0;
+
+    // a new process' view: totals from the headers, then whatever compaction the writers left undone
+    MatchHistory reader(path);
+    const MatchTotals loaded = reader.wait_for_totals();
+    reader.wait_for_worker();
+    const HistoryStats reader_stats = reader.get_stats();
+    start_time = clock::now();
+    HistoryScan full;
+    std::size_t file_size;
+    {
+        const MappedFile file(path);
+        full = scan_history(file.begin(), file.size(), true);
+        file_size = file.size();
+    }
+    const double full_scan_ms = std::chrono::duration<double, std::milli>(clock::now() - start_time).count();
+    HistoryScan headers;
+    {
+        const MappedFile file(path);
+        headers = scan_history(file.begin(), file.size());
+    }
+
+    // half a record at the end, as if a writer died mid write
+    bool torn_ok = false;
+    {
+        const int fd = ::open(path.c_str(), O_WRONLY | O_APPEND);
+        const std::uint8_t torn[7] = { 40, 0, 2, 1, 9, 9, 9 };
+        torn_ok = fd >= 0 && ::write(fd, torn, sizeof(torn)) == static_cast<ssize_t>(sizeof(torn));
+        ::close(fd);
+        MatchHistory repaired(path);
+        torn_ok = torn_ok && repaired.wait_for_totals() == expected;
+        const MatchSummary match = history_match(options, matches);
+        repaired.append(match);
+        MatchTotals more = expected;
+        more.add(match.winner, match.ticks);
+        const MappedFile file(path);
+        torn_ok = torn_ok && repaired.wait_for_totals() == more && scan_history(file.begin(), file.size(), true).totals == more;
+    }
+    ::unlink(path.c_str());
+
+    const bool loaded_ok = loaded == expected, full_ok = full.totals == expected, compacted_ok = headers.sealed < HISTORY_COMPACT_AT;
+    printf("matches      %llu (%llu from a child process), %.0f appends/sec\n", static_cast<unsigned long long>(matches),
+        static_cast<unsigned long long>(child_matches), append_seconds > 0 ? matches / append_seconds : 0.0);
+    writer_stats.append_time.print(stdout, "append");
+    printf("load         %.3f ms: %zu segments, %llu records read\n", reader_stats.load_time.max() / 1e6,
+        reader_stats.segments, static_cast<unsigned long long>(reader_stats.records_read));
+    printf("full scan    %.3f ms: %llu records still in the log\n", full_scan_ms, static_cast<unsigned long long>(full.records_read));
+    printf("file         %zu bytes, %llu bytes of records logged, %u + %u compactions, %zu sealed segments left\n", file_size,
+        static_cast<unsigned long long>(logged_bytes), writer_stats.compactions, reader_stats.compactions, headers.sealed);
+    printf("totals       green %llu, blue %llu, draw %llu, none %llu\n",
+        static_cast<unsigned long long>(loaded.wins[0]), static_cast<unsigned long long>(loaded.wins[1]),
+        static_cast<unsigned long long>(loaded.draws), static_cast<unsigned long long>(loaded.no_winner));
+    printf("checks       loaded %s, full scan %s, compacted %s, torn write %s, child %s\n", loaded_ok ? "ok" : "FAILED",
+        full_ok ? "ok" : "FAILED", compacted_ok ? "ok" : "FAILED", torn_ok ? "ok" : "FAILED", child_ok ? "ok" : "FAILED");
+    return loaded_ok && full_ok && compacted_ok && torn_ok && child_ok;
+}
+
+// one snake's half of the board in a --food run: columns x0..x1, rows y0..y1 (an even number of them)
+struct FoodRegion {
+    int x0, y0, x1, y1;
+
+    int area() const {
+        return (x1 - x0 + 1) * (y1 - y0 + 1);
+    }
+
+    // the next cell of a cycle through every cell: right along the top row, back and forth along the rows below
+    // (leaving out column x0), then up column x0 to the start
+    Direction next(Coordinates const& pos) const {
+        if (pos.y == y0)
+            return pos.x < x1 ? Direction::Right : Direction::Down;
+        if (pos.x == x0)
+            return Direction::Up;
+        if ((pos.y - y0) % 2 == 1)
+            return pos.x > x0 + 1 || pos.y == y1 ? Direction::Left : Direction::Down;
+        return pos.x < x1 ? Direction::Right : Direction::Down;
+    }
+};
+
+// spawning pellets at one occupancy, with the free cell set and by rejection sampling
+struct SpawnTiming {
+    double occupancy;
+    std::size_t free;
+    double set_ns, rejection_ns, rejection_tries;
+};
+
+// whether every empty cell is either free or a pellet and every pellet lies on an empty cell, O(board)
+template <typename SimulationType>
+bool free_cells_consistent(SimulationType const& simulation) {
+    FreeCells const& free = simulation.get_free_cells();
+    const int width = simulation.get_width();
+    vector<std::uint8_t> food(static_cast<std::size_t>(width) * simulation.get_height(), 0);
+    for (Coordinates pos : simulation.get_food())
+        ++food[static_cast<std::size_t>(pos.y) * width + pos.x];
+    std::size_t empty = 0;
+    for (int y = 0; y < simulation.get_height(); ++y) {
+        for (int x = 0; x < width; ++x) {
+            const std::uint8_t pellets = food[static_cast<std::size_t>(y) * width + x];
+            const bool is_empty = simulation.get_board().owner({ x, y }) == CELL_EMPTY, is_food = pellets > 0;
+            if (pellets > 1)
+                return false; // two pellets in one cell
+            empty += is_empty;
+            if (free.contains({ x, y }) != (is_empty && !is_food) || (is_food && !is_empty))
+                return false;
+        }
+    }
+    return empty == free.size() + simulation.get_food().size();
+}
+
+/*
+Fills the board in food mode: two snakes start 1 long, each going round a
+cycle through every cell of its half of the board, so neither crashes
+until it eats the last cell of its half, which is where the run stops
+(the board is over 99% full by then on any but a tiny board). Every tick
+checks that the pellets are all there (or the free cells have run out)
+and that free cells, pellets and snake cells add up to the playing area,
+every 4096 ticks and at each occupancy timed the empty cells are checked
+one by one against the free set. At each occupancy spawning is timed with
+the free set and with rejection sampling, at 97% the free set is checked
+for uniformity (chi-square over every free cell) and a snapshot restored
+into a second simulation has to play on the same. No tick may allocate.
+Returns false if any check fails.
+*/
+bool check_food(Options const& options) {
+    using clock = std::chrono::steady_clock;
+    static constexpr double OCCUPANCIES[] = { 0.5, 0.9, 0.95, 0.97, 0.99, 0.999 };
+    static constexpr std::size_t OCCUPANCY_COUNT = sizeof(OCCUPANCIES) / sizeof(OCCUPANCIES[0]);
+    static constexpr int SAMPLES = 20000;
+    static constexpr unsigned long FULL_CHECK_INTERVAL = 4096, REPLAY_TICKS = 2000;
+    const int width = options.width, height = options.height;
+    const std::size_t interior = static_cast<std::size_t>(width - 2) * (height - 2);
+    const FoodRegion regions[2] = {
+        { 1, 1, (width - 2) / 2, height - 2 },
+        { (width - 2) / 2 + 1, 1, width - 2, height - 2 }
+    };
+    auto make_food_players = [&] {
+        vector<shared_ptr<Player>> players;
+        for (int i = 0; i < 2; ++i)
+            players.push_back(make_shared<Player>(i + 1, Coordinates{ regions[i].x0, regions[i].y0 }, Direction::Right, 0, 0, 0, 0, 1, body_capacity(width, height)));
+        return players;
+    };
+    Simulation simulation(width, height, make_food_players());
+    simulation.set_food(options.food, options.seed);
+
+    auto occupancy = [&] {
+        return 1.0 - static_cast<double>(simulation.get_free_cells().size() + simulation.get_food().size()) / interior;
+    };
+    auto commands_for = [&](Simulation const& sim, Direction* commands) {
+        for (std::size_t i = 0; i < 2; ++i)
+            commands[i] = regions[i].next(sim.get_player(i).get_snake().get_head());
+    };
+
+    vector<SpawnTiming> timings;
+    std::size_t next_occupancy = 0;
+    unsigned long ticks = 0, allocations = 0, tick_failures = 0, full_checks = 0, full_failures = 0, eaten = 0;
+    double chi_square_z = 0;
+    std::size_t chi_square_cells = 0;
+    bool uniform_ok = false, replay_ok = false;
+    std::unique_ptr<Simulation> restored; // from a snapshot at 97%, stepped alongside until replay_until or the board fills
+    unsigned long replay_until = 0;
+    vector<std::uint8_t> snapshot, expected, actual;
+    Direction commands[MAX_PLAYERS];
+    SplitMix64 rng(options.seed);
+    const auto start_time = clock::now();
+    double tick_seconds = 0;
+    // a snake that ate the last cell of its half would be 1 longer than the half next tick, and crash
+    auto nearly_full = [&] {
+        for (std::size_t i = 0; i < 2; ++i) {
+            if (static_cast<std::size_t>(regions[i].area()) - simulation.get_player(i).get_body().size() <= 1)
+                return true;
+        }
+        return false;
+    };
+    auto compare_restored = [&] {
+        expected.clear();
+        simulation.save_snapshot(expected);
+        actual.clear();
+        restored->save_snapshot(actual);
+        replay_ok = expected == actual && simulation.get_food() == restored->get_food();
+        restored.reset();
+    };
+    while (ticks < options.ticks && !nearly_full()) {
+        commands_for(simulation, commands);
+        const std::size_t before_food = simulation.get_food().size() + simulation.get_free_cells().size();
+        const auto tick_start = clock::now();
+        const unsigned long allocations_before = allocation_count.load(std::memory_order_relaxed);
+        simulation.step(commands);
+        allocations += allocation_count.load(std::memory_order_relaxed) - allocations_before;
+        tick_seconds += std::chrono::duration<double>(clock::now() - tick_start).count();
+        ++ticks;
+        eaten += before_food - (simulation.get_food().size() + simulation.get_free_cells().size());
+
+        // O(pellets) every tick
+        bool tick_ok = simulation.get_alive_count() == 2 && simulation.get_winner() == NO_WINNER;
+        tick_ok = tick_ok && (simulation.get_food().size() == options.food || simulation.get_free_cells().empty());
+        std::size_t snake_cells = 0;
+        for (std::size_t i = 0; i < 2; ++i)
+            snake_cells += simulation.get_player(i).get_body().size();
+        tick_ok = tick_ok && snake_cells + simulation.get_free_cells().size() + simulation.get_food().size() == interior;
+        for (Coordinates pos : simulation.get_food())
+            tick_ok = tick_ok && simulation.get_board().owner(pos) == CELL_EMPTY && !simulation.get_free_cells().contains(pos);
+        tick_failures += !tick_ok;
+
+        if (restored) {
+            commands_for(*restored, commands);
+            restored->step(commands);
+            if (ticks == replay_until)
+                compare_restored();
+        }
+
+        const bool new_occupancy = next_occupancy < OCCUPANCY_COUNT && occupancy() >= OCCUPANCIES[next_occupancy];
+        if (ticks % FULL_CHECK_INTERVAL == 0 || new_occupancy) {
+            ++full_checks;
+            full_failures += !free_cells_consistent(simulation);
+        }
+        if (!new_occupancy)
+            continue;
+        const double reached = OCCUPANCIES[next_occupancy++];
+        if (simulation.get_free_cells().empty())
+            continue; // the board filled up in one go, there is nothing left to spawn on
+
+        // time spawning on a copy of the free set and on the board itself
+        FreeCells const& free = simulation.get_free_cells();
+        SpawnTiming timing{ occupancy(), free.size(), 0, 0, 0 };
+        std::uint64_t sink = 0;
+        auto start = clock::now();
+        for (int i = 0; i < SAMPLES; ++i) {
+            const Coordinates pos = free.sample(rng);
+            sink += static_cast<std::uint64_t>(pos.x) + pos.y;
+        }
+        timing.set_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count() / SAMPLES;
+        unsigned long tries = 0;
+        start = clock::now();
+        for (int i = 0; i < SAMPLES; ++i) {
+            for (;;) {
+                ++tries;
+                const std::uint64_t roll = rng.next();
+                const Coordinates pos{ 1 + static_cast<int>((roll & 0xFFFFFFFF) % (width - 2)), 1 + static_cast<int>((roll >> 32) % (height - 2)) };
+                if (free.contains(pos)) { // empty and without a pellet, as the board and a scan of the pellets would say
+                    sink += static_cast<std::uint64_t>(pos.x) + pos.y;
+                    break;
+                }
+            }
+        }
+        timing.rejection_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count() / SAMPLES;
+        timing.rejection_tries = static_cast<double>(tries) / SAMPLES;
+        if (sink == 0)
+            printf("\n"); // keeps the sampling loops from being optimised away
+        timings.push_back(timing);
+
+        if (reached != 0.97)
+            continue;
+        // every free cell should come up equally often
+        vector<unsigned> counts(static_cast<std::size_t>(width) * height, 0);
+        const std::size_t draws = 200 * free.size();
+        for (std::size_t i = 0; i < draws; ++i) {
+            const Coordinates pos = free.sample(rng);
+            ++counts[static_cast<std::size_t>(pos.y) * width + pos.x];
+        }
+        const double expected_count = static_cast<double>(draws) / free.size();
+        double chi_square = 0;
+        bool only_free = true;
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                const unsigned count = counts[static_cast<std::size_t>(y) * width + x];
+                if (!free.contains({ x, y })) {
+                    only_free = only_free && count == 0;
+                    continue;
+                }
+                chi_square += (count - expected_count) * (count - expected_count) / expected_count;
+            }
+        }
+        chi_square_cells = free.size();
+        const double degrees = static_cast<double>(free.size() - 1);
+        chi_square_z = (chi_square - degrees) / std::sqrt(2 * degrees);
+        uniform_ok = only_free && std::abs(chi_square_z) < 5;
+
+        // a restored snapshot plays on as the original, pellets included
+        snapshot.clear();
+        simulation.save_snapshot(snapshot);
+        restored = std::make_unique<Simulation>(width, height, make_food_players());
+        restored->set_food(options.food, options.seed + 1); // a different seed, the snapshot's generator replaces it
+        restored->load_snapshot(snapshot.data());
+        replay_until = ticks + REPLAY_TICKS;
+    }
+    if (restored)
+        compare_restored(); // filled up before replay_until
+    const double seconds = std::chrono::duration<double>(clock::now() - start_time).count();
+    const bool final_ok = free_cells_consistent(simulation);
+    const double reached = occupancy();
+    ++full_checks;
+    full_failures += !final_ok;
+
+    printf("board        %dx%d, %zu cells to fill, %zu pellets\n", width, height, interior, options.food);
+    printf("ticks        %lu, %lu pellets eaten, %.1f%% occupied at the end\n", ticks, eaten, 100 * reached);
+    printf("seconds      %.3f (%.3f stepping, %.0f ticks/sec)\n", seconds, tick_seconds, tick_seconds > 0 ? ticks / tick_seconds : 0.0);
+    printf("occupancy    free cells   free set   rejection  (tries)\n");
+    for (SpawnTiming const& timing : timings) {
+        printf("  %6.2f%%    %10zu   %6.1f ns   %9.1f ns  (%.1f)\n", 100 * timing.occupancy, timing.free, timing.set_ns,
+            timing.rejection_ns, timing.rejection_tries);
+    }
+    if (chi_square_cells > 0)
+        printf("uniformity   chi-square over %zu free cells at 97%%: z = %.2f\n", chi_square_cells, chi_square_z);
+    const bool filled = reached > 0.95, allocations_ok = allocations == 0;
+    printf("checks       ticks %s (%lu failed), free set %s (%lu of %lu failed), uniform %s, snapshot %s, allocations %s (%lu), over 95%% %s\n",
+        tick_failures == 0 ? "ok" : "FAILED", tick_failures, full_failures == 0 ? "ok" : "FAILED", full_failures, full_checks,
+        uniform_ok ? "ok" : "FAILED", replay_ok ? "ok" : "FAILED", allocations_ok ? "ok" : "FAILED", allocations, filled ? "ok" : "FAILED");
+    return tick_failures == 0 && full_failures == 0 && uniform_ok && replay_ok && allocations_ok && filled;
+}
+
+void print_tournament(TournamentResult const& result, std::size_t threads, double single_thread_rate) {
+    printf("threads %-3zu  matches %-9lu (green %d, blue %d, draw %d, none %d)  %.3fs  %10.0f matches/sec  %12.0f ticks/sec",
+        threads, result.matches,
+        result.scoreboard.at(PLAYER1), result.scoreboard.at(PLAYER2), result.scoreboard.at(DRAW), result.scoreboard.at(NO_WINNER),
+        result.seconds, result.matches_per_second(), result.seconds > 0 ? result.ticks / result.seconds : 0.0);
+    if (single_thread_rate > 0)
+        printf("  speedup %.2fx", result.matches_per_second() / single_thread_rate);
+    printf("\n");
+    if (result.bot_decision_time.count() > 0) {
+        result.bot_decision_time.print(stdout, "  bot decision");
+        printf("  bot budget overruns %lu\n", result.bot_budget_overruns);
+    }
+}
+
+// independent seeded matches spread over a thread pool, optionally repeated at 1, 2, 4 ... threads
+void run_tournament(Options const& options) {
+    MatchConfig config;
+    config.width = options.width;
+    config.height = options.height;
+    config.p1_bot = options.p1_bot;
+    config.p2_bot = options.p2_bot;
+    config.bot_budget = std::chrono::microseconds(options.bot_budget_us);
+    config.record_path = options.record_path;
+    printf("board %dx%d, %lu matches, seeds %u..%lu\n", options.width, options.height,
+        options.tournament_matches, options.seed, options.seed + options.tournament_matches - 1);
+
+    double single_thread_rate = 0;
+    if (options.scaling) {
+        for (std::size_t threads = 1; threads < options.threads; threads *= 2) {
+            const TournamentResult result = snake::run_tournament(config, options.tournament_matches, threads, options.seed);
+            if (threads == 1)
+                single_thread_rate = result.matches_per_second();
+            print_tournament(result, threads, single_thread_rate);
+        }
+    }
+    const TournamentResult result = snake::run_tournament(config, options.tournament_matches, options.threads, options.seed);
+    print_tournament(result, options.threads, single_thread_rate);
+}
+
+// replays every match of an archive at full speed: once from the start, checking every snapshot and the
+// outcome against the recording, then again from a seek to the middle
+bool verify_replays(Options const& options) {
+    const ReplayArchive archive(options.replay_path);
+    unsigned long ticks = 0, mismatches = 0;
+    vector<std::uint8_t> snapshot;
+    LatencyHistogram seek_time;
+    auto start_time = std::chrono::steady_clock::now();
+    const std::size_t matches = archive.for_each([&](ReplayView const& view) {
+        ReplayHeader const& header = view.get_header();
+        Simulation simulation = make_replay_simulation(view.get_setup());
+        ReplayPlayer player(view);
+        std::uint32_t next_snapshot = 0;
+        Direction p1_cmd, p2_cmd;
+        bool match_ok = true;
+        while (!simulation.is_over() && simulation.get_frame_count() < header.total_ticks) {
+            const std::uint32_t tick = static_cast<std::uint32_t>(simulation.get_frame_count());
+            if (next_snapshot < header.snapshot_count && view.snapshot(next_snapshot).tick == tick) {
+                snapshot.clear();
+                simulation.save_snapshot(snapshot);
+                if (std::memcmp(snapshot.data(), view.snapshot_data(view.snapshot(next_snapshot)), snapshot.size()) != 0)
+                    match_ok = false;
+                ++next_snapshot;
+            }
+            player.commands(tick, p1_cmd, p2_cmd);
+            simulation.step(p1_cmd, p2_cmd);
+        }
+        ticks += simulation.get_frame_count();
+        if (simulation.get_winner() != header.winner || simulation.get_frame_count() != header.total_ticks)
+            match_ok = false;
+
+        // seeking to the middle and playing on must end the same way
+        Simulation sought = make_replay_simulation(view.get_setup());
+        ReplayPlayer seeker(view);
+        const auto seek_start = std::chrono::steady_clock::now();
+        seeker.seek(sought, header.total_ticks / 2);
+        seek_time.record(std::chrono::steady_clock::now() - seek_start);
+        while (!sought.is_over() && sought.get_frame_count() < header.total_ticks) {
+            seeker.commands(static_cast<std::uint32_t>(sought.get_frame_count()), p1_cmd, p2_cmd);
+            sought.step(p1_cmd, p2_cmd);
+        }
+        if (sought.get_winner() != header.winner || sought.get_frame_count() != header.total_ticks)
+            match_ok = false;
+        mismatches += !match_ok;
+    });
+    auto finish_time = std::chrono::steady_clock::now();
+    const double seconds = std::chrono::duration<double>(finish_time - start_time).count();
+    printf("replays      %zu\n", matches);
+    printf("ticks        %lu\n", ticks);
+    printf("mismatches   %lu\n", mismatches);
+    printf("seconds      %.3f\n", seconds);
+    printf("ticks/sec    %.0f\n", seconds > 0 ? ticks / seconds : 0.0);
+    seek_time.print(stdout, "seek");
+    return mismatches == 0;
+}
+
+// one side of a rollback match: its own Simulation, fed by its own bot and the other side's messages
+struct RollbackPeer {
+    Simulation simulation;
+    LoopbackTransport transport;
+    RollbackSession<LoopbackTransport> session;
+    RandomBot bot;
+    vector<Direction> sent; // the local command of every tick, for the lockstep reference
+
+    RollbackPeer(Options const& options, LoopbackTransport link, int const player, std::uint64_t const seed) :
+        simulation(make_replay_simulation({ options.width, options.height,
+            calculate_starting_positions(options.width, options.height).player1_start,
+            calculate_starting_positions(options.width, options.height).player2_start,
+            calculate_starting_positions(options.width, options.height).initial_width / 5, FRAMES_PER_SECOND })),
+        transport(std::move(link)),
+        session(simulation, transport, player),
+        bot(seed)
+    {}
+
+    void tick() {
+        transport.tick();
+        session.poll();
+        if (session.can_step()) {
+            const Direction cmd = bot.next_command();
+            sent.push_back(cmd);
+            session.step(cmd);
+        }
+    }
+};
+
+// two rollback sessions in one process over a LoopbackTransport with random latency, each match checked
+// against the same commands played in lockstep
+bool run_rollback(Options const& options) {
+    const unsigned long matches = options.tournament_matches > 0 ? options.tournament_matches : 100;
+    const unsigned max_delay = static_cast<unsigned>(options.rollback_delay);
+    const StartingPositions start = calculate_starting_positions(options.width, options.height);
+    RollbackStats total;
+    unsigned long mismatches = 0, ticks = 0;
+    vector<std::uint8_t> expected, actual;
+    auto start_time = std::chrono::steady_clock::now();
+    for (unsigned long match = 0; match < matches; ++match) {
+        const std::uint64_t seed = options.seed + match;
+        auto link = LoopbackTransport::make_pair(0, max_delay, seed);
+        RollbackPeer green(options, std::move(link.first), PLAYER1, seed * 2 + 1);
+        RollbackPeer blue(options, std::move(link.second), PLAYER2, seed * 2 + 2);
+        while (green.session.confirmed_winner() == NO_WINNER || blue.session.confirmed_winner() == NO_WINNER) {
+            if (green.simulation.get_frame_count() > options.ticks)
+                throw runtime_error("rollback match did not finish");
+            green.tick();
+            blue.tick();
+        }
+
+        Simulation reference = make_replay_simulation({ options.width, options.height, start.player1_start, start.player2_start, start.initial_width / 5, FRAMES_PER_SECOND });
+        while (!reference.is_over()) {
+            const std::size_t tick = reference.get_frame_count();
+            reference.step(tick < green.sent.size() ? green.sent[tick] : Direction::None, tick < blue.sent.size() ? blue.sent[tick] : Direction::None);
+        }
+        expected.clear();
+        reference.save_snapshot(expected);
+        for (RollbackPeer const* peer : { &green, &blue }) {
+            actual.clear();
+            peer->simulation.save_snapshot(actual);
+            if (peer->session.confirmed_winner() != reference.get_winner() || actual != expected)
+                ++mismatches;
+        }
+        ticks += reference.get_frame_count();
+
+        for (RollbackPeer const* peer : { &green, &blue }) {
+            RollbackStats const& stats = peer->session.get_stats();
+            total.ticks += stats.ticks;
+            total.stalls += stats.stalls;
+            total.rollbacks += stats.rollbacks;
+            total.resimulated_ticks += stats.resimulated_ticks;
+            total.max_depth = std::max(total.max_depth, stats.max_depth);
+            total.save_time.merge(stats.save_time);
+            total.rollback_time.merge(stats.rollback_time);
+            total.resimulated_tick_time.merge(stats.resimulated_tick_time);
+        }
+    }
+    auto finish_time = std::chrono::steady_clock::now();
+    const double seconds = std::chrono::duration<double>(finish_time - start_time).count();
+    printf("board        %dx%d, latency 0..%u ticks\n", options.width, options.height, max_delay);
+    printf("matches      %lu\n", matches);
+    printf("ticks        %lu\n", ticks);
+    printf("mismatches   %lu\n", mismatches);
+    printf("seconds      %.3f\n", seconds);
+    total.print(stdout);
+    return mismatches == 0;
+}
+
+// a --server player: joins like snake.o --join, a random bot plays blue and asks for a rematch as soon as a match ends
+struct ServerClient {
+    SocketTransport connection;
+    NetHello board;
+    Simulation simulation;
+    RollbackSession<SocketTransport> session;
+    RandomBot bot;
+    bool restarting;
+
+    ServerClient(std::string const& address, std::uint64_t const seed) :
+        connection(SocketTransport::connect(address)),
+        board(connection.receive_hello()),
+        simulation(board.width, board.height, make_bot_players(board.width, board.height, 2), board.tick_rate),
+        session(simulation, connection, PLAYER2),
+        bot(seed),
+        restarting(false)
+    {}
+
+    void tick() {
+        if (restarting) {
+            if (!session.try_restart())
+                return;
+            simulation.reset(make_bot_players(board.width, board.height, 2));
+            session.reset();
+            restarting = false;
+        }
+        session.poll();
+        if (session.can_step())
+            session.step(bot.next_command());
+        restarting = session.confirmed_winner() != NO_WINNER;
+    }
+};
+
+// a --server player that sends its moves but never reads what the server sends back, like a suspended snake.o
+// --join or a hostile peer: the server has to drop it without holding up a worker. Going straight it hits a wall
+// well within SILENT_MATCH_TICKS, so asking for a rematch after that many keeps the server playing, and sending,
+// without having to read how the match went. Moves go out a couple of ticks late, never ahead of the server
+struct SilentClient {
+    static constexpr std::uint32_t SILENT_MATCH_TICKS = 100;
+    static constexpr std::uint32_t SILENT_LAG = 2;
+
+    SocketTransport connection;
+    std::uint32_t match_tick;
+    bool dropped;
+
+    explicit SilentClient(std::string const& address) : connection(SocketTransport::connect(address)), match_tick(0), dropped(false) {}
+
+    void tick() {
+        if (dropped)
+            return;
+        try {
+            if (match_tick >= SILENT_LAG)
+                connection.send({ match_tick - SILENT_LAG, NetMessageType::Input, static_cast<std::uint8_t>(Direction::None), 0 });
+            if (++match_tick == SILENT_MATCH_TICKS) {
+                connection.send({ 0, NetMessageType::Restart, 0, 0 });
+                match_tick = 0;
+            }
+        } catch (const exception&) {
+            dropped = true; // the server hung up
+        }
+    }
+};
+
+constexpr std::size_t SERVER_CONNECTS_PER_TICK = 64;
+constexpr std::chrono::seconds SERVER_WARM_UP{ 1 }, SERVER_MEASURE{ 3 }, SERVER_SILENT_LIMIT{ 30 };
+
+// a GameServer on --threads workers with ever more clients, all ticked from this thread at the tick rate. First a
+// SilentClient plays next to the clients of the first step, and has to be dropped within SERVER_SILENT_LIMIT with
+// every other session still connected. Then at each step (halving down from --server sessions, at most 6 steps) it
+// warms up and reports the server's deadline misses and tick latency percentiles over SERVER_MEASURE. Fails if a
+// session drops
+bool run_server(Options const& options) {
+    using clock = std::chrono::steady_clock;
+    ServerConfig config;
+    config.address = "/tmp/snake-headless-server-" + std::to_string(getpid()) + ".sock";
+    config.width = options.width;
+    config.height = options.height;
+    config.threads = options.threads;
+    config.max_sessions = options.server_sessions + 1; // and a SilentClient
+    config.bot = options.p1_bot;
+    config.bot_budget = std::chrono::microseconds(options.bot_budget_us);
+    GameServer server(config);
+
+    vector<std::size_t> steps;
+    for (std::size_t sessions = options.server_sessions; sessions > 0 && steps.size() < 6; sessions /= 2)
+        steps.insert(steps.begin(), sessions);
+
+    vector<std::unique_ptr<ServerClient>> clients;
+    clients.reserve(options.server_sessions);
+    EventReactor reactor(-1);
+    const clock::duration period = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / config.tick_rate));
+    reactor.arm(clock::now() + period, period);
+    std::uint64_t client_ticks = 0;
+    std::unique_ptr<SilentClient> silent;
+    const auto tick_clients = [&] {
+        reactor.wait_for_tick([] {});
+        for (auto& client : clients)
+            client->tick();
+        if (silent)
+            silent->tick();
+        ++client_ticks;
+    };
+    const auto connect_clients = [&](std::size_t const sessions) {
+        while (clients.size() < sessions) {
+            for (std::size_t i = 0; i < SERVER_CONNECTS_PER_TICK && clients.size() < sessions; ++i)
+                clients.push_back(std::make_unique<ServerClient>(config.address, options.seed + clients.size()));
+            tick_clients();
+        }
+    };
+    const auto tick_for = [&](clock::duration const duration) {
+        const auto until = clock::now() + duration;
+        while (clock::now() < until)
+            tick_clients();
+    };
+
+    printf("board        %dx%d, %u ticks/s, %zu workers, %s server bot\n", config.width, config.height, config.tick_rate, server.get_threads(),
+        config.bot == BotKind::FloodFill ? "flood fill" : "random");
+    bool ok = true;
+    silent = std::make_unique<SilentClient>(config.address);
+    connect_clients(steps.front());
+    const auto silent_start = clock::now();
+    while (!silent->dropped && clock::now() - silent_start < SERVER_SILENT_LIMIT)
+        tick_clients();
+    const double silent_seconds = std::chrono::duration<double>(clock::now() - silent_start).count();
+    tick_for(SERVER_RESOLUTION * 100); // the dispatcher reaps the session on its next deadline
+    const bool silent_ok = silent->dropped && server.get_sessions() == clients.size();
+    printf("silent peer  %s after %.1fs, %zu of %zu other sessions still connected\n", silent->dropped ? "dropped" : "NOT dropped",
+        silent_seconds, server.get_sessions() - (silent->dropped ? 0 : 1), clients.size());
+    ok = ok && silent_ok;
+    silent.reset();
+    printf("%9s %10s %9s %9s %10s %10s %10s %12s %12s\n",
+        "sessions", "ticks/s", "missed", "skipped", "miss %", "p50 us", "p99 us", "max us", "p99 run us");
+    ServerStats last;
+    for (std::size_t const sessions : steps) {
+        connect_clients(sessions);
+        tick_for(SERVER_WARM_UP);
+        server.take_stats();
+        const auto start = clock::now();
+        const std::uint64_t start_ticks = client_ticks;
+        tick_for(SERVER_MEASURE);
+        last = server.take_stats();
+        const double seconds = std::chrono::duration<double>(clock::now() - start).count();
+        printf("%9zu %10.0f %9lu %9lu %9.2f%% %10.1f %10.1f %12.1f %12.1f\n",
+            last.sessions, last.ticks / seconds, last.missed, last.skipped, last.miss_rate(),
+            last.tick_latency.percentile_ns(50) / 1000.0, last.tick_latency.percentile_ns(99) / 1000.0,
+            last.tick_latency.max() / 1000.0, last.tick_time.percentile_ns(99) / 1000.0);
+        if (client_ticks - start_ticks < static_cast<std::uint64_t>(seconds * config.tick_rate * 0.9))
+            printf("             the clients fell behind the tick rate, the server was waiting on them\n");
+        if (last.sessions != sessions || last.closed > 0) {
+            printf("             sessions dropped: %zu connected, %lu closed\n", last.sessions, last.closed);
+            ok = false;
+        }
+    }
+    last.print(stdout);
+    return ok;
+}
+
+}
+
+int main(int argc, char** argv) {
+    try {
+        const Options options = parse_options(argc, argv);
+        if (options.alloc_check_matches > 0)
+            return check_allocations(options) ? 0 : 1;
+        if (options.broadcast_matches > 0)
+            return check_broadcast(options) ? 0 : 1;
+        if (options.history_matches > 0)
+            return check_history(options) ? 0 : 1;
+        if (options.food > 0)
+            return check_food(options) ? 0 : 1;
+        if (!options.replay_path.empty())
+            return verify_replays(options) ? 0 : 1;
+        if (options.rollback_delay >= 0)
+            return run_rollback(options) ? 0 : 1;
+        if (options.server_sessions > 0)
+            return run_server(options) ? 0 : 1;
+        if (options.batch_games > 0)
+            return verify_batch(options) ? 0 : 1;
+        if (options.env_batch > 0)
+            run_env(options);
+        else if (options.tournament_matches > 0)
+            run_tournament(options);
+        else
+            options.arena ? run_ticks<ArenaSimulation>(options) : run_ticks<Simulation>(options);
+    } catch (const exception& err) {
+        fprintf(stderr, "headless: %s\n", err.what());
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,572 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "replay.h"
+#include "stats.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+
+using std::runtime_error;
+
+namespace snake {
+
+/*
+Match history log. Every finished match is appended as one small record,
+and the file is a run of segments:
+
+  HistorySegment  header, with the totals of the segment's matches once sealed
+  records         per match a HistoryRecord, then a u32 final length per
+                  player and an i32 x, y per collision cell
+
+A segment is sealed when it holds HISTORY_SEGMENT_MATCHES records: its
+header is rewritten in place with their totals and a new segment is
+started after it. Lifetime totals are the sealed headers added up, hopping
+from header to header, plus a scan of the one open segment at the end, so
+loading them costs O(segments + HISTORY_SEGMENT_MATCHES) however many
+matches were played. Compaction folds all but the newest
+HISTORY_KEEP_SEGMENTS sealed segments into a single header that keeps
+their totals and drops their records.
+
+Processes writing the same file take turns through flock(). Compaction
+replaces the file by rename(), and a writer that finds its descriptor no
+longer names the path reopens it. All values are native endian and read
+with memcpy out of a memory mapped file, like replay archives.
+*/
+inline constexpr char HISTORY_MAGIC[4] = { 'S', 'N', 'K', 'H' };
+inline constexpr std::uint16_t HISTORY_VERSION = 1;
+inline constexpr std::uint32_t HISTORY_SEGMENT_MATCHES = 4096;
+inline constexpr std::size_t HISTORY_KEEP_SEGMENTS = 4; // sealed segments compaction leaves their records in
+inline constexpr std::size_t HISTORY_COMPACT_AT = 16;   // sealed segments with records before compaction is worth it
+
+inline constexpr std::uint32_t SEGMENT_SEALED = 1;    // the totals cover every record in the segment
+inline constexpr std::uint32_t SEGMENT_COMPACTED = 2; // the records were dropped, only the totals are left
+
+// wins by player id, draws and matches nobody won (errors, quitting)
+struct MatchTotals {
+    std::uint64_t matches;
+    std::uint64_t ticks;
+    std::uint64_t no_winner;
+    std::uint64_t draws;
+    std::uint64_t wins[MAX_PLAYERS]; // index = id - 1
+
+    void add(int const winner, std::uint64_t const match_ticks) {
+        ++matches;
+        ticks += match_ticks;
+        if (winner == NO_WINNER)
+            ++no_winner;
+        else if (winner == DRAW)
+            ++draws;
+        else
+            ++wins[winner - 1];
+    }
+
+    void add(MatchTotals const& other) {
+        matches += other.matches;
+        ticks += other.ticks;
+        no_winner += other.no_winner;
+        draws += other.draws;
+        for (std::size_t i = 0; i < MAX_PLAYERS; ++i)
+            wins[i] += other.wins[i];
+    }
+
+    bool operator==(MatchTotals const& other) const {
+        return std::memcmp(this, &other, sizeof(MatchTotals)) == 0;
+    }
+};
+
+struct HistorySegment {
+    char magic[4];
+    std::uint16_t version;
+    std::uint16_t header_size;
+    std::uint32_t flags;
+    std::uint32_t record_count; // valid once sealed
+    std::uint64_t segment_size; // header included, valid once sealed
+    MatchTotals totals;         // valid once sealed
+};
+
+struct HistoryRecord {
+    std::uint16_t record_size; // lengths and collisions included
+    std::uint8_t player_count;
+    std::int8_t winner;
+    std::uint32_t ticks;
+    std::uint16_t collision_count;
+    std::uint16_t reserved;
+};
+
+inline constexpr std::size_t MAX_HISTORY_RECORD = sizeof(HistoryRecord) + MAX_PLAYERS * sizeof(std::uint32_t) + MAX_PLAYERS * 2 * sizeof(std::int32_t);
+
+// a finished match as logged, fixed size so the end of a match doesn't allocate
+struct MatchSummary {
+    int winner;
+    std::uint32_t ticks;
+    std::size_t player_count;
+    std::array<std::uint32_t, MAX_PLAYERS> lengths;
+    std::size_t collision_count;
+    std::array<Coordinates, MAX_PLAYERS> collisions; // every snake crashes at most once
+};
+
+template <typename SimulationType>
+MatchSummary summarize_match(SimulationType const& sim, int const winner) {
+    MatchSummary summary;
+    summary.winner = winner;
+    summary.ticks = static_cast<std::uint32_t>(sim.get_frame_count());
+    summary.player_count = sim.get_player_count();
+    for (std::size_t i = 0; i < summary.player_count; ++i)
+        summary.lengths[i] = static_cast<std::uint32_t>(sim.get_player(i).get_snake().get_length());
+    summary.collision_count = std::min(sim.get_collisions().size(), MAX_PLAYERS);
+    std::copy_n(sim.get_collisions().begin(), summary.collision_count, summary.collisions.begin());
+    return summary;
+}
+
+// a record is only taken if all of it is there and it makes sense, anything else is the torn end of an interrupted write
+inline bool read_history_record(std::uint8_t const* at, std::size_t const room, HistoryRecord& record) {
+    if (room < sizeof(HistoryRecord))
+        return false;
+    std::memcpy(&record, at, sizeof(record));
+    return record.player_count >= 2 && record.player_count <= MAX_PLAYERS &&
+        record.winner >= NO_WINNER && record.winner <= record.player_count &&
+        record.collision_count <= MAX_PLAYERS &&
+        record.record_size == sizeof(HistoryRecord) + record.player_count * sizeof(std::uint32_t) + record.collision_count * 2 * sizeof(std::int32_t) &&
+        record.record_size <= room;
+}
+
+// what a pass over a log found, and where appending carries on
+struct HistoryScan {
+    MatchTotals totals{};
+    std::size_t segments = 0;
+    std::size_t sealed = 0;       // sealed segments that still have their records
+    std::uint64_t records_read = 0;
+    bool open_segment = false;    // false for an empty file, the first append starts a segment
+    std::size_t tail_offset = 0;  // header of the open segment
+    std::uint32_t tail_records = 0;
+    MatchTotals tail_totals{};
+    std::size_t valid_size = 0;   // anything after it is a torn write, cut off by the next append
+};
+
+/*
+Adds up a log. Sealed segments count through their headers unless
+every_record is set, which reads every record the way a log without
+segment totals would have to (compacted segments have nothing else).
+*/
+inline HistoryScan scan_history(std::uint8_t const* data, std::size_t const size, bool const every_record = false) {
+    HistoryScan scan;
+    std::size_t at = 0;
+    while (at + sizeof(HistorySegment) <= size) {
+        HistorySegment header;
+        std::memcpy(&header, data + at, sizeof(header));
+        if (std::memcmp(header.magic, HISTORY_MAGIC, sizeof(header.magic)) != 0 || header.version != HISTORY_VERSION || header.header_size != sizeof(HistorySegment))
+            throw runtime_error("not a match history or a different version");
+        ++scan.segments;
+        const bool sealed = header.flags & SEGMENT_SEALED;
+        if (sealed && (header.segment_size < sizeof(HistorySegment) || header.segment_size > size - at))
+            throw runtime_error("match history is corrupt");
+        if (sealed && !(every_record && !(header.flags & SEGMENT_COMPACTED))) {
+            scan.totals.add(header.totals);
+            if (!(header.flags & SEGMENT_COMPACTED))
+                ++scan.sealed;
+            at += header.segment_size;
+            scan.valid_size = at;
+            continue;
+        }
+        // the open segment runs to the end of the file
+        const std::size_t end = sealed ? at + header.segment_size : size;
+        MatchTotals segment{};
+        std::uint32_t records = 0;
+        std::size_t record_at = at + sizeof(HistorySegment);
+        HistoryRecord record;
+        while (record_at < end && read_history_record(data + record_at, end - record_at, record)) {
+            segment.add(record.winner, record.ticks);
+            ++records;
+            record_at += record.record_size;
+        }
+        scan.records_read += records;
+        scan.totals.add(segment);
+        if (sealed) {
+            if (record_at != end || !(segment == header.totals))
+                throw runtime_error("match history is corrupt");
+            ++scan.sealed;
+            at = end;
+            scan.valid_size = at;
+            continue;
+        }
+        scan.open_segment = true;
+        scan.tail_offset = at;
+        scan.tail_records = records;
+        scan.tail_totals = segment;
+        scan.valid_size = record_at;
+        break;
+    }
+    return scan;
+}
+
+struct HistoryStats {
+    LatencyHistogram load_time;   // lifetime totals from the mapped file
+    LatencyHistogram append_time; // per finished match
+    std::size_t segments = 0;     // as of the last load
+    std::uint64_t records_read = 0; // by the last load, the open segment's
+    unsigned compactions = 0;
+    std::uint64_t bytes_before = 0, bytes_after = 0; // the last compaction
+
+    void print(std::FILE* out) const {
+        load_time.print(out, "history load");
+        append_time.print(out, "history append");
+        std::fprintf(out, "history: %zu segments, %llu records read to load, %u compactions",
+            segments, static_cast<unsigned long long>(records_read), compactions);
+        if (compactions > 0)
+            std::fprintf(out, " (last %llu -> %llu bytes)", static_cast<unsigned long long>(bytes_before), static_cast<unsigned long long>(bytes_after));
+        std::fprintf(out, "\n");
+    }
+};
+
+/*
+A match history on disk. Lifetime totals are loaded from the mapped file
+on a thread of its own, which goes on to compact the log if it has grown,
+and the game over screen asks for them with lifetime_totals(), which
+never waits. Appending takes the lock briefly; the expensive part of a
+compaction, writing the new file, runs without it.
+*/
+class MatchHistory {
+    using clock = std::chrono::steady_clock;
+
+    std::string path;
+    int fd;
+    mutable std::mutex mutex; // fd, log, lifetime & stats
+    HistoryScan log;          // this process' view of the file as of its last load or append
+    std::size_t known_size;   // the file's size then, a different size means another process wrote to it
+    MatchTotals lifetime;
+    bool loaded;
+    std::atomic<bool> stopping;
+    std::atomic<bool> worker_done;
+    std::thread worker; // loads the totals, then compacts
+    HistoryStats stats;
+
+    struct FileLock {
+        int fd;
+        explicit FileLock(int const locked_fd) : fd(locked_fd) {}
+        FileLock(const FileLock&) = delete;
+        FileLock& operator=(const FileLock&) = delete;
+        ~FileLock() {
+            ::flock(fd, LOCK_UN);
+        }
+    };
+
+    static ino_t inode_of(int const file) {
+        struct stat info;
+        return ::fstat(file, &info) == 0 ? info.st_ino : 0;
+    }
+
+    void open_file() {
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0)
+            throw runtime_error("could not open match history " + path);
+    }
+
+    // locks the file the path names now, reopening it if a compaction replaced the one we had open. mutex held
+    void lock_file(int const operation) {
+        for (;;) {
+            while (::flock(fd, operation) != 0) {
+                if (errno != EINTR)
+                    throw runtime_error("could not lock match history " + path);
+            }
+            struct stat named;
+            if (::stat(path.c_str(), &named) == 0 && named.st_ino == inode_of(fd))
+                return;
+            ::flock(fd, LOCK_UN);
+            ::close(fd);
+            open_file();
+            known_size = static_cast<std::size_t>(-1); // a new file, read it again
+        }
+    }
+
+    // mutex and file lock held
+    void load_locked() {
+        const auto start = clock::now();
+        const MappedFile file(path);
+        log = scan_history(file.begin(), file.size());
+        known_size = file.size();
+        lifetime = log.totals;
+        loaded = true;
+        stats.load_time.record(clock::now() - start);
+        stats.segments = log.segments;
+        stats.records_read = log.records_read;
+    }
+
+    void write_at(void const* data, std::size_t const bytes, std::size_t const offset) {
+        if (::pwrite(fd, data, bytes, static_cast<off_t>(offset)) != static_cast<ssize_t>(bytes))
+            throw runtime_error("could not write match history " + path);
+    }
+
+    static HistorySegment segment_header(std::uint32_t const flags) {
+        HistorySegment header{};
+        std::memcpy(header.magic, HISTORY_MAGIC, sizeof(header.magic));
+        header.version = HISTORY_VERSION;
+        header.header_size = sizeof(HistorySegment);
+        header.flags = flags;
+        return header;
+    }
+
+    // seals the full open segment, if there is one, and starts the next. mutex and file lock held
+    void start_segment() {
+        if (log.open_segment) {
+            HistorySegment sealed = segment_header(SEGMENT_SEALED);
+            sealed.record_count = log.tail_records;
+            sealed.segment_size = log.valid_size - log.tail_offset;
+            sealed.totals = log.tail_totals;
+            write_at(&sealed, sizeof(sealed), log.tail_offset);
+            ++log.sealed;
+        }
+        const HistorySegment header = segment_header(0);
+        write_at(&header, sizeof(header), log.valid_size);
+        log.open_segment = true;
+        log.tail_offset = log.valid_size;
+        log.tail_records = 0;
+        log.tail_totals = MatchTotals{};
+        log.valid_size += sizeof(header);
+        ++log.segments;
+    }
+
+    void run_worker() {
+        try {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!loaded) {
+                    lock_file(LOCK_SH);
+                    FileLock file_lock(fd);
+                    load_locked();
+                }
+            }
+            if (!stopping.load())
+                compact();
+        } catch (const std::exception&) {
+            // the history is a nicety, a game is never stopped for it: no totals on screen and no compaction
+        }
+        worker_done.store(true);
+    }
+
+    /*
+    Rewrites the log as one compacted header holding the totals of
+    everything before the newest HISTORY_KEEP_SEGMENTS sealed segments,
+    followed by those segments and the open one. Sealed segments never
+    change, so they are copied from a mapping without any lock; only the
+    open segment, which may have grown meanwhile, is copied under the
+    lock, just before the new file is renamed over the old one.
+    */
+    void compact() {
+        std::unique_ptr<MappedFile> file;
+        ino_t inode;
+        std::size_t cut = 0, copy_end = 0;
+        HistorySegment folded = segment_header(SEGMENT_SEALED | SEGMENT_COMPACTED);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (log.sealed < HISTORY_COMPACT_AT)
+                return;
+            lock_file(LOCK_SH);
+            FileLock file_lock(fd);
+            inode = inode_of(fd);
+            file = std::make_unique<MappedFile>(path);
+            const HistoryScan scan = scan_history(file->begin(), file->size());
+            if (scan.sealed < HISTORY_COMPACT_AT)
+                return;
+            // fold the segments until only HISTORY_KEEP_SEGMENTS sealed ones with records are left
+            std::size_t to_fold = scan.sealed - HISTORY_KEEP_SEGMENTS;
+            while (cut < file->size()) {
+                HistorySegment header;
+                std::memcpy(&header, file->begin() + cut, sizeof(header));
+                if (!(header.flags & SEGMENT_SEALED))
+                    break;
+                if (!(header.flags & SEGMENT_COMPACTED)) {
+                    if (to_fold == 0)
+                        break;
+                    --to_fold;
+                }
+                folded.totals.add(header.totals);
+                cut += header.segment_size;
+            }
+            folded.segment_size = sizeof(HistorySegment);
+            copy_end = scan.open_segment ? scan.tail_offset : scan.valid_size;
+        }
+
+        // the new file is written aside and only renamed over the log once it is complete
+        struct TempFile {
+            std::string path;
+            int fd;
+            bool kept = false;
+            ~TempFile() {
+                if (fd >= 0)
+                    ::close(fd);
+                if (!kept)
+                    ::unlink(path.c_str());
+            }
+            bool write_all(std::uint8_t const* data, std::size_t bytes) const {
+                while (bytes > 0) {
+                    const ssize_t written = ::write(fd, data, bytes);
+                    if (written <= 0)
+                        return false;
+                    data += written;
+                    bytes -= static_cast<std::size_t>(written);
+                }
+                return true;
+            }
+        } temp{ path + ".compact.XXXXXX", -1, true };
+        // a name of its own, processes sharing the log may be compacting it at the same time
+        temp.fd = ::mkostemp(&temp.path[0], O_CLOEXEC);
+        if (temp.fd < 0)
+            return;
+        temp.kept = false;
+        ::fchmod(temp.fd, 0644);
+        if ( !temp.write_all(reinterpret_cast<std::uint8_t const*>(&folded), sizeof(folded)) ||
+            !temp.write_all(file->begin() + cut, copy_end - cut) || stopping.load())
+            return;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        lock_file(LOCK_EX);
+        FileLock file_lock(fd);
+        if (inode_of(fd) != inode)
+            return; // another process compacted it meanwhile
+        // the open segment as it is now, at most HISTORY_SEGMENT_MATCHES records
+        const MappedFile now(path);
+        const HistoryScan scan = scan_history(now.begin(), now.size());
+        if (scan.valid_size < copy_end || !temp.write_all(now.begin() + copy_end, scan.valid_size - copy_end) ||
+            ::fsync(temp.fd) != 0 || ::rename(temp.path.c_str(), path.c_str()) != 0)
+            return;
+        temp.kept = true;
+        // other writers waiting for the old file find it renamed away once this lock is released, and reopen
+        const int old_fd = fd;
+        open_file();
+        file_lock.fd = fd;
+        ::flock(old_fd, LOCK_UN);
+        ::close(old_fd);
+        const MappedFile compacted(path);
+        log = scan_history(compacted.begin(), compacted.size());
+        known_size = compacted.size();
+        stats.bytes_before = now.size();
+        stats.bytes_after = compacted.size();
+        ++stats.compactions;
+    }
+
+public:
+    explicit MatchHistory(std::string const& history_path) :
+        path(history_path),
+        fd(-1),
+        log{},
+        known_size(static_cast<std::size_t>(-1)),
+        lifetime{},
+        loaded(false),
+        stopping(false),
+        worker_done(false)
+    {
+        open_file();
+        worker = std::thread([this] { run_worker(); });
+    }
+
+    MatchHistory(const MatchHistory&) = delete;
+    MatchHistory& operator=(const MatchHistory&) = delete;
+
+    ~MatchHistory() {
+        stopping.store(true);
+        worker.join();
+        ::close(fd);
+    }
+
+    // logs a finished match, throws if the file can't be written
+    void append(MatchSummary const& match) {
+        const auto start = clock::now();
+        std::array<std::uint8_t, MAX_HISTORY_RECORD> buffer;
+        HistoryRecord record{};
+        record.player_count = static_cast<std::uint8_t>(match.player_count);
+        record.winner = static_cast<std::int8_t>(match.winner);
+        record.ticks = match.ticks;
+        record.collision_count = static_cast<std::uint16_t>(match.collision_count);
+        record.record_size = static_cast<std::uint16_t>(sizeof(HistoryRecord) + match.player_count * sizeof(std::uint32_t) + match.collision_count * 2 * sizeof(std::int32_t));
+        std::uint8_t* out = buffer.data();
+        std::memcpy(out, &record, sizeof(record));
+        out += sizeof(record);
+        std::memcpy(out, match.lengths.data(), match.player_count * sizeof(std::uint32_t));
+        out += match.player_count * sizeof(std::uint32_t);
+        for (std::size_t i = 0; i < match.collision_count; ++i) {
+            const std::int32_t cell[2] = { match.collisions[i].x, match.collisions[i].y };
+            std::memcpy(out, cell, sizeof(cell));
+            out += sizeof(cell);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        lock_file(LOCK_EX);
+        FileLock file_lock(fd);
+        struct stat info;
+        if (::fstat(fd, &info) != 0)
+            throw runtime_error("could not stat match history " + path);
+        if (static_cast<std::size_t>(info.st_size) != known_size)
+            load_locked(); // first append, or someone else appended: catch up, it only reads the open segment
+        if (static_cast<std::size_t>(info.st_size) > log.valid_size && ::ftruncate(fd, static_cast<off_t>(log.valid_size)) != 0)
+            throw runtime_error("could not repair match history " + path);
+        if (!log.open_segment || log.tail_records >= HISTORY_SEGMENT_MATCHES)
+            start_segment();
+        write_at(buffer.data(), record.record_size, log.valid_size);
+        log.valid_size += record.record_size;
+        ++log.tail_records;
+        log.tail_totals.add(match.winner, match.ticks);
+        log.totals.add(match.winner, match.ticks);
+        lifetime.add(match.winner, match.ticks);
+        known_size = log.valid_size;
+        stats.append_time.record(clock::now() - start);
+
+        // the log has grown enough to be compacted again and the last worker is done
+        if (log.sealed >= HISTORY_COMPACT_AT && worker_done.load()) {
+            worker.join();
+            worker_done.store(false);
+            worker = std::thread([this] { run_worker(); });
+        }
+    }
+
+    // the lifetime totals if they are loaded and nobody holds the lock right now, never waits
+    bool lifetime_totals(MatchTotals& totals) const {
+        std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+        if (!lock.owns_lock() || !loaded)
+            return false;
+        totals = lifetime;
+        return true;
+    }
+
+    // the lifetime totals, loading them here if the worker hasn't yet
+    MatchTotals wait_for_totals() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!loaded) {
+            lock_file(LOCK_SH);
+            FileLock file_lock(fd);
+            load_locked();
+        }
+        return lifetime;
+    }
+
+    // lets the compaction running now, if any, finish
+    void wait_for_worker() {
+        while (!worker_done.load())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    HistoryStats get_stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+    std::string const& get_path() const {
+        return path;
+    }
+};
+}
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef INPUT_QUEUE_H
+#define INPUT_QUEUE_H
+
+#include "core.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+
+namespace snake {
+
+struct KeyEvent {
+    int ch; // as returned by wgetch
+    std::chrono::steady_clock::time_point time; // when the key was read
+};
+
+/*
+Lock free single producer / single consumer queue. One thread may call
+try_push and one (other) thread may call try_pop, nothing else is shared.
+Capacity must be a power of two; one slot is never used so a full queue
+can be told apart from an empty one.
+*/
+template <typename T, std::size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+    std::array<T, Capacity> slots;
+    alignas(64) std::atomic<std::size_t> read_pos;  // written by the consumer only
+    alignas(64) std::atomic<std::size_t> write_pos; // written by the producer only
+
+public:
+    SpscQueue() : read_pos(0), write_pos(0) {}
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // producer side, returns false (dropping the value) if the queue is full
+    bool try_push(T const& value) {
+        const std::size_t write = write_pos.load(std::memory_order_relaxed);
+        const std::size_t next = (write + 1) & (Capacity - 1);
+        if (next == read_pos.load(std::memory_order_acquire))
+            return false;
+        slots[write] = value;
+        write_pos.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // consumer side, returns false if there is nothing to read
+    bool try_pop(T& value) {
+        const std::size_t read = read_pos.load(std::memory_order_relaxed);
+        if (read == write_pos.load(std::memory_order_acquire))
+            return false;
+        value = slots[read];
+        read_pos.store((read + 1) & (Capacity - 1), std::memory_order_release);
+        return true;
+    }
+
+    // consumer side
+    void clear() {
+        read_pos.store(write_pos.load(std::memory_order_acquire), std::memory_order_release);
+    }
+};
+
+/*
+Turns a player has typed but that have not been applied yet. The game loop
+applies at most one per tick, so a quick double tap (e.g. up then left
+within one tick) becomes two consecutive turns instead of the first one
+being overwritten. Turns that would not change anything (same direction
+twice, or reversing into the snake) are dropped when they are typed.
+*/
+class TurnBuffer {
+public:
+    struct Turn {
+        Direction dir;
+        std::chrono::steady_clock::time_point typed; // for key to screen latency
+    };
+
+private:
+    static constexpr std::size_t CAPACITY = 4; // more than this in one tick is mashing, not steering
+    std::array<Turn, CAPACITY> turns;
+    std::size_t first, count;
+
+public:
+    TurnBuffer() : turns{}, first(0), count(0) {}
+
+    // current_dir is the direction the snake is moving in right now
+    void push(Turn const& turn, Direction const current_dir) {
+        const Direction last = count == 0 ? current_dir : turns[(first + count - 1) % CAPACITY].dir;
+        if (turn.dir == Direction::None || turn.dir == last || turn.dir == get_opposite(last) || count == CAPACITY)
+            return;
+        turns[(first + count) % CAPACITY] = turn;
+        ++count;
+    }
+
+    bool pop(Turn& turn) {
+        if (count == 0)
+            return false;
+        turn = turns[first];
+        first = (first + 1) % CAPACITY;
+        --count;
+        return true;
+    }
+
+    void clear() {
+        first = 0;
+        count = 0;
+    }
+};
+}
+
+#endif
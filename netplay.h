@@ -0,0 +1,615 @@
+#ifndef NETPLAY_H
+#define NETPLAY_H
+
+#include "simulation.h"
+#include "stats.h"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <memory>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdexcept>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+using std::runtime_error;
+using std::vector;
+
+namespace snake {
+
+enum class NetMessageType : std::uint8_t {
+    Input = 1,  // a player's command for one tick, sent for every tick even if it is Direction::None
+    Restart = 2 // the sender is ready for the next match
+};
+
+struct NetMessage {
+    std::uint32_t tick;
+    NetMessageType type;
+    std::uint8_t dir;
+    std::uint16_t reserved;
+};
+
+// sent by the host as soon as a peer connects, the peer plays on the host's board
+struct NetHello {
+    char magic[4];
+    std::uint16_t version;
+    std::uint16_t width, height;
+    std::uint16_t tick_rate;
+};
+
+inline constexpr char NET_MAGIC[4] = { 'S', 'N', 'K', 'N' };
+inline constexpr std::uint16_t NET_VERSION = 1;
+
+/*
+In-process stand-in for a socket, used to test rollback without a network.
+Messages arrive in order, each one between min_delay and max_delay ticks
+after it was sent. Both ends are expected to call tick() once per game tick.
+*/
+class LoopbackTransport {
+    struct Pending {
+        std::uint64_t deliver_at;
+        NetMessage message;
+    };
+    using Channel = std::deque<Pending>;
+
+    std::shared_ptr<Channel> outgoing, incoming;
+    unsigned min_delay, max_delay;
+    std::uint64_t now, last_delivery, rng;
+
+    LoopbackTransport(std::shared_ptr<Channel> out, std::shared_ptr<Channel> in, unsigned min_ticks, unsigned max_ticks, std::uint64_t seed) :
+        outgoing(std::move(out)), incoming(std::move(in)),
+        min_delay(min_ticks), max_delay(std::max(min_ticks, max_ticks)),
+        now(0), last_delivery(0), rng(seed | 1)
+    {}
+
+    unsigned next_delay() {
+        // xorshift64, jitter only needs to be cheap and repeatable
+        rng ^= rng << 13;
+        rng ^= rng >> 7;
+        rng ^= rng << 17;
+        return min_delay + static_cast<unsigned>(rng % (max_delay - min_delay + 1));
+    }
+
+public:
+    static std::pair<LoopbackTransport, LoopbackTransport> make_pair(unsigned const min_ticks, unsigned const max_ticks, std::uint64_t const seed = 1) {
+        auto a_to_b = std::make_shared<Channel>();
+        auto b_to_a = std::make_shared<Channel>();
+        return {
+            LoopbackTransport(a_to_b, b_to_a, min_ticks, max_ticks, seed),
+            LoopbackTransport(b_to_a, a_to_b, min_ticks, max_ticks, seed * 31 + 7)
+        };
+    }
+
+    void tick() {
+        ++now;
+    }
+
+    void send(NetMessage const& message) {
+        // a stream never reorders, so a message can't overtake the one before it
+        last_delivery = std::max(last_delivery, now + next_delay());
+        outgoing->push_back({ last_delivery, message });
+    }
+
+    bool receive(NetMessage& message) {
+        if (incoming->empty() || incoming->front().deliver_at > now)
+            return false;
+        message = incoming->front().message;
+        incoming->pop_front();
+        return true;
+    }
+};
+
+/*
+A connected TCP or Unix stream socket. Addresses containing a '/' are Unix
+socket paths, anything else is [host:]port. receive() never blocks; send()
+and the handshake do, but messages are 8 bytes so that is only ever for as
+long as the kernel's socket buffer is full. A server, which can't have one
+peer that stops reading hold up a thread, calls limit_sends() instead:
+what the kernel won't take is kept in a small outbound buffer, and a peer
+that lets it overflow or stay unwritable for too long is disconnected.
+*/
+class SocketTransport {
+    using clock = std::chrono::steady_clock;
+
+    int fd;
+    std::array<std::uint8_t, 4096> buffer;
+    std::size_t buffer_begin, buffer_end;
+    // limit_sends(): bytes the kernel wouldn't take yet, empty = sends block
+    vector<std::uint8_t> outbound;
+    std::size_t outbound_size;
+    clock::duration send_timeout;
+    clock::time_point unwritable_since; // the first send the kernel refused, epoch while nothing is pending
+
+    static bool is_unix_address(std::string const& address) {
+        return address.find('/') != std::string::npos;
+    }
+
+    static sockaddr_un unix_address(std::string const& path) {
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(addr.sun_path))
+            throw runtime_error("socket path too long: " + path);
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        return addr;
+    }
+
+    // [host:]port, the host defaults to any address when listening and localhost when connecting
+    static addrinfo* resolve(std::string const& address, bool const passive) {
+        const std::size_t colon = address.rfind(':');
+        const std::string host = colon == std::string::npos ? "" : address.substr(0, colon);
+        const std::string port = colon == std::string::npos ? address : address.substr(colon + 1);
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = passive ? AI_PASSIVE : 0;
+        addrinfo* result = nullptr;
+        if (::getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &result) != 0)
+            throw runtime_error("could not resolve " + address);
+        return result;
+    }
+
+    void wait_for(short const events) {
+        pollfd waiting{ fd, events, 0 };
+        if (::poll(&waiting, 1, -1) < 0 && errno != EINTR)
+            throw runtime_error("poll failed on the connection");
+    }
+
+    // sends what it can of the outbound buffer without blocking, throws if the peer has stopped reading
+    void flush_outbound() {
+        std::size_t sent = 0;
+        while (sent < outbound_size) {
+            const ssize_t written = ::send(fd, outbound.data() + sent, outbound_size - sent, MSG_NOSIGNAL);
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    break;
+                throw runtime_error("opponent disconnected");
+            }
+            sent += static_cast<std::size_t>(written);
+        }
+        std::memmove(outbound.data(), outbound.data() + sent, outbound_size - sent);
+        outbound_size -= sent;
+        if (outbound_size == 0)
+            unwritable_since = clock::time_point();
+        else if (unwritable_since == clock::time_point())
+            unwritable_since = clock::now();
+        else if (clock::now() - unwritable_since > send_timeout)
+            throw runtime_error("opponent stopped reading");
+    }
+
+    void write_all(void const* data, std::size_t size) {
+        auto bytes = static_cast<std::uint8_t const*>(data);
+        if (!outbound.empty()) {
+            if (outbound.size() - outbound_size < size)
+                throw runtime_error("opponent stopped reading");
+            std::memcpy(outbound.data() + outbound_size, bytes, size);
+            outbound_size += size;
+            flush_outbound();
+            return;
+        }
+        while (size > 0) {
+            const ssize_t written = ::send(fd, bytes, size, MSG_NOSIGNAL);
+            if (written < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    wait_for(POLLOUT);
+                    continue;
+                }
+                if (errno == EINTR)
+                    continue;
+                throw runtime_error("opponent disconnected");
+            }
+            bytes += written;
+            size -= static_cast<std::size_t>(written);
+        }
+    }
+
+    // tops the buffer up with whatever has arrived, returns false if nothing had
+    bool fill_buffer() {
+        if (buffer_begin > 0) {
+            std::memmove(buffer.data(), buffer.data() + buffer_begin, buffer_end - buffer_begin);
+            buffer_end -= buffer_begin;
+            buffer_begin = 0;
+        }
+        const ssize_t got = ::recv(fd, buffer.data() + buffer_end, buffer.size() - buffer_end, 0);
+        if (got == 0)
+            throw runtime_error("opponent disconnected");
+        if (got < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                return false;
+            throw runtime_error("opponent disconnected");
+        }
+        buffer_end += static_cast<std::size_t>(got);
+        return true;
+    }
+
+    void read_all(void* data, std::size_t const size) {
+        while (buffer_end - buffer_begin < size) {
+            if (!fill_buffer())
+                wait_for(POLLIN);
+        }
+        std::memcpy(data, buffer.data() + buffer_begin, size);
+        buffer_begin += size;
+    }
+
+public:
+    explicit SocketTransport(int const connected_fd) :
+        fd(connected_fd), buffer_begin(0), buffer_end(0), outbound_size(0), send_timeout(0)
+    {
+        int on = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on)); // fails harmlessly on Unix sockets
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+
+    SocketTransport(SocketTransport&& other) noexcept :
+        fd(other.fd), buffer(other.buffer), buffer_begin(other.buffer_begin), buffer_end(other.buffer_end),
+        outbound(std::move(other.outbound)), outbound_size(other.outbound_size), send_timeout(other.send_timeout),
+        unwritable_since(other.unwritable_since)
+    {
+        other.fd = -1;
+    }
+
+    SocketTransport(const SocketTransport&) = delete;
+    SocketTransport& operator=(const SocketTransport&) = delete;
+    SocketTransport& operator=(SocketTransport&&) = delete;
+
+    ~SocketTransport() {
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+    // a listening socket on address, accepting up to backlog connections before they are accept()ed
+    static int open_listener(std::string const& address, int const backlog) {
+        int server = -1;
+        if (is_unix_address(address)) {
+            const sockaddr_un addr = unix_address(address);
+            ::unlink(address.c_str()); // left behind by an earlier game
+            server = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (server < 0 || ::bind(server, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr)) != 0) {
+                if (server >= 0)
+                    ::close(server);
+                throw runtime_error("could not listen on " + address);
+            }
+        } else {
+            addrinfo* info = resolve(address, true);
+            for (addrinfo* it = info; it != nullptr && server < 0; it = it->ai_next) {
+                server = ::socket(it->ai_family, it->ai_socktype, it->ai_protocol);
+                if (server < 0)
+                    continue;
+                int on = 1;
+                ::setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+                if (::bind(server, it->ai_addr, it->ai_addrlen) != 0) {
+                    ::close(server);
+                    server = -1;
+                }
+            }
+            ::freeaddrinfo(info);
+            if (server < 0)
+                throw runtime_error("could not listen on " + address);
+        }
+        if (::listen(server, backlog) != 0) {
+            ::close(server);
+            throw runtime_error("could not listen on " + address);
+        }
+        return server;
+    }
+
+    // blocks until one peer connects
+    static SocketTransport listen(std::string const& address) {
+        const int server = open_listener(address, 1);
+        const int peer = ::accept(server, nullptr, nullptr);
+        ::close(server); // one opponent per game
+        if (is_unix_address(address))
+            ::unlink(address.c_str());
+        if (peer < 0)
+            throw runtime_error("could not accept a connection on " + address);
+        return SocketTransport(peer);
+    }
+
+    static SocketTransport connect(std::string const& address) {
+        int peer = -1;
+        if (is_unix_address(address)) {
+            const sockaddr_un addr = unix_address(address);
+            peer = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (peer >= 0 && ::connect(peer, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr)) != 0) {
+                ::close(peer);
+                peer = -1;
+            }
+        } else {
+            addrinfo* info = resolve(address.find(':') == std::string::npos ? "localhost:" + address : address, false);
+            for (addrinfo* it = info; it != nullptr && peer < 0; it = it->ai_next) {
+                peer = ::socket(it->ai_family, it->ai_socktype, it->ai_protocol);
+                if (peer >= 0 && ::connect(peer, it->ai_addr, it->ai_addrlen) != 0) {
+                    ::close(peer);
+                    peer = -1;
+                }
+            }
+            ::freeaddrinfo(info);
+        }
+        if (peer < 0)
+            throw runtime_error("could not connect to " + address);
+        return SocketTransport(peer);
+    }
+
+    // sends never block from now on: up to buffer_bytes the kernel won't take are kept, and the peer is treated as
+    // disconnected if that overflows or some of it can't be sent for longer than timeout
+    void limit_sends(std::size_t const buffer_bytes, clock::duration const timeout) {
+        outbound.assign(std::max(buffer_bytes, sizeof(NetHello)), 0);
+        outbound_size = 0;
+        send_timeout = timeout;
+    }
+
+    void send_hello(NetHello const& hello) {
+        write_all(&hello, sizeof(hello));
+    }
+
+    NetHello receive_hello() {
+        NetHello hello;
+        read_all(&hello, sizeof(hello));
+        if (std::memcmp(hello.magic, NET_MAGIC, sizeof(hello.magic)) != 0 || hello.version != NET_VERSION)
+            throw runtime_error("the other side is not a compatible snake game");
+        return hello;
+    }
+
+    void send(NetMessage const& message) {
+        write_all(&message, sizeof(message));
+    }
+
+    bool receive(NetMessage& message) {
+        if (outbound_size > 0)
+            flush_outbound(); // a peer that sends but never reads is found out even while nothing new is sent
+        if (buffer_end - buffer_begin < sizeof(message) && !fill_buffer())
+            return false;
+        if (buffer_end - buffer_begin < sizeof(message))
+            return false;
+        std::memcpy(&message, buffer.data() + buffer_begin, sizeof(message));
+        buffer_begin += sizeof(message);
+        return true;
+    }
+};
+
+struct RollbackStats {
+    unsigned long ticks = 0;             // ticks stepped for the first time
+    unsigned long stalls = 0;            // ticks not stepped because the peer was too far behind
+    unsigned long rollbacks = 0;
+    unsigned long resimulated_ticks = 0;
+    std::uint32_t max_depth = 0;         // most ticks re-simulated by one rollback
+    LatencyHistogram save_time;          // snapshot taken before every tick
+    LatencyHistogram rollback_time;      // restore + re-simulate, per rollback
+    LatencyHistogram resimulated_tick_time; // rollback_time / depth, per rollback
+
+    void print(FILE* out) const {
+        fprintf(out, "rollback     ticks %lu  stalls %lu  rollbacks %lu  resimulated ticks %lu  max depth %u\n",
+            ticks, stalls, rollbacks, resimulated_ticks, max_depth);
+        save_time.print(out, "snapshot save");
+        rollback_time.print(out, "rollback");
+        resimulated_tick_time.print(out, "rollback per tick");
+    }
+};
+
+/*
+Rollback netplay for one side of a two player match. The local command is
+simulated the tick it is typed, with no added delay; the remote command for
+ticks it has not arrived for yet is predicted to be Direction::None (snakes
+mostly go straight). When a remote command turns out to differ from the
+prediction, the simulation is restored from the snapshot taken before that
+tick and the ticks since are re-simulated with the real commands.
+
+Snapshots are Simulation::save_snapshot() images: flat bytes with no
+pointers, so keeping one per tick is a memcpy-sized copy into a buffer
+reserved up front, never an allocation. A side may run at most MAX_ROLLBACK
+ticks ahead of the last remote command it has; beyond that it stalls until
+the peer catches up.
+*/
+template <typename Transport>
+class RollbackSession {
+public:
+    static constexpr std::uint32_t MAX_ROLLBACK = 8;
+
+private:
+    static constexpr std::uint32_t HISTORY = 32; // power of two, more than the 2 * MAX_ROLLBACK + 1 ticks that can be in flight
+    static constexpr std::uint32_t NO_ROLLBACK = UINT32_MAX;
+
+    struct TickCommands {
+        std::uint32_t tick;
+        Direction commands[2]; // by player index, predictions until remote_known
+        bool remote_known;
+    };
+
+    Simulation& simulation;
+    Transport& transport;
+    int local_index, remote_index; // 0 = green, 1 = blue
+    std::array<TickCommands, HISTORY> history;
+    std::array<vector<std::uint8_t>, MAX_ROLLBACK + 1> snapshots; // state before tick t, at t % (MAX_ROLLBACK + 1)
+    std::uint32_t confirmed; // the remote command is known for every tick before this one
+    std::uint32_t committed; // the local command has been sent for every tick before this one
+    std::uint32_t reported;  // next tick pop_confirmed() hands out
+    std::uint32_t rollback_from;
+    bool restart_sent, peer_restarted;
+    bool trusted_peer; // false: a message that can't come from a well behaved peer ends the session
+    RollbackStats stats;
+
+    TickCommands& commands_for(std::uint32_t const tick) {
+        TickCommands& slot = history[tick & (HISTORY - 1)];
+        if (slot.tick != tick)
+            slot = { tick, { Direction::None, Direction::None }, false };
+        return slot;
+    }
+
+    void save_snapshot(std::uint32_t const tick) {
+        vector<std::uint8_t>& snapshot = snapshots[tick % snapshots.size()];
+        snapshot.clear();
+        simulation.save_snapshot(snapshot);
+    }
+
+    void simulate(std::uint32_t const tick) {
+        TickCommands& tick_commands = commands_for(tick);
+        simulation.step(tick_commands.commands[0], tick_commands.commands[1]);
+    }
+
+    void roll_back() {
+        const auto start = std::chrono::steady_clock::now();
+        // the present is the last tick we sent a command for, which is further on than the simulation
+        // if a misprediction had ended the match early
+        const std::uint32_t present = committed;
+        simulation.load_snapshot(snapshots[rollback_from % snapshots.size()].data());
+        std::uint32_t depth = 0;
+        while (simulation.get_frame_count() < present && !simulation.is_over()) {
+            const std::uint32_t tick = static_cast<std::uint32_t>(simulation.get_frame_count());
+            save_snapshot(tick);
+            simulate(tick);
+            ++depth;
+        }
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        ++stats.rollbacks;
+        stats.resimulated_ticks += depth;
+        stats.max_depth = std::max(stats.max_depth, depth);
+        stats.rollback_time.record(elapsed);
+        if (depth > 0)
+            stats.resimulated_tick_time.record(elapsed / depth);
+        rollback_from = NO_ROLLBACK;
+    }
+
+public:
+    // a server passes trusted = false for peers it doesn't control, see poll()
+    RollbackSession(Simulation& sim, Transport& link, int const local_player, bool const trusted = true) :
+        simulation(sim),
+        transport(link),
+        local_index(local_player == PLAYER1 ? 0 : 1),
+        remote_index(local_player == PLAYER1 ? 1 : 0),
+        restart_sent(false),
+        peer_restarted(false),
+        trusted_peer(trusted)
+    {
+        reset();
+    }
+
+    // call after simulation.reset() for the next match
+    void reset() {
+        for (std::uint32_t i = 0; i < HISTORY; ++i)
+            history[i] = { i + 1, { Direction::None, Direction::None }, false }; // tags that no tick below HISTORY maps to
+        const std::size_t snapshot_size = sizeof(std::uint32_t) + 2 * (12 + 4 * body_capacity(simulation.get_width(), simulation.get_height()));
+        for (vector<std::uint8_t>& snapshot : snapshots)
+            snapshot.reserve(snapshot_size);
+        confirmed = 0;
+        committed = 0;
+        reported = 0;
+        rollback_from = NO_ROLLBACK;
+        restart_sent = false;
+        peer_restarted = false;
+    }
+
+    // reads everything the peer has sent and, if a prediction was wrong, rolls back and re-simulates up to the present.
+    // From an untrusted peer, a message for any tick but the next one, or one outside the rollback window (whose
+    // snapshot is gone, or so far ahead that it would skip the stall and settle the match early), throws
+    void poll() {
+        NetMessage message;
+        while (transport.receive(message)) {
+            if (message.type == NetMessageType::Restart) {
+                peer_restarted = true;
+                break; // anything after it belongs to the next match
+            }
+            if (!trusted_peer) {
+                const std::uint64_t frame = simulation.get_frame_count();
+                if (message.type != NetMessageType::Input || message.dir > static_cast<std::uint8_t>(Direction::Right) ||
+                    message.tick != confirmed || std::uint64_t(message.tick) + MAX_ROLLBACK < frame ||
+                    std::uint64_t(message.tick) > std::uint64_t(committed) + MAX_ROLLBACK)
+                    throw runtime_error("opponent sent an invalid message");
+            }
+            const Direction actual = static_cast<Direction>(message.dir);
+            TickCommands& tick_commands = commands_for(message.tick);
+            if (message.tick < simulation.get_frame_count() && tick_commands.commands[remote_index] != actual)
+                rollback_from = std::min(rollback_from, message.tick);
+            tick_commands.commands[remote_index] = actual;
+            tick_commands.remote_known = true;
+            confirmed = message.tick + 1; // a stream delivers ticks in order
+        }
+        if (rollback_from != NO_ROLLBACK)
+            roll_back();
+    }
+
+    // false once the game is over (maybe only as predicted) or while too far ahead of the peer
+    bool can_step() {
+        if (simulation.is_over())
+            return false;
+        if (simulation.get_frame_count() >= confirmed + MAX_ROLLBACK) {
+            ++stats.stalls;
+            return false;
+        }
+        return true;
+    }
+
+    // simulates the next tick with the local command, only if can_step()
+    void step(Direction const local_cmd) {
+        const std::uint32_t tick = static_cast<std::uint32_t>(simulation.get_frame_count());
+        TickCommands& tick_commands = commands_for(tick);
+        tick_commands.commands[local_index] = local_cmd;
+        transport.send({ tick, NetMessageType::Input, static_cast<std::uint8_t>(local_cmd), 0 });
+        committed = tick + 1;
+
+        const auto start = std::chrono::steady_clock::now();
+        save_snapshot(tick);
+        stats.save_time.record(std::chrono::steady_clock::now() - start);
+        simulate(tick);
+        ++stats.ticks;
+    }
+
+    // the winner once every command up to the end of the match is known, until then NO_WINNER
+    int confirmed_winner() const {
+        if (!simulation.is_over() || confirmed < simulation.get_frame_count())
+            return NO_WINNER;
+        return simulation.get_winner();
+    }
+
+    // hands out the next tick whose commands are final, in order (for recording the match)
+    bool pop_confirmed(Direction& p1_cmd, Direction& p2_cmd) {
+        if (reported >= confirmed || reported >= simulation.get_frame_count())
+            return false;
+        TickCommands const& tick_commands = history[reported & (HISTORY - 1)];
+        p1_cmd = tick_commands.commands[0];
+        p2_cmd = tick_commands.commands[1];
+        ++reported;
+        return true;
+    }
+
+    // tells the peer we are ready for another match (once) and returns whether it is too, without waiting
+    bool try_restart() {
+        if (!restart_sent) {
+            transport.send({ 0, NetMessageType::Restart, 0, 0 });
+            restart_sent = true;
+        }
+        NetMessage message;
+        while (!peer_restarted && transport.receive(message)) {
+            if (message.type == NetMessageType::Restart)
+                peer_restarted = true; // anything else still in flight belongs to the match that just ended
+        }
+        return peer_restarted;
+    }
+
+    // tells the peer we are ready for another match and blocks until it is too
+    void restart() {
+        while (!try_restart())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    RollbackStats const& get_stats() const {
+        return stats;
+    }
+};
+}
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "stats.h"
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace snake {
+
+// the parts of a frame that are timed, nested as listed: a frame runs updates, an update reads input, runs the
+// bots and steps the simulation (which resolves collisions) and draws, then the frame is refreshed
+enum class Phase : std::uint8_t {
+    Frame, Update, Input, Bots, Step, Collide, Draw, Refresh
+};
+
+inline constexpr std::size_t PHASE_COUNT = 8;
+
+inline const char* phase_name(Phase const phase) {
+    static const char* const names[PHASE_COUNT] = { "frame", "update", "input", "bots", "step", "collide", "draw", "refresh" };
+    return names[static_cast<std::size_t>(phase)];
+}
+
+#ifdef SNAKE_PROFILING
+inline constexpr bool PROFILING = true;
+
+/*
+Built only with -DSNAKE_PROFILING (make profile). Every scoped timer adds
+its duration to its phase's histogram and appends a trace event to a
+preallocated ring of the most recent MAX_TRACE_EVENTS, which can be
+written out as Chrome trace-event JSON (chrome://tracing, Perfetto). Only
+the game loop thread records, so nothing is locked.
+*/
+class Profiler {
+    using clock = std::chrono::steady_clock;
+
+    struct TraceEvent {
+        std::uint64_t start_ns, duration_ns; // start is relative to the profiler's creation
+        Phase phase;
+    };
+
+    static constexpr std::size_t MAX_TRACE_EVENTS = std::size_t(1) << 18; // ~6 MB, half an hour at 20 ticks/s
+
+    std::array<LatencyHistogram, PHASE_COUNT> phases;
+    std::vector<TraceEvent> events;
+    std::size_t next_event;
+    bool wrapped;
+    clock::time_point epoch;
+
+    Profiler() : events(MAX_TRACE_EVENTS), next_event(0), wrapped(false), epoch(clock::now()) {}
+
+public:
+    static Profiler& instance() {
+        static Profiler single_instance;
+        return single_instance;
+    }
+
+    void record(Phase const phase, clock::time_point const start, clock::time_point const finish) {
+        const auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(finish - start);
+        phases[static_cast<std::size_t>(phase)].record(duration);
+        events[next_event] = {
+            static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(start - epoch).count()),
+            static_cast<std::uint64_t>(duration.count()),
+            phase
+        };
+        if (++next_event == events.size()) {
+            next_event = 0;
+            wrapped = true;
+        }
+    }
+
+    LatencyHistogram const& get(Phase const phase) const {
+        return phases[static_cast<std::size_t>(phase)];
+    }
+
+    void print(std::FILE* out) const {
+        for (std::size_t i = 0; i < PHASE_COUNT; ++i) {
+            if (phases[i].count() > 0)
+                phases[i].print(out, phase_name(static_cast<Phase>(i)));
+        }
+    }
+
+    // one line for the HUD, written into out (no allocation, it is drawn every frame)
+    void format_hud(char* out, std::size_t const size) const {
+        auto us = [this](Phase const phase, double const p) { return get(phase).percentile_ns(p) / 1000.0; };
+        std::snprintf(out, size, " frame p50 %.0fus p99 %.0fus | update %.0fus step %.0fus draw %.0fus refresh %.0fus (p99) ",
+            us(Phase::Frame, 50), us(Phase::Frame, 99), us(Phase::Update, 99), us(Phase::Step, 99), us(Phase::Draw, 99), us(Phase::Refresh, 99));
+    }
+
+    // the recorded events, oldest first, as Chrome trace-event JSON
+    void write_trace(std::string const& path) const {
+        std::FILE* out = std::fopen(path.c_str(), "w");
+        if (out == nullptr)
+            throw std::runtime_error("can't write trace file " + path);
+        std::fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        const std::size_t count = wrapped ? events.size() : next_event;
+        const std::size_t first = wrapped ? next_event : 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            TraceEvent const& event = events[(first + i) % events.size()];
+            std::fprintf(out, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}\n",
+                i == 0 ? "" : ",", phase_name(event.phase), event.start_ns / 1000.0, event.duration_ns / 1000.0);
+        }
+        std::fprintf(out, "]}\n");
+        if (std::fclose(out) != 0)
+            throw std::runtime_error("can't write trace file " + path);
+    }
+};
+
+// times the enclosing scope
+class ProfileScope {
+    Phase phase;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit ProfileScope(Phase const timed_phase) : phase(timed_phase), start(std::chrono::steady_clock::now()) {}
+
+    ProfileScope(ProfileScope const&) = delete;
+    ProfileScope& operator=(ProfileScope const&) = delete;
+
+    ~ProfileScope() {
+        Profiler::instance().record(phase, start, std::chrono::steady_clock::now());
+    }
+};
+
+#define SNAKE_PROFILE_JOIN2(a, b) a##b
+#define SNAKE_PROFILE_JOIN(a, b) SNAKE_PROFILE_JOIN2(a, b)
+#define SNAKE_PROFILE_SCOPE(phase) ::snake::ProfileScope SNAKE_PROFILE_JOIN(snake_profile_scope_, __LINE__)(phase)
+#else
+inline constexpr bool PROFILING = false;
+
+// compiled out: no clock reads, no code
+#define SNAKE_PROFILE_SCOPE(phase) static_cast<void>(0)
+#endif
+}
+
+#endif
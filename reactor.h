@@ -0,0 +1,125 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include "stats.h"
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+using std::runtime_error;
+
+namespace snake {
+
+struct ReactorStats {
+    unsigned long timer_wakeups = 0; // poll() returned for the tick timer
+    unsigned long input_wakeups = 0; // poll() returned for the keyboard
+    LatencyHistogram input_handling; // time spent reading & queueing keys per input wake up
+
+    void print(std::FILE* out) const {
+        std::fprintf(out, "wake ups: timer %lu, input %lu\n", timer_wakeups, input_wakeups);
+        input_handling.print(out, "input handling");
+    }
+};
+
+/*
+The game loop waits here, in poll() on the keyboard and on a timerfd
+that expires on the scheduler's start + n * period grid. Key presses are
+handed to a callback the moment they can be read, however far away the
+next tick is, and the loop carries on to the tick when the timer expires.
+The keyboard needs no thread of its own, so there is nothing to join or
+detach at shutdown.
+
+steady_clock is CLOCK_MONOTONIC on Linux, so its time points are used as
+absolute timer expiries as they are.
+*/
+class EventReactor {
+    using clock = std::chrono::steady_clock;
+
+    int input_fd;
+    int timer_fd;
+    bool input_open; // false once the keyboard hung up, it would otherwise always poll readable
+    ReactorStats stats;
+
+    static timespec to_timespec(clock::duration const duration) {
+        const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+        timespec spec;
+        spec.tv_sec = static_cast<time_t>(ns / 1000000000);
+        spec.tv_nsec = static_cast<long>(ns % 1000000000);
+        return spec;
+    }
+
+public:
+    // input -1 waits for the timer alone
+    explicit EventReactor(int const input = STDIN_FILENO) :
+        input_fd(input),
+        timer_fd(timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK)),
+        input_open(true)
+    {
+        if (timer_fd < 0)
+            throw runtime_error("can't create a timerfd");
+    }
+
+    EventReactor(const EventReactor&) = delete;
+    EventReactor& operator=(const EventReactor&) = delete;
+
+    ~EventReactor() {
+        close(timer_fd);
+    }
+
+    // the timer expires at first_deadline (straight away if it has passed) and every period after it
+    void arm(clock::time_point const first_deadline, clock::duration const period) {
+        itimerspec spec;
+        spec.it_value = to_timespec(first_deadline.time_since_epoch());
+        spec.it_interval = to_timespec(period);
+        if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, nullptr) != 0)
+            throw runtime_error("can't arm the tick timer");
+    }
+
+    void disarm() {
+        const itimerspec spec{};
+        timerfd_settime(timer_fd, 0, &spec, nullptr);
+    }
+
+    // returns once the timer has expired (one or more times), calling on_input whenever the keyboard can be read
+    template <typename OnInput>
+    void wait_for_tick(OnInput&& on_input) {
+        pollfd fds[2] = {
+            { timer_fd, POLLIN, 0 },
+            { input_open ? input_fd : -1, POLLIN, 0 }
+        };
+        for (;;) {
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR)
+                    continue; // SIGWINCH
+                throw runtime_error("poll failed");
+            }
+            // keys first: a key typed just before the tick counts for it
+            if (fds[1].revents & (POLLHUP | POLLERR | POLLNVAL)) {
+                input_open = false;
+                fds[1].fd = -1;
+            } else if (fds[1].revents & POLLIN) {
+                ++stats.input_wakeups;
+                const auto start = clock::now();
+                on_input();
+                stats.input_handling.record(clock::now() - start);
+            }
+            std::uint64_t expirations;
+            if ((fds[0].revents & POLLIN) && read(timer_fd, &expirations, sizeof(expirations)) == sizeof(expirations)) {
+                ++stats.timer_wakeups;
+                return;
+            }
+        }
+    }
+
+    ReactorStats const& get_stats() const {
+        return stats;
+    }
+};
+}
+
+#endif
@@ -0,0 +1,441 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "simulation.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+using std::runtime_error;
+using std::vector;
+
+namespace snake {
+
+/*
+Replay archive format. An archive is a file of back to back match blocks,
+each one self describing:
+
+  ReplayHeader
+  event stream    per command: varint (ticks since the previous command) then
+                  one byte (player index << 3 | direction). Ticks where nobody
+                  turned cost nothing.
+  snapshot index  snapshot_count * ReplaySnapshotEntry, sorted by tick
+  snapshots       Simulation::save_snapshot() taken before every
+                  snapshot_interval'th tick
+
+Seeking restores the closest snapshot at or before the target and
+re-simulates at most snapshot_interval ticks from there. All multi byte
+values are native endian and read with memcpy, so blocks can be used
+straight out of a memory mapped file.
+*/
+inline constexpr char REPLAY_MAGIC[4] = { 'S', 'N', 'K', 'R' };
+inline constexpr std::uint16_t REPLAY_VERSION = 1;
+inline constexpr std::uint32_t DEFAULT_SNAPSHOT_INTERVAL = 256;
+
+struct ReplayHeader {
+    char magic[4];
+    std::uint16_t version;
+    std::uint16_t header_size;
+    std::uint32_t block_size; // whole block, header included
+    std::int32_t width, height;
+    std::int32_t p1_start_x, p1_start_y;
+    std::int32_t p2_start_x, p2_start_y;
+    std::int32_t initial_length;
+    std::uint32_t tick_rate;
+    std::uint32_t snapshot_interval;
+    std::uint32_t total_ticks;
+    std::int32_t winner;
+    std::uint32_t events_offset, events_size; // from the start of the block
+    std::uint32_t index_offset, snapshot_count;
+};
+
+struct ReplaySnapshotEntry {
+    std::uint32_t tick;
+    std::uint32_t event_offset;    // first event at or after tick, relative to the event stream
+    std::uint32_t event_base_tick; // tick the delta of that event is relative to
+    std::uint32_t snapshot_offset; // from the start of the block
+};
+
+// a match's starting conditions, enough to build its Simulation from scratch
+struct ReplaySetup {
+    int width, height;
+    Coordinates player1_start, player2_start;
+    int initial_length;
+    unsigned tick_rate;
+};
+
+// a fresh Simulation in the state the recorded match started in
+inline Simulation make_replay_simulation(ReplaySetup const& setup) {
+    const std::size_t area = body_capacity(setup.width, setup.height);
+    return Simulation(setup.width, setup.height,
+        make_shared<Player>(PLAYER1, setup.player1_start, Direction::Right, 0, 0, 0, 0, setup.initial_length, area),
+        make_shared<Player>(PLAYER2, setup.player2_start, Direction::Left, 0, 0, 0, 0, setup.initial_length, area),
+        setup.tick_rate);
+}
+
+// records one match in memory, finish() turns it into a block ready to be appended to an archive
+class ReplayRecorder {
+    static constexpr std::uint32_t RESERVED_TICKS = 1 << 15; // recording a match this long never allocates
+
+    ReplaySetup setup;
+    std::uint32_t snapshot_interval;
+    vector<std::uint8_t> events, snapshots;
+    vector<ReplaySnapshotEntry> index;
+    std::uint32_t last_event_tick;
+    vector<std::uint8_t> block;
+
+    void append_varint(std::uint32_t value) {
+        while (value >= 0x80) {
+            events.push_back(static_cast<std::uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        events.push_back(static_cast<std::uint8_t>(value));
+    }
+
+    void record_command(std::uint32_t const tick, int const player_index, Direction const dir) {
+        if (dir == Direction::None)
+            return;
+        append_varint(tick - last_event_tick);
+        events.push_back(static_cast<std::uint8_t>(player_index << 3 | static_cast<int>(dir)));
+        last_event_tick = tick;
+    }
+
+    // room for RESERVED_TICKS of a command from each player every tick and snakes growing at the usual rate
+    void reserve_match() {
+        events.reserve(2 * 2 * RESERVED_TICKS); // a 1 byte delta and a command byte each
+        index.reserve(RESERVED_TICKS / snapshot_interval + 1);
+        const std::uint64_t growth_interval = 2 * std::max(setup.tick_rate, 1u);
+        const std::uint64_t area = static_cast<std::uint64_t>(setup.width) * setup.height;
+        std::size_t bytes = 0;
+        for (std::uint64_t tick = 0; tick < RESERVED_TICKS; tick += snapshot_interval) {
+            const std::uint64_t length = std::min<std::uint64_t>(setup.initial_length + tick / growth_interval + 1, area);
+            bytes += sizeof(std::uint32_t) + 2 * (10 + length * sizeof(PackedCoordinates));
+        }
+        snapshots.reserve(bytes);
+    }
+
+public:
+    explicit ReplayRecorder(std::uint32_t interval = DEFAULT_SNAPSHOT_INTERVAL) :
+        setup{},
+        snapshot_interval(interval == 0 ? 1 : interval),
+        last_event_tick(0)
+    {}
+
+    void begin(ReplaySetup const& match_setup) {
+        if (match_setup.width > MAX_PACKED_COORDINATE || match_setup.height > MAX_PACKED_COORDINATE)
+            throw runtime_error("board too large to record");
+        setup = match_setup;
+        events.clear();
+        snapshots.clear();
+        index.clear();
+        last_event_tick = 0;
+        reserve_match();
+    }
+
+    // call before simulation.step(p1_cmd, p2_cmd)
+    void record_tick(Simulation const& simulation, Direction const p1_cmd, Direction const p2_cmd) {
+        const std::uint32_t tick = static_cast<std::uint32_t>(simulation.get_frame_count());
+        if (tick % snapshot_interval == 0) {
+            index.push_back({ tick, static_cast<std::uint32_t>(events.size()), last_event_tick, static_cast<std::uint32_t>(snapshots.size()) });
+            simulation.save_snapshot(snapshots);
+        }
+        record_command(tick, 0, p1_cmd);
+        record_command(tick, 1, p2_cmd);
+    }
+
+    // the finished block, valid until the next begin()/finish()
+    vector<std::uint8_t> const& finish(std::uint32_t const total_ticks, int const winner) {
+        ReplayHeader header{};
+        std::memcpy(header.magic, REPLAY_MAGIC, sizeof(header.magic));
+        header.version = REPLAY_VERSION;
+        header.header_size = sizeof(ReplayHeader);
+        header.width = setup.width;
+        header.height = setup.height;
+        header.p1_start_x = setup.player1_start.x;
+        header.p1_start_y = setup.player1_start.y;
+        header.p2_start_x = setup.player2_start.x;
+        header.p2_start_y = setup.player2_start.y;
+        header.initial_length = setup.initial_length;
+        header.tick_rate = setup.tick_rate;
+        header.snapshot_interval = snapshot_interval;
+        header.total_ticks = total_ticks;
+        header.winner = winner;
+        header.events_offset = sizeof(ReplayHeader);
+        header.events_size = static_cast<std::uint32_t>(events.size());
+        header.index_offset = header.events_offset + header.events_size;
+        header.snapshot_count = static_cast<std::uint32_t>(index.size());
+        const std::uint32_t snapshots_offset = header.index_offset + header.snapshot_count * sizeof(ReplaySnapshotEntry);
+        header.block_size = snapshots_offset + static_cast<std::uint32_t>(snapshots.size());
+
+        block.clear();
+        append_pod(block, header);
+        block.insert(block.end(), events.begin(), events.end());
+        for (ReplaySnapshotEntry entry : index) {
+            entry.snapshot_offset += snapshots_offset;
+            append_pod(block, entry);
+        }
+        block.insert(block.end(), snapshots.begin(), snapshots.end());
+        return block;
+    }
+};
+
+// appends a finished block to an archive in a single write, O_APPEND keeps concurrent writers from interleaving
+inline void append_replay(std::string const& path, vector<std::uint8_t> const& block) {
+    const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0)
+        throw runtime_error("could not open replay archive " + path);
+    const ssize_t written = ::write(fd, block.data(), block.size());
+    ::close(fd);
+    if (written != static_cast<ssize_t>(block.size()))
+        throw runtime_error("could not write replay archive " + path);
+}
+
+// read only memory mapping of a whole file
+class MappedFile {
+    void* data;
+    std::size_t length;
+
+public:
+    explicit MappedFile(std::string const& path) : data(nullptr), length(0) {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw runtime_error("could not open " + path);
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            ::close(fd);
+            throw runtime_error("could not stat " + path);
+        }
+        length = static_cast<std::size_t>(info.st_size);
+        if (length > 0) {
+            data = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data == MAP_FAILED) {
+                ::close(fd);
+                throw runtime_error("could not map " + path);
+            }
+        }
+        ::close(fd); // the mapping stays valid
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        if (data != nullptr)
+            ::munmap(data, length);
+    }
+
+    std::uint8_t const* begin() const {
+        return static_cast<std::uint8_t const*>(data);
+    }
+
+    std::size_t size() const {
+        return length;
+    }
+};
+
+/*
+One recorded match, read in place from a mapped archive. Feeds the recorded
+commands to a Simulation tick by tick (ReplayPlayer) or jumps to any tick
+through the snapshots (seek).
+*/
+class ReplayView {
+    std::uint8_t const* block;
+    ReplayHeader header;
+
+public:
+    explicit ReplayView(std::uint8_t const* data) : block(data) {
+        std::memcpy(&header, data, sizeof(header));
+    }
+
+    ReplayHeader const& get_header() const {
+        return header;
+    }
+
+    ReplaySetup get_setup() const {
+        return {
+            header.width, header.height,
+            { header.p1_start_x, header.p1_start_y },
+            { header.p2_start_x, header.p2_start_y },
+            header.initial_length,
+            header.tick_rate
+        };
+    }
+
+    std::uint8_t const* events_begin() const {
+        return block + header.events_offset;
+    }
+
+    std::uint8_t const* events_end() const {
+        return block + header.events_offset + header.events_size;
+    }
+
+    ReplaySnapshotEntry snapshot(std::uint32_t const i) const {
+        ReplaySnapshotEntry entry;
+        std::memcpy(&entry, block + header.index_offset + i * sizeof(ReplaySnapshotEntry), sizeof(entry));
+        return entry;
+    }
+
+    std::uint8_t const* snapshot_data(ReplaySnapshotEntry const& entry) const {
+        return block + entry.snapshot_offset;
+    }
+};
+
+// every match in an archive file, read through a memory mapping without copying or parsing up front
+class ReplayArchive {
+    MappedFile file;
+
+    [[noreturn]] static void corrupt() {
+        throw runtime_error("corrupt replay archive");
+    }
+
+    // the size of the two player snapshot at offset, which must lie within the block
+    static std::uint64_t snapshot_size(std::uint8_t const* block, std::uint64_t const offset, std::uint64_t const block_size, ReplayHeader const& header) {
+        std::uint64_t at = offset + sizeof(std::uint32_t); // frame_count
+        for (int player = 0; player < 2; ++player) {
+            at += 2 * sizeof(std::uint8_t) + sizeof(std::int32_t); // directions and length
+            if (at + sizeof(std::uint32_t) > block_size)
+                corrupt();
+            std::uint32_t body_size;
+            std::memcpy(&body_size, block + at, sizeof(body_size));
+            if (body_size > static_cast<std::uint64_t>(header.width) * static_cast<std::uint64_t>(header.height))
+                corrupt();
+            at += sizeof(std::uint32_t) + static_cast<std::uint64_t>(body_size) * sizeof(PackedCoordinates);
+        }
+        if (at > block_size)
+            corrupt();
+        return at - offset;
+    }
+
+    // every offset and size in a block's header and snapshot index lies within the block
+    static void check_block(std::uint8_t const* block, ReplayHeader const& header) {
+        const std::uint64_t block_size = header.block_size;
+        if (header.width <= 0 || header.height <= 0)
+            corrupt();
+        if (header.events_offset < sizeof(ReplayHeader) || std::uint64_t(header.events_offset) + header.events_size > block_size)
+            corrupt();
+        const std::uint64_t index_end = std::uint64_t(header.index_offset) + std::uint64_t(header.snapshot_count) * sizeof(ReplaySnapshotEntry);
+        if (header.index_offset < sizeof(ReplayHeader) || index_end > block_size)
+            corrupt();
+        for (std::uint32_t i = 0; i < header.snapshot_count; ++i) {
+            ReplaySnapshotEntry entry;
+            std::memcpy(&entry, block + header.index_offset + std::uint64_t(i) * sizeof(entry), sizeof(entry));
+            if (entry.event_offset > header.events_size || entry.snapshot_offset < index_end || entry.snapshot_offset >= block_size)
+                corrupt();
+            snapshot_size(block, entry.snapshot_offset, block_size, header);
+        }
+    }
+
+public:
+    explicit ReplayArchive(std::string const& path) : file(path) {}
+
+    // calls visit(ReplayView const&) for each match in file order, returns the number of matches
+    template <typename Visitor>
+    std::size_t for_each(Visitor&& visit) const {
+        std::size_t matches = 0;
+        std::size_t offset = 0;
+        while (offset < file.size()) {
+            if (file.size() - offset < sizeof(ReplayHeader))
+                throw runtime_error("truncated replay archive");
+            const ReplayView view(file.begin() + offset);
+            ReplayHeader const& header = view.get_header();
+            if (std::memcmp(header.magic, REPLAY_MAGIC, sizeof(header.magic)) != 0 || header.version != REPLAY_VERSION)
+                throw runtime_error("not a replay archive (or unsupported version)");
+            if (header.block_size < sizeof(ReplayHeader) || header.block_size > file.size() - offset)
+                corrupt();
+            check_block(file.begin() + offset, header);
+            visit(view);
+            offset += header.block_size;
+            ++matches;
+        }
+        return matches;
+    }
+};
+
+// hands out a recorded match's commands one tick at a time
+class ReplayPlayer {
+    ReplayView view;
+    std::uint8_t const* next_event;
+    std::uint32_t next_event_tick;
+    bool has_event;
+
+    // a u32 is at most 5 bytes of 7 bits
+    static std::uint32_t read_varint(std::uint8_t const*& data, std::uint8_t const* const end) {
+        std::uint32_t value = 0;
+        for (int shift = 0; shift < 35 && data < end; shift += 7) {
+            const std::uint8_t byte = *data++;
+            value |= static_cast<std::uint32_t>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0)
+                return value;
+        }
+        throw runtime_error("corrupt replay archive");
+    }
+
+    void load_event(std::uint32_t const previous_tick) {
+        has_event = next_event < view.events_end();
+        if (has_event) {
+            next_event_tick = previous_tick + read_varint(next_event, view.events_end());
+            if (next_event >= view.events_end())
+                throw runtime_error("corrupt replay archive"); // the command byte is missing
+        }
+    }
+
+public:
+    explicit ReplayPlayer(ReplayView const& replay) : view(replay), next_event(nullptr), next_event_tick(0), has_event(false) {
+        rewind();
+    }
+
+    void rewind() {
+        next_event = view.events_begin();
+        load_event(0);
+    }
+
+    // the commands recorded for tick, ticks must be asked for in order
+    void commands(std::uint32_t const tick, Direction& p1_cmd, Direction& p2_cmd) {
+        p1_cmd = Direction::None;
+        p2_cmd = Direction::None;
+        while (has_event && next_event_tick == tick) {
+            const std::uint8_t command = *next_event++;
+            const Direction dir = static_cast<Direction>(command & 7);
+            if ((command >> 3) == 0)
+                p1_cmd = dir;
+            else
+                p2_cmd = dir;
+            load_event(tick);
+        }
+    }
+
+    // puts simulation in the state it was in just before tick, in O(snapshot_interval) steps
+    void seek(Simulation& simulation, std::uint32_t const tick) {
+        const ReplayHeader& header = view.get_header();
+        if (header.snapshot_count == 0)
+            throw runtime_error("replay has no snapshots");
+        // binary search for the last snapshot at or before tick
+        std::uint32_t low = 0, high = header.snapshot_count;
+        while (high - low > 1) {
+            const std::uint32_t mid = (low + high) / 2;
+            if (view.snapshot(mid).tick <= tick)
+                low = mid;
+            else
+                high = mid;
+        }
+        const ReplaySnapshotEntry entry = view.snapshot(low);
+        simulation.load_snapshot(view.snapshot_data(entry));
+        next_event = view.events_begin() + entry.event_offset;
+        load_event(entry.event_base_tick);
+        Direction p1_cmd, p2_cmd;
+        while (simulation.get_frame_count() < tick && !simulation.is_over()) {
+            commands(static_cast<std::uint32_t>(simulation.get_frame_count()), p1_cmd, p2_cmd);
+            simulation.step(p1_cmd, p2_cmd);
+        }
+    }
+};
+}
+
+#endif
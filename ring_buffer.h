@@ -0,0 +1,181 @@
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+#include "arena.h"
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+
+using std::runtime_error;
+
+namespace snake {
+
+/*
+Fixed capacity double ended buffer with a deque-like front/back interface.
+Storage is contiguous, so a full scan is at most two linear passes (see
+segments()). It is allocated once by the constructor unless a larger
+max_capacity is given, in which case a full buffer doubles (copying its
+contents once) until it reaches max_capacity. A buffer built in a
+MatchArena gets its full capacity from the arena up front and never grows
+or frees anything. T is the type the
+buffer hands out, Stored is the type kept in memory, which lets a buffer of
+Coordinates be stored as PackedCoordinates.
+*/
+template <typename T, typename Stored = T>
+class RingBuffer {
+    std::unique_ptr<Stored[]> owned; // null when the storage is in a MatchArena
+    Stored* storage; // default initialized, unused slots are never read
+    std::size_t mask;  // capacity - 1, capacity is a power of two
+    std::size_t first; // index of front()
+    std::size_t count;
+    std::size_t limit; // never grows past this
+
+    static std::size_t round_up_pow2(std::size_t n) {
+        std::size_t capacity = 1;
+        while (capacity < n)
+            capacity <<= 1;
+        return capacity;
+    }
+
+    // only called when full, so the contents are copied to the front of the new storage in order
+    [[gnu::noinline]] void grow() {
+        const std::size_t new_capacity = capacity() * 2;
+        std::unique_ptr<Stored[]> grown(new Stored[new_capacity]);
+        Segment parts[2];
+        const std::size_t part_count = segments(parts);
+        std::size_t at = 0;
+        for (std::size_t i = 0; i < part_count; ++i) {
+            std::copy(parts[i].data, parts[i].data + parts[i].size, grown.get() + at);
+            at += parts[i].size;
+        }
+        owned = std::move(grown);
+        storage = owned.get();
+        mask = new_capacity - 1;
+        first = 0;
+    }
+
+public:
+    class const_iterator {
+        RingBuffer const* buffer;
+        std::size_t pos; // offset from front()
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = T;
+
+        const_iterator(RingBuffer const* buf, std::size_t p) : buffer(buf), pos(p) {}
+        T operator*() const { return (*buffer)[pos]; }
+        T operator[](difference_type n) const { return (*buffer)[pos + n]; }
+        const_iterator& operator++() { ++pos; return *this; }
+        const_iterator operator++(int) { const_iterator prev = *this; ++pos; return prev; }
+        const_iterator& operator--() { --pos; return *this; }
+        const_iterator operator--(int) { const_iterator prev = *this; --pos; return prev; }
+        const_iterator& operator+=(difference_type n) { pos += n; return *this; }
+        const_iterator& operator-=(difference_type n) { pos -= n; return *this; }
+        const_iterator operator+(difference_type n) const { return const_iterator(buffer, pos + n); }
+        const_iterator operator-(difference_type n) const { return const_iterator(buffer, pos - n); }
+        difference_type operator-(const_iterator const& rhs) const { return difference_type(pos) - difference_type(rhs.pos); }
+        bool operator==(const_iterator const& rhs) const { return pos == rhs.pos; }
+        bool operator!=(const_iterator const& rhs) const { return pos != rhs.pos; }
+        bool operator<(const_iterator const& rhs) const { return pos < rhs.pos; }
+    };
+
+    // a contiguous run of the buffer, in front to back order
+    struct Segment {
+        Stored const* data;
+        std::size_t size;
+    };
+
+    explicit RingBuffer(std::size_t min_capacity, std::size_t max_capacity = 0) :
+        owned(new Stored[round_up_pow2(min_capacity)]),
+        storage(owned.get()),
+        mask(round_up_pow2(min_capacity) - 1),
+        first(0),
+        count(0),
+        limit(std::max(min_capacity, max_capacity))
+    {}
+
+    RingBuffer(std::size_t max_capacity, MatchArena& arena) :
+        storage(static_cast<Stored*>(arena.allocate(storage_bytes(max_capacity), alignof(Stored)))),
+        mask(round_up_pow2(max_capacity) - 1),
+        first(0),
+        count(0),
+        limit(max_capacity)
+    {
+        static_assert(std::is_trivially_default_constructible_v<Stored> && std::is_trivially_destructible_v<Stored>,
+            "arena storage is neither constructed nor destroyed");
+    }
+
+    // what a buffer of max_capacity takes from a MatchArena
+    static std::size_t storage_bytes(std::size_t const max_capacity) {
+        return round_up_pow2(max_capacity) * sizeof(Stored);
+    }
+
+    void push_front(T const& value) {
+        if (count == capacity()) {
+            if (capacity() >= limit)
+                throw runtime_error("ring buffer capacity exceeded");
+            grow();
+        }
+        first = (first - 1) & mask;
+        storage[first] = Stored(value);
+        ++count;
+    }
+
+    void pop_back() {
+        --count;
+    }
+
+    void clear() {
+        first = 0;
+        count = 0;
+    }
+
+    T front() const {
+        return T(storage[first]);
+    }
+
+    T back() const {
+        return T(storage[(first + count - 1) & mask]);
+    }
+
+    T operator[](std::size_t pos) const {
+        return T(storage[(first + pos) & mask]);
+    }
+
+    std::size_t size() const {
+        return count;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    std::size_t capacity() const {
+        return mask + 1;
+    }
+
+    const_iterator begin() const {
+        return const_iterator(this, 0);
+    }
+
+    const_iterator end() const {
+        return const_iterator(this, count);
+    }
+
+    // the body as at most two contiguous arrays, for tight (vectorizable) scans
+    std::size_t segments(Segment out[2]) const {
+        const std::size_t first_len = std::min(count, capacity() - first);
+        out[0] = { storage + first, first_len };
+        out[1] = { storage, count - first_len };
+        return out[1].size == 0 ? 1 : 2;
+    }
+};
+}
+
+#endif
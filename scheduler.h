@@ -0,0 +1,119 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "stats.h"
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+
+using std::runtime_error;
+
+namespace snake {
+
+// what to do when the game loop wakes up after one or more deadlines have already passed
+enum class MissedTickPolicy {
+    Skip,   // drop the missed ticks, the game runs slower for a moment but never bursts
+    CatchUp // run the missed ticks back to back (up to MAX_CATCH_UP_TICKS) so game time keeps up with wall time
+};
+
+struct FrameTiming {
+    unsigned long frames = 0;         // times the loop woke up
+    unsigned long ticks = 0;          // simulation ticks handed out, frames + caught up ticks
+    unsigned long overruns = 0;       // frames that woke after the following deadline had already passed
+    unsigned long skipped_ticks = 0;  // ticks dropped under MissedTickPolicy::Skip (or past the catch up limit)
+    unsigned long caught_up_ticks = 0;// extra ticks run under MissedTickPolicy::CatchUp
+    LatencyHistogram wake_jitter;     // how late the loop woke relative to its deadline
+    LatencyHistogram frame_time;      // time from waking to finishing the frame
+
+    void print(std::FILE* out) const {
+        std::fprintf(out, "frames %lu, ticks %lu, overruns %lu, skipped ticks %lu, caught up ticks %lu\n",
+            frames, ticks, overruns, skipped_ticks, caught_up_ticks);
+        wake_jitter.print(out, "wake jitter");
+        frame_time.print(out, "frame time");
+    }
+};
+
+/*
+Fixed timestep loop pacing. Deadlines are absolute points on steady_clock
+(start + n * period) rather than "sleep for whatever is left of this frame",
+so time spent drawing, sleeping late or waiting on the terminal never
+accumulates as drift. The game waits for them in an EventReactor, whose
+timer expires on the same grid, and calls tick_arrived() when it wakes.
+*/
+class FixedTimestepScheduler {
+    using clock = std::chrono::steady_clock;
+
+    clock::duration period;
+    MissedTickPolicy policy;
+    clock::time_point next_deadline;
+    clock::time_point frame_start;
+    FrameTiming timing;
+
+public:
+    static constexpr unsigned MAX_CATCH_UP_TICKS = 5;
+
+    FixedTimestepScheduler(unsigned const tick_rate, MissedTickPolicy const missed_policy) :
+        policy(missed_policy)
+    {
+        set_tick_rate(tick_rate);
+    }
+
+    // takes effect from the next start()
+    void set_tick_rate(unsigned const tick_rate) {
+        if (tick_rate == 0)
+            throw runtime_error("tick rate must be greater than 0");
+        period = std::chrono::duration_cast<clock::duration>(std::chrono::seconds(1)) / tick_rate;
+    }
+
+    // the first tick is due immediately
+    void start() {
+        next_deadline = clock::now();
+    }
+
+    // the deadline the caller should wake up at
+    clock::time_point get_next_deadline() const {
+        return next_deadline;
+    }
+
+    // call on waking at or after the next deadline, returns how many ticks the caller should run (at least 1)
+    unsigned tick_arrived() {
+        frame_start = clock::now();
+        const clock::duration late = frame_start - next_deadline;
+        timing.wake_jitter.record(late);
+        ++timing.frames;
+
+        // deadlines (after the one we woke for) that have already gone by
+        const unsigned long missed = late / period;
+        unsigned ticks = 1;
+        if (missed > 0) {
+            ++timing.overruns;
+            if (policy == MissedTickPolicy::CatchUp) {
+                const unsigned long catch_up = missed < MAX_CATCH_UP_TICKS ? missed : MAX_CATCH_UP_TICKS;
+                ticks += static_cast<unsigned>(catch_up);
+                timing.caught_up_ticks += catch_up;
+                timing.skipped_ticks += missed - catch_up;
+            } else {
+                timing.skipped_ticks += missed;
+            }
+        }
+        timing.ticks += ticks;
+        next_deadline += period * (missed + 1); // stay on the start + n * period grid
+        return ticks;
+    }
+
+    // call once the frame has been updated & rendered
+    void frame_done() {
+        timing.frame_time.record(clock::now() - frame_start);
+    }
+
+    clock::duration get_period() const {
+        return period;
+    }
+
+    FrameTiming const& get_timing() const {
+        return timing;
+    }
+};
+}
+
+#endif
@@ -0,0 +1,327 @@
+#ifndef SCREEN_H
+#define SCREEN_H
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ncurses.h>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using std::runtime_error;
+using std::vector;
+
+namespace snake {
+
+enum class OutputBackend : std::uint8_t {
+    Ncurses, // mvwaddch & wrefresh
+    Ansi // escape sequences composed by Screen, one write() per frame
+};
+
+// what the ansi backend sent to the terminal
+struct OutputStats {
+    std::uint64_t frames = 0, bytes = 0, writes = 0;
+    std::uint64_t max_frame_bytes = 0;
+
+    void print(std::FILE* out) const {
+        const double n = frames == 0 ? 1.0 : static_cast<double>(frames);
+        std::fprintf(out, "output                 frames=%-9llu mean %9.1f bytes  max %9llu bytes  %5.2f write()/frame\n",
+            static_cast<unsigned long long>(frames), bytes / n, static_cast<unsigned long long>(max_frame_bytes), writes / n);
+    }
+};
+
+/*
+The drawing interface GameWindow renders through: single cells and runs of
+text in a color pair, then a flush per frame. The ncurses backend passes
+them on to mvwaddch/mvwaddnstr and wrefresh. The ansi backend composes the
+frame itself in a buffer allocated once for a full repaint and sends it
+with a single write() on flush, so a frame costs one syscall however many
+cells changed. It remembers where the terminal's cursor is and which
+colors are set, so it only moves the cursor to a cell that isn't next to
+the last one drawn (with the shortest of CR, CRLF, a relative or an
+absolute move) and only sends the colors that change, the background
+alone for a blank cell. Cells drawn one after another along a row in the
+same color and glyph are merged into a run, sent as the glyph and a
+repeat count when the terminal has one (terminfo rep).
+
+ncurses stays initialised in both cases for the keyboard and the terminal
+modes. It never learns what the ansi backend drew, so nothing may be drawn
+through ncurses once the ansi backend is in use.
+*/
+class Screen {
+    static constexpr std::size_t MAX_SEQUENCE = 32; // the longest cursor move + SGR + repeated glyph, with room to spare
+    static constexpr int MAX_PAIRS = 64;
+
+    OutputBackend backend;
+    int fd;
+    int width, height; // terminal size, needed to know when the cursor wraps
+    bool repeat_supported; // ESC [ n b repeats the last character n times
+    vector<char> frame;
+    std::size_t used;
+    int cursor_x, cursor_y; // -1 = where the terminal's cursor is is not known
+    int current_foreground, current_background; // SGR color codes last sent, -1 = not known
+    std::array<std::uint8_t, MAX_PAIRS> pair_foreground, pair_background; // as SGR codes
+    int run_x, run_y, run_length, run_pair; // cells not composed yet, all with the same pair & glyph
+    char run_glyph;
+    OutputStats stats;
+    std::uint64_t frame_bytes;
+
+    static int ansi_color(short const color, int const base) {
+        // 8 to 15 are the bright colors
+        return color < 8 ? base + color : base + 60 + color - 8;
+    }
+
+    void append(char const c) {
+        frame[used++] = c;
+    }
+
+    void append(const char* bytes, std::size_t const length) {
+        std::memcpy(frame.data() + used, bytes, length);
+        used += length;
+    }
+
+    void append_number(int n) {
+        char digits[12];
+        int count = 0;
+        do {
+            digits[count++] = static_cast<char>('0' + n % 10);
+            n /= 10;
+        } while (n > 0);
+        while (count > 0)
+            append(digits[--count]);
+    }
+
+    static int digit_count(int const n) {
+        return n < 10 ? 1 : n < 100 ? 2 : n < 1000 ? 3 : n < 10000 ? 4 : 5;
+    }
+
+    // ESC [ n <code>, n left out when it is 1
+    void append_relative(int const n, char const code) {
+        append("\x1b[", 2);
+        if (n > 1)
+            append_number(n);
+        append(code);
+    }
+
+    static int relative_length(int const n) {
+        return 3 + (n > 1 ? digit_count(n) : 0);
+    }
+
+    void move_to(int const y, int const x) {
+        if (y == cursor_y && x == cursor_x)
+            return;
+        // ESC [ row ; col H, the column left out when it is the first
+        const int absolute = 3 + digit_count(y + 1) + (x > 0 ? 1 + digit_count(x + 1) : 0);
+        if (cursor_y >= 0) {
+            if (y == cursor_y && x == 0) {
+                append('\r');
+                return;
+            }
+            if (y == cursor_y + 1 && x == 0) {
+                append("\r\n", 2); // never scrolls, y is on screen
+                return;
+            }
+            if (y == cursor_y && relative_length(std::abs(x - cursor_x)) < absolute) {
+                append_relative(std::abs(x - cursor_x), x > cursor_x ? 'C' : 'D');
+                return;
+            }
+            if (x == cursor_x && relative_length(std::abs(y - cursor_y)) < absolute) {
+                append_relative(std::abs(y - cursor_y), y > cursor_y ? 'B' : 'A');
+                return;
+            }
+        }
+        append("\x1b[", 2);
+        append_number(y + 1);
+        if (x > 0) {
+            append(';');
+            append_number(x + 1);
+        }
+        append('H');
+    }
+
+    // a blank cell only shows its background
+    void set_colors(int const pair, bool const blank) {
+        const int foreground = blank ? current_foreground : pair_foreground[pair], background = pair_background[pair];
+        const bool set_foreground = foreground != current_foreground, set_background = background != current_background;
+        if (!set_foreground && !set_background)
+            return;
+        append("\x1b[", 2);
+        if (set_foreground)
+            append_number(foreground);
+        if (set_foreground && set_background)
+            append(';');
+        if (set_background)
+            append_number(background);
+        append('m');
+        current_foreground = foreground;
+        current_background = background;
+    }
+
+    void compose_run() {
+        if (run_length == 0)
+            return;
+        if (frame.size() - used < MAX_SEQUENCE + static_cast<std::size_t>(run_length))
+            send(); // only text over a full repaint can fill the buffer, it costs one more write()
+        move_to(run_y, run_x);
+        set_colors(run_pair, run_glyph == ' ');
+        append(run_glyph);
+        const int repeats = run_length - 1;
+        if (repeat_supported && relative_length(repeats) < repeats) {
+            append_relative(repeats, 'b');
+        } else {
+            for (int i = 0; i < repeats; ++i)
+                append(run_glyph);
+        }
+        cursor_y = run_y;
+        cursor_x = run_x + run_length;
+        if (cursor_x >= width)
+            cursor_x = cursor_y = -1; // terminals differ on where the cursor is after the last column
+        run_length = 0;
+    }
+
+    void send() {
+        std::size_t sent = 0;
+        while (sent < used) {
+            const ssize_t written = ::write(fd, frame.data() + sent, used - sent);
+            ++stats.writes;
+            if (written < 0) {
+                if (errno == EINTR || errno == EAGAIN)
+                    continue;
+                break; // the terminal is gone, the next frame tries again
+            }
+            sent += static_cast<std::size_t>(written);
+        }
+        frame_bytes += used;
+        used = 0;
+    }
+
+    void forget_terminal_state() {
+        cursor_x = cursor_y = -1;
+        current_foreground = current_background = -1;
+        run_length = 0;
+    }
+
+public:
+    Screen() :
+        backend(OutputBackend::Ncurses),
+        fd(STDOUT_FILENO),
+        width(0),
+        height(0),
+        repeat_supported(false),
+        used(0),
+        pair_foreground{},
+        pair_background{},
+        run_x(0),
+        run_y(0),
+        run_pair(0),
+        run_glyph(' '),
+        frame_bytes(0)
+    {
+        forget_terminal_state();
+    }
+
+    // both backends: init_pair for ncurses, the SGR color codes of the same colors for ansi
+    void define_pair(int const pair, short const foreground, short const background) {
+        if (pair <= 0 || pair >= MAX_PAIRS)
+            throw runtime_error("color pair " + std::to_string(pair) + " out of range");
+        init_pair(static_cast<short>(pair), foreground, background);
+        pair_foreground[pair] = static_cast<std::uint8_t>(ansi_color(foreground, 30));
+        pair_background[pair] = static_cast<std::uint8_t>(ansi_color(background, 40));
+    }
+
+    // the ansi backend writes to output_fd, ncurses has to be initialised for the terminal's capabilities
+    void set_backend(OutputBackend const output, int const output_fd = STDOUT_FILENO) {
+        backend = output;
+        fd = output_fd;
+        used = 0;
+        const char* repeat = tigetstr(const_cast<char*>("rep"));
+        repeat_supported = repeat != nullptr && repeat != reinterpret_cast<char*>(-1);
+        forget_terminal_state();
+    }
+
+    OutputBackend get_backend() const {
+        return backend;
+    }
+
+    void resize(int const columns, int const rows) {
+        width = columns;
+        height = rows;
+        // a full repaint is at most a color change and a character per cell and a cursor move per row
+        frame.assign(static_cast<std::size_t>(columns) * rows * MAX_SEQUENCE / 2 + MAX_SEQUENCE * 2, 0);
+        used = 0;
+        run_length = 0;
+    }
+
+    void cell(int const y, int const x, char const glyph, int const pair) {
+        if (backend == OutputBackend::Ncurses) {
+            mvwaddch(stdscr, y, x, static_cast<chtype>(static_cast<unsigned char>(glyph)) | COLOR_PAIR(pair));
+            return;
+        }
+        if (x < 0 || y < 0 || x >= width || y >= height || pair <= 0 || pair >= MAX_PAIRS)
+            return;
+        if (run_length > 0 && y == run_y && x == run_x + run_length && pair == run_pair && glyph == run_glyph) {
+            ++run_length;
+            return;
+        }
+        compose_run();
+        run_x = x;
+        run_y = y;
+        run_pair = pair;
+        run_glyph = glyph;
+        run_length = 1;
+    }
+
+    void text(int const y, int const x, const char* str, int const length, int const pair) {
+        if (backend == OutputBackend::Ncurses) {
+            wattron(stdscr, COLOR_PAIR(pair));
+            mvwaddnstr(stdscr, y, x, str, length);
+            wattroff(stdscr, COLOR_PAIR(pair));
+            return;
+        }
+        for (int i = 0; i < length && str[i] != '\0'; ++i)
+            cell(y, x + i, str[i], pair);
+    }
+
+    void text(int const y, int const x, std::string const& str, int const pair) {
+        text(y, x, str.c_str(), static_cast<int>(str.size()), pair);
+    }
+
+    // ends the frame
+    void flush() {
+        if (backend == OutputBackend::Ncurses) {
+            wrefresh(stdscr);
+            return;
+        }
+        compose_run();
+        send();
+        ++stats.frames;
+        stats.bytes += frame_bytes;
+        stats.max_frame_bytes = std::max(stats.max_frame_bytes, frame_bytes);
+        frame_bytes = 0;
+    }
+
+    // before endwin(): default colors, and the cursor back where ncurses left it so it can move it on correctly
+    void finish() {
+        if (backend != OutputBackend::Ansi || frame.empty())
+            return;
+        compose_run();
+        append("\x1b[0m", 4);
+        cursor_x = cursor_y = -1;
+        move_to(getcury(stdscr), getcurx(stdscr));
+        send();
+        forget_terminal_state();
+    }
+
+    OutputStats const& get_stats() const {
+        return stats;
+    }
+};
+}
+
+#endif
@@ -0,0 +1,358 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "bots.h"
+#include "netplay.h"
+#include "reactor.h"
+#include "stats.h"
+#include "thread_pool.h"
+#include "timer_wheel.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using std::vector;
+
+namespace snake {
+
+struct ServerConfig {
+    std::string address;          // Unix socket path or [host:]port, as for --host
+    int width = 80, height = 24;  // every match is played on this board
+    unsigned tick_rate = FRAMES_PER_SECOND;
+    std::size_t threads = 0;      // workers ticking matches, 0 = one per core
+    std::size_t max_sessions = 16384;
+    BotKind bot = BotKind::Random; // the server's side of every match
+    std::chrono::microseconds bot_budget{ 1000 };
+};
+
+// what the server did since the last take_stats()
+struct ServerStats {
+    std::size_t sessions = 0;     // connected when the stats were taken
+    unsigned long opened = 0, closed = 0;
+    unsigned long matches = 0;    // played to the end
+    unsigned long ticks = 0;      // match ticks run
+    unsigned long missed = 0;     // ticks finished after the match's next tick was due
+    unsigned long skipped = 0;    // ticks never run, the match was still busy with the one before
+    LatencyHistogram tick_latency; // from a tick's deadline to the match having run it
+    LatencyHistogram tick_time;    // running it
+    LatencyHistogram dispatch_lag; // from its deadline to a worker starting on it: wheel resolution + queueing
+
+    void merge(ServerStats const& other) {
+        opened += other.opened;
+        closed += other.closed;
+        matches += other.matches;
+        ticks += other.ticks;
+        missed += other.missed;
+        skipped += other.skipped;
+        tick_latency.merge(other.tick_latency);
+        tick_time.merge(other.tick_time);
+        dispatch_lag.merge(other.dispatch_lag);
+    }
+
+    double miss_rate() const {
+        const unsigned long due = ticks + skipped;
+        return due == 0 ? 0.0 : 100.0 * static_cast<double>(missed + skipped) / due;
+    }
+
+    void print(std::FILE* out) const {
+        std::fprintf(out, "server       sessions %zu (+%lu -%lu)  matches %lu  ticks %lu  deadline misses %lu + %lu skipped (%.2f%%)\n",
+            sessions, opened, closed, matches, ticks, missed, skipped, miss_rate());
+        tick_latency.print(out, "tick latency");
+        tick_time.print(out, "tick time");
+        dispatch_lag.print(out, "dispatch lag");
+    }
+};
+
+// a player's socket: at 8 bytes a tick the kernel's buffer and SERVER_SEND_BUFFER hold seconds of messages, a player
+// who hasn't read them for SERVER_SEND_TIMEOUT is disconnected rather than block the worker sending to them
+inline constexpr int SERVER_SOCKET_BUFFER = 4 * 1024;
+inline constexpr std::size_t SERVER_SEND_BUFFER = 512;
+inline constexpr std::chrono::seconds SERVER_SEND_TIMEOUT{ 2 };
+
+/*
+One remote player against a server bot, the server playing green (PLAYER1)
+as a --host game would. A match is only ever touched by the worker running
+its tick: the dispatcher hands it on by setting running and submitting the
+tick, and takes it back when the worker clears running, so nothing in it
+needs a lock.
+*/
+class ServerMatch {
+    ServerConfig const& config;
+    Simulation simulation;
+    SocketTransport connection;
+    RollbackSession<SocketTransport> session;
+    Bot bot;
+    std::uint64_t seed;
+    bool awaiting_restart; // the match is over, waiting for the player to ask for another
+
+public:
+    std::atomic<bool> running; // a tick is queued or being run, the match belongs to a worker until it is cleared
+    bool closed;               // the player has gone, set by the worker that found out
+    std::chrono::steady_clock::time_point deadline; // of the tick being run
+
+    ServerMatch(ServerConfig const& server_config, int const fd, std::uint64_t const bot_seed) :
+        config(server_config),
+        simulation(config.width, config.height, make_bot_players(config.width, config.height, 2), config.tick_rate),
+        connection(fd),
+        session(simulation, connection, PLAYER1, false),
+        bot(config.bot, bot_seed, config.bot_budget),
+        seed(bot_seed),
+        awaiting_restart(false),
+        running(false),
+        closed(false)
+    {
+        connection.limit_sends(SERVER_SEND_BUFFER, SERVER_SEND_TIMEOUT);
+        NetHello hello;
+        std::memcpy(hello.magic, NET_MAGIC, sizeof(hello.magic));
+        hello.version = NET_VERSION;
+        hello.width = static_cast<std::uint16_t>(config.width);
+        hello.height = static_cast<std::uint16_t>(config.height);
+        hello.tick_rate = static_cast<std::uint16_t>(config.tick_rate);
+        connection.send_hello(hello);
+        bot.prepare(simulation);
+    }
+
+    ServerMatch(const ServerMatch&) = delete;
+    ServerMatch& operator=(const ServerMatch&) = delete;
+
+    // one tick of the match, true if it was the one that finished it. Throws once the player has disconnected or stopped
+    // reading
+    bool tick() {
+        if (awaiting_restart) {
+            if (!session.try_restart())
+                return false;
+            simulation.reset(make_bot_players(config.width, config.height, 2));
+            session.reset();
+            bot.reseed(++seed);
+            bot.prepare(simulation);
+            awaiting_restart = false;
+        }
+        session.poll();
+        if (session.can_step())
+            session.step(bot.next_command(simulation, PLAYER1));
+        awaiting_restart = session.confirmed_winner() != NO_WINNER;
+        return awaiting_restart;
+    }
+};
+
+/*
+Hosts any number of matches at once, each played against a bot like a
+--host game. A match is a task, not a thread: a dispatcher thread keeps
+every match's next tick deadline in a TimerWheel with SERVER_RESOLUTION
+ticks, wakes up on a timerfd once per wheel tick (or when a player
+connects) and submits each match whose deadline has come to a fixed
+WorkStealingPool. Matches tick on their own phase, from when their player
+connected, so the load is spread over the tick period instead of arriving
+all at once.
+
+A tick that finishes after the match's next tick was due is a deadline
+miss; a deadline that comes while the match is still busy is skipped and
+counted as one too, so an overloaded server falls behind smoothly instead
+of queueing up ticks it can't run. Stats are collected per worker and
+added up by take_stats().
+*/
+inline constexpr std::chrono::milliseconds SERVER_RESOLUTION{ 1 };
+
+class GameServer {
+    using clock = std::chrono::steady_clock;
+
+    struct Slot {
+        std::unique_ptr<ServerMatch> match;
+        clock::time_point deadline; // next tick, dispatcher only
+    };
+
+    struct alignas(64) WorkerStats {
+        std::mutex mutex;
+        ServerStats stats;
+    };
+
+    ServerConfig config;
+    clock::duration period;
+    clock::time_point epoch; // wheel tick 0
+    int listener;
+    vector<Slot> slots; // by timer id
+    vector<std::uint32_t> free_slots;
+    TimerWheel wheel;
+    std::uint64_t next_seed;
+    vector<std::unique_ptr<WorkerStats>> worker_stats;
+    std::atomic<std::size_t> sessions;
+    std::atomic<unsigned long> opened, closed, skipped;
+    std::atomic<bool> stopping;
+    WorkStealingPool pool;
+    std::thread dispatcher;
+
+    std::uint64_t wheel_tick(clock::time_point const time) const {
+        // rounded up, a timer never expires before its deadline
+        return static_cast<std::uint64_t>((time - epoch + SERVER_RESOLUTION - clock::duration(1)) / SERVER_RESOLUTION);
+    }
+
+    void accept_sessions() {
+        for (;;) {
+            const int fd = ::accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED)
+                    continue;
+                return; // EAGAIN, or out of descriptors until a session closes
+            }
+            ::setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &SERVER_SOCKET_BUFFER, sizeof(SERVER_SOCKET_BUFFER));
+            if (sessions.load() >= config.max_sessions) {
+                ::close(fd);
+                continue;
+            }
+            std::uint32_t id;
+            if (!free_slots.empty()) {
+                id = free_slots.back();
+                free_slots.pop_back();
+            } else {
+                id = static_cast<std::uint32_t>(slots.size());
+                slots.emplace_back();
+                wheel.reserve(slots.size());
+            }
+            try {
+                slots[id].match = std::make_unique<ServerMatch>(config, fd, next_seed++);
+            } catch (const std::exception&) {
+                free_slots.push_back(id); // hung up before the hello
+                continue;
+            }
+            slots[id].deadline = clock::now() + period;
+            wheel.schedule(id, wheel_tick(slots[id].deadline));
+            sessions.fetch_add(1);
+            opened.fetch_add(1);
+        }
+    }
+
+    void close_session(std::uint32_t const id) {
+        slots[id].match.reset();
+        free_slots.push_back(id);
+        sessions.fetch_sub(1);
+        closed.fetch_add(1);
+    }
+
+    void dispatch(std::uint32_t const id) {
+        Slot& slot = slots[id];
+        ServerMatch* const match = slot.match.get();
+        if (match->running.load(std::memory_order_acquire)) {
+            skipped.fetch_add(1);
+        } else if (match->closed) {
+            close_session(id);
+            return;
+        } else {
+            match->deadline = slot.deadline;
+            match->running.store(true, std::memory_order_relaxed);
+            pool.submit([this, match] { run_tick(*match); });
+        }
+        slot.deadline += period;
+        wheel.schedule(id, wheel_tick(slot.deadline));
+    }
+
+    void run_tick(ServerMatch& match) {
+        const auto start = clock::now();
+        bool finished = false;
+        try {
+            finished = match.tick();
+        } catch (const std::exception&) {
+            match.closed = true;
+        }
+        const auto done = clock::now();
+        WorkerStats& worker = *worker_stats[static_cast<std::size_t>(WorkStealingPool::current_worker())];
+        {
+            std::lock_guard<std::mutex> lock(worker.mutex);
+            ServerStats& stats = worker.stats;
+            ++stats.ticks;
+            stats.matches += finished;
+            if (done - match.deadline >= period)
+                ++stats.missed;
+            stats.tick_latency.record(done - match.deadline);
+            stats.tick_time.record(done - start);
+            stats.dispatch_lag.record(start - match.deadline);
+        }
+        match.running.store(false, std::memory_order_release);
+    }
+
+    void dispatch_loop() {
+        EventReactor reactor(listener);
+        reactor.arm(clock::now() + SERVER_RESOLUTION, SERVER_RESOLUTION);
+        while (!stopping.load()) {
+            reactor.wait_for_tick([this] { accept_sessions(); });
+            const auto now = static_cast<std::uint64_t>((clock::now() - epoch) / SERVER_RESOLUTION);
+            wheel.advance(now, [this](std::uint32_t const id, std::uint64_t) {
+                dispatch(id);
+            });
+        }
+    }
+
+public:
+    // listens on config.address straight away, players can connect with snake.o --join
+    explicit GameServer(ServerConfig const& server_config) :
+        config(server_config),
+        period(std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(1.0 / std::max(1u, server_config.tick_rate)))),
+        epoch(clock::now()),
+        listener(SocketTransport::open_listener(server_config.address, SOMAXCONN)),
+        next_seed(1),
+        sessions(0),
+        opened(0),
+        closed(0),
+        skipped(0),
+        stopping(false),
+        pool(server_config.threads != 0 ? server_config.threads : std::max(1u, std::thread::hardware_concurrency()))
+    {
+        ::fcntl(listener, F_SETFL, ::fcntl(listener, F_GETFL) | O_NONBLOCK);
+        ::fcntl(listener, F_SETFD, FD_CLOEXEC);
+        for (std::size_t i = 0; i < pool.size(); ++i)
+            worker_stats.push_back(std::make_unique<WorkerStats>());
+        dispatcher = std::thread(&GameServer::dispatch_loop, this);
+    }
+
+    GameServer(const GameServer&) = delete;
+    GameServer& operator=(const GameServer&) = delete;
+
+    // stops ticking, hangs up on every player and stops listening
+    ~GameServer() {
+        stopping.store(true);
+        dispatcher.join();
+        pool.wait_idle();
+        slots.clear();
+        ::close(listener);
+        if (config.address.find('/') != std::string::npos)
+            ::unlink(config.address.c_str());
+    }
+
+    // the stats since the last call, from any thread
+    ServerStats take_stats() {
+        ServerStats total;
+        for (auto& worker : worker_stats) {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            total.merge(worker->stats);
+            worker->stats = ServerStats();
+        }
+        total.sessions = sessions.load();
+        total.opened = opened.exchange(0);
+        total.closed = closed.exchange(0);
+        total.skipped = skipped.exchange(0);
+        return total;
+    }
+
+    std::size_t get_sessions() const {
+        return sessions.load();
+    }
+
+    std::size_t get_threads() const {
+        return pool.size();
+    }
+};
+}
+
+#endif
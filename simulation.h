@@ -0,0 +1,605 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include "arena.h"
+#include "board.h"
+#include "config.h"
+#include "core.h"
+#include "free_cells.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+using std::runtime_error;
+using std::vector;
+
+namespace snake {
+
+struct StartingPositions {
+    Coordinates player1_start, player2_start;
+    int initial_height, initial_width;
+};
+
+inline StartingPositions calculate_starting_positions(int const max_x, int const max_y) {
+    // max_x & max_y are the full board dimensions, border included
+    int half_y = max_y/2;
+    int quarter_x = max_x / 4;
+    int three_quarter_x = quarter_x*3;
+    return {
+        {quarter_x, half_y},        // player 1 start
+        {three_quarter_x, half_y},  // player 2 start
+        max_y - 3,                  // (x axis-1) -2 [border height]
+        max_x - 3                   // (y axis-1) - 2 [border width]
+    };
+}
+
+struct StartingPosition {
+    Coordinates pos;
+    Direction dir;
+};
+
+// players are paired up facing each other like the two player game, one pair per row, rows evenly spaced
+inline vector<StartingPosition> calculate_starting_positions(int const max_x, int const max_y, std::size_t const count) {
+    const StartingPositions two_player = calculate_starting_positions(max_x, max_y);
+    const int rows = static_cast<int>((count + 1) / 2);
+    if (max_y < 2 * rows + 3)
+        throw runtime_error("board too short for " + std::to_string(count) + " players");
+    vector<StartingPosition> positions;
+    for (std::size_t i = 0; i < count; ++i) {
+        const int y = static_cast<int>(i / 2 + 1) * max_y / (rows + 1); // max_y / 2 for two players
+        if (i % 2 == 0)
+            positions.push_back({ { two_player.player1_start.x, y }, Direction::Right });
+        else
+            positions.push_back({ { two_player.player2_start.x, y }, Direction::Left });
+    }
+    return positions;
+}
+
+template <typename T>
+void append_pod(vector<std::uint8_t>& out, T const& value) {
+    const std::size_t at = out.size();
+    out.resize(at + sizeof(T));
+    std::memcpy(out.data() + at, &value, sizeof(T));
+}
+
+// reads a T from possibly unaligned memory and advances data past it
+template <typename T>
+T read_pod(std::uint8_t const*& data) {
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    data += sizeof(T);
+    return value;
+}
+
+// a snake can never be longer than the board has cells
+inline std::size_t body_capacity(int const width, int const height) {
+    return static_cast<std::size_t>(width) * height;
+}
+
+// an arena bigger than the view starts the players as a view sized board would, in the middle of the arena
+inline vector<StartingPosition> calculate_starting_positions(int const max_x, int const max_y, std::size_t const count, int const view_x, int const view_y) {
+    const int x = std::min(view_x, max_x), y = std::min(view_y, max_y);
+    vector<StartingPosition> positions = calculate_starting_positions(x, y, count);
+    for (StartingPosition& start : positions) {
+        start.pos.x += (max_x - x) / 2;
+        start.pos.y += (max_y - y) / 2;
+    }
+    return positions;
+}
+
+// a Player with all of Player's constructor arguments but the last, the player and its body in arena if there is one
+template <typename... Args>
+shared_ptr<Player> make_player(MatchArena* const arena, Args&&... args) {
+    if (arena == nullptr)
+        return make_shared<Player>(std::forward<Args>(args)...);
+    return std::allocate_shared<Player>(ArenaAllocator<Player>(*arena), std::forward<Args>(args)..., arena);
+}
+
+// what count players with bodies of capacity take from a MatchArena, control blocks and alignment included
+inline std::size_t match_arena_bytes(std::size_t const count, std::size_t const capacity) {
+    return count * (SnakeBody::storage_bytes(capacity) + sizeof(Player) + 128);
+}
+
+// count keyboardless players (for bots) at their starting positions, view_x & view_y as above (0 = the whole board)
+inline vector<shared_ptr<Player>> make_bot_players(int const width, int const height, std::size_t const count, int const view_x = 0, int const view_y = 0, MatchArena* const arena = nullptr) {
+    const int x = view_x > 0 ? std::min(view_x, width) : width, y = view_y > 0 ? std::min(view_y, height) : height;
+    const vector<StartingPosition> positions = calculate_starting_positions(width, height, count, x, y);
+    const int length = calculate_starting_positions(x, y).initial_width / 5;
+    vector<shared_ptr<Player>> players;
+    for (std::size_t i = 0; i < count; ++i)
+        players.push_back(make_player(arena, static_cast<int>(i) + 1, positions[i].pos, positions[i].dir, 0, 0, 0, 0, length, body_capacity(width, height)));
+    return players;
+}
+
+/*
+Simulation holds the rules of the game and nothing else: no ncurses, no
+threads, no sleeping. Each call to step() advances the game by exactly one
+tick and returns the outcome, so it can be driven as fast as the CPU allows
+(see headless.cpp) or paced and drawn by Game/GameWindow.
+
+Any number of players from 2 to MAX_PLAYERS share one Board, so resolving
+a tick costs O(players) whatever their lengths. A snake that crashes stays
+where it is as an obstacle; the last one moving wins. Crash rules, applied
+to every player the same way:
+  - tails leave their cells before any head moves, so following a tail is safe
+  - a head entering a wall or any body (dead or alive) crashes
+  - heads entering the same free cell on the same tick all crash
+  - if every snake still moving crashes on the same tick it is a draw
+
+Snakes grow by 1 every 2 seconds, or in food mode (set_food()) only by
+eating: a number of pellets lie on random empty cells, a head entering
+one eats it and makes its snake 1 longer, and a new one appears at once.
+Pellets are not on the Board, a bot or a collision sees an empty cell.
+The empty cells without a pellet are kept in a FreeCells set updated with
+every head and tail, so a pellet is placed in O(1), uniformly, however
+full the board is.
+
+Config (see config.h) picks the board: Board for screen sized games, or
+ChunkedBoard for arenas too big to store densely, both cost O(1) per
+lookup. A StaticConfig also fixes the board size, player count, tick rate
+and whether the border wraps at compile time.
+*/
+template <typename Config>
+class BasicSimulation {
+public:
+    using BoardType = typename Config::BoardType;
+
+private:
+    int board_width, board_height; // full board dimensions, border included
+    vector<shared_ptr<Player>> players; // players[i]->id() == i + 1
+    vector<SnakeMove> moves; // what changed in the last step, for incremental renderers
+    vector<std::uint8_t> alive;
+    vector<std::uint8_t> crashed; // step() scratch
+    int alive_count;
+    BoardType board;
+    vector<Coordinates> collision_pos;
+    unsigned long frame_count;
+    unsigned growth_interval; // snakes grow by 1 every growth_interval ticks (2 seconds)
+    int winner; // -1 = none, 0 = draw, otherwise the id of the winning player
+    vector<Coordinates> restored_body; // load_snapshot() scratch, kept so restoring doesn't allocate
+    std::size_t food_count; // pellets kept on the board, 0 = no food, snakes grow on the timer
+    vector<Coordinates> food; // where they are
+    FreeCells free_cells; // food mode: the empty cells without a pellet
+    SplitMix64 food_rng;
+    vector<std::uint32_t> restored_free_cells; // load_snapshot() scratch
+
+    // a constant for static configurations, so the per player loops of a tick can be unrolled
+    std::size_t player_count() const {
+        if constexpr (Config::IS_STATIC)
+            return Config::PLAYERS;
+        else
+            return players.size();
+    }
+
+    unsigned tick_growth_interval() const {
+        if constexpr (Config::IS_STATIC)
+            return 2 * Config::TICK_RATE;
+        else
+            return growth_interval;
+    }
+
+    void check_static_size(int const width, int const height) const {
+        if constexpr (Config::IS_STATIC) {
+            if (width != Config::WIDTH || height != Config::HEIGHT)
+                throw runtime_error("board size doesn't match the simulation's static configuration");
+        }
+    }
+
+    void set_players(vector<shared_ptr<Player>> new_players) {
+        if (new_players.size() < 2 || new_players.size() > MAX_PLAYERS)
+            throw runtime_error("a match needs 2 to " + std::to_string(MAX_PLAYERS) + " players");
+        if constexpr (Config::IS_STATIC) {
+            if (new_players.size() != Config::PLAYERS)
+                throw runtime_error("this simulation is configured for " + std::to_string(Config::PLAYERS) + " players");
+        }
+        for (std::size_t i = 0; i < new_players.size(); ++i) {
+            if (new_players[i] == nullptr)
+                throw runtime_error("simulation created without players");
+            if (new_players[i]->id() != static_cast<int>(i) + 1)
+                throw runtime_error("player ids must be 1, 2, 3 ... in order");
+        }
+        players = std::move(new_players);
+        moves.assign(players.size(), SnakeMove{});
+        alive.assign(players.size(), 1);
+        crashed.assign(players.size(), 0);
+        alive_count = static_cast<int>(players.size());
+        collision_pos.reserve(MAX_PLAYERS); // every snake crashes at most once
+    }
+
+    void place_players() {
+        board.reset(board_width, board_height);
+        // crashed snakes first, a crashed head may overlap a body that is still moving
+        for (int pass = 0; pass < 2; ++pass) {
+            for (std::size_t i = 0; i < players.size(); ++i) {
+                if (alive[i] != pass)
+                    continue;
+                for (Coordinates pos : players[i]->get_body())
+                    board.occupy(pos, players[i]->id());
+            }
+        }
+        if (food_count > 0)
+            place_food();
+    }
+
+    // O(board), when the players are (re)placed: pellets that survived (a restored snapshot) stay, then the
+    // pellets missing are spawned
+    void place_food() {
+        free_cells.rebuild(board);
+        food.erase(std::remove_if(food.begin(), food.end(), [this](Coordinates const& pos) {
+            return !free_cells.take(pos);
+        }), food.end());
+        spawn_food();
+    }
+
+    void spawn_food() {
+        while (food.size() < food_count && !free_cells.empty()) {
+            const Coordinates pos = free_cells.sample(food_rng);
+            free_cells.take(pos);
+            food.push_back(pos);
+        }
+    }
+
+    // a head entered an empty cell, returns true if a pellet was there
+    bool eat(Coordinates const& head) {
+        if (free_cells.take(head))
+            return false;
+        for (Coordinates& pellet : food) {
+            if (pellet == head) {
+                pellet = food.back();
+                food.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void crash(std::size_t const i) {
+        if (!crashed[i]) {
+            crashed[i] = 1;
+            --alive_count;
+        }
+    }
+
+    // updates the board with this tick's moves, returns true if anyone crashed
+    bool resolve_collisions() {
+        SNAKE_PROFILE_SCOPE(Phase::Collide);
+        const std::size_t count = player_count();
+        // free every tail before placing any head, a head may follow a tail into its cell
+        for (std::size_t i = 0; i < count; ++i) {
+            if (alive[i] && moves[i].tail_popped) {
+                board.vacate(moves[i].tail);
+                if (food_count > 0 && board.owner(moves[i].tail) == CELL_EMPTY)
+                    free_cells.release(moves[i].tail);
+            }
+        }
+        // O(1) per player: the board already knows what was in the cell before the head arrived
+        bool any_crashed = false;
+        for (std::size_t i = 0; i < count; ++i) {
+            if (!alive[i])
+                continue;
+            const Coordinates head = moves[i].head;
+            const std::uint8_t prev_owner = board.owner(head);
+            if (prev_owner == CELL_EMPTY) {
+                board.occupy(head, players[i]->id());
+                if (food_count > 0 && eat(head))
+                    players[i]->get_snake().grow();
+                continue;
+            }
+            // wall, a body, or a head that got here first this tick, which crashes too
+            crash(i);
+            any_crashed = true;
+            const std::size_t other = prev_owner - 1u;
+            if (prev_owner != CELL_BORDER && other < i && alive[other] && moves[other].head == head)
+                crash(other);
+        }
+        return any_crashed;
+    }
+
+public:
+    BasicSimulation(int width, int height, vector<shared_ptr<Player>> match_players, unsigned tick_rate = FRAMES_PER_SECOND) :
+        board_width(width),
+        board_height(height),
+        alive_count(0),
+        board(width, height),
+        frame_count(0),
+        growth_interval(2 * tick_rate),
+        winner(NO_WINNER),
+        food_count(0),
+        food_rng(0)
+    {
+        if (tick_rate == 0)
+            throw runtime_error("tick rate must be greater than 0");
+        if constexpr (Config::IS_STATIC) {
+            if (tick_rate != Config::TICK_RATE)
+                throw runtime_error("tick rate doesn't match the simulation's static configuration");
+        }
+        check_static_size(width, height);
+        if (PACKED_SNAKE_BODY && (width > MAX_PACKED_COORDINATE || height > MAX_PACKED_COORDINATE))
+            throw runtime_error("board too large for packed coordinates");
+        set_players(std::move(match_players));
+        place_players();
+    }
+
+    BasicSimulation(int width, int height, shared_ptr<Player> p1, shared_ptr<Player> p2, unsigned tick_rate = FRAMES_PER_SECOND) :
+        BasicSimulation(width, height, vector<shared_ptr<Player>>{ p1, p2 }, tick_rate)
+    {}
+
+    // static configurations only, everything but the players is in the configuration
+    explicit BasicSimulation(vector<shared_ptr<Player>> match_players) :
+        BasicSimulation(Config::WIDTH, Config::HEIGHT, std::move(match_players), Config::TICK_RATE)
+    {}
+
+    void reset(vector<shared_ptr<Player>> match_players) {
+        set_players(std::move(match_players));
+        collision_pos.clear();
+        food.clear();
+        frame_count = 0;
+        winner = NO_WINNER;
+        place_players();
+    }
+
+    void reset(shared_ptr<Player> p1, shared_ptr<Player> p2) {
+        reset(vector<shared_ptr<Player>>{ p1, p2 });
+    }
+
+    // lets go of the players so the MatchArena they are in can be reset, nothing but reset() may be called until then
+    void release_players() {
+        players.clear();
+    }
+
+    // a new match with the same players, each already put back at its start (Snake::restore), without allocating
+    void restart() {
+        for (std::size_t i = 0; i < players.size(); ++i) {
+            moves[i] = {};
+            alive[i] = 1;
+            crashed[i] = 0;
+        }
+        alive_count = static_cast<int>(players.size());
+        collision_pos.clear();
+        food.clear();
+        frame_count = 0;
+        winner = NO_WINNER;
+        place_players();
+    }
+
+    /*
+    Food mode: count pellets on the board from now on and snakes only grow
+    by eating them, 0 goes back to growing on the timer. Pellets are placed
+    by a SplitMix64 seeded with seed, so a match with the same seed and
+    commands plays out the same. Needs a dense board, an arena can't list
+    its empty cells.
+    */
+    void set_food(std::size_t const count, std::uint64_t const seed) {
+        if (std::is_same_v<BoardType, ChunkedBoard> && count > 0)
+            throw runtime_error("food needs a dense board, not an arena");
+        food_count = count;
+        food_rng = SplitMix64(seed);
+        food.clear();
+        food.reserve(count);
+        if (food_count > 0)
+            place_food();
+    }
+
+    /*
+    Snapshot of everything step() depends on: frame count and each snake's
+    directions, length and body, and in food mode the pellets. Layout
+    (native endianness):
+      u32 frame_count
+      per player: u8 current_dir (| 0x80 once crashed), u8 next_dir, i32 length, u32 body_size,
+                  body_size * (i16 x, i16 y) head first
+      food mode only: u64 food rng state, u32 pellets, pellets * (i16 x, i16 y), u32 free_cells,
+                      free_cells * u32 board index (y * width + x) in FreeCells order, which spawning depends on
+    */
+    void save_snapshot(vector<std::uint8_t>& out) const {
+        if (board_width > MAX_PACKED_COORDINATE || board_height > MAX_PACKED_COORDINATE)
+            throw runtime_error("board too large for snapshots");
+        append_pod(out, static_cast<std::uint32_t>(frame_count));
+        for (std::size_t i = 0; i < players.size(); ++i) {
+            Snake const& snake = players[i]->get_snake();
+            append_pod(out, static_cast<std::uint8_t>(static_cast<int>(snake.get_direction()) | (alive[i] ? 0 : 0x80)));
+            append_pod(out, static_cast<std::uint8_t>(snake.get_next_direction()));
+            append_pod(out, static_cast<std::int32_t>(snake.get_length()));
+            append_pod(out, static_cast<std::uint32_t>(snake.get_body().size()));
+            for (Coordinates pos : snake.get_body())
+                append_pod(out, PackedCoordinates(pos));
+        }
+        if (food_count > 0) {
+            append_pod(out, food_rng.get_state());
+            append_pod(out, static_cast<std::uint32_t>(food.size()));
+            for (Coordinates pos : food)
+                append_pod(out, PackedCoordinates(pos));
+            append_pod(out, static_cast<std::uint32_t>(free_cells.size()));
+            const std::size_t at = out.size();
+            out.resize(at + free_cells.size() * sizeof(std::uint32_t));
+            std::memcpy(out.data() + at, free_cells.get_cells().data(), free_cells.size() * sizeof(std::uint32_t));
+        }
+    }
+
+    // restores a save_snapshot() of a match with the same number of players and food, returns a pointer just past the snapshot
+    std::uint8_t const* load_snapshot(std::uint8_t const* data) {
+        frame_count = read_pod<std::uint32_t>(data);
+        alive_count = 0;
+        for (std::size_t i = 0; i < players.size(); ++i) {
+            const std::uint8_t current_byte = read_pod<std::uint8_t>(data);
+            const auto current = static_cast<Direction>(current_byte & 0x7F);
+            const auto next = static_cast<Direction>(read_pod<std::uint8_t>(data));
+            const int length = read_pod<std::int32_t>(data);
+            const std::uint32_t body_size = read_pod<std::uint32_t>(data);
+            restored_body.resize(body_size);
+            for (Coordinates& pos : restored_body)
+                pos = static_cast<Coordinates>(read_pod<PackedCoordinates>(data));
+            players[i]->get_snake().restore(current, next, length, restored_body.begin(), restored_body.end());
+            alive[i] = (current_byte & 0x80) == 0;
+            alive_count += alive[i];
+            moves[i] = {};
+        }
+        if (food_count > 0) {
+            food_rng = SplitMix64(read_pod<std::uint64_t>(data));
+            food.resize(read_pod<std::uint32_t>(data));
+            for (Coordinates& pos : food)
+                pos = static_cast<Coordinates>(read_pod<PackedCoordinates>(data));
+            restored_free_cells.resize(read_pod<std::uint32_t>(data));
+            std::memcpy(restored_free_cells.data(), data, restored_free_cells.size() * sizeof(std::uint32_t));
+            data += restored_free_cells.size() * sizeof(std::uint32_t);
+        }
+        collision_pos.clear();
+        winner = NO_WINNER;
+        place_players();
+        if (food_count > 0)
+            free_cells.assign(restored_free_cells.begin(), restored_free_cells.end()); // the same cells, in the saved order
+        return data;
+    }
+
+    void resize(int width, int height) {
+        // takes effect on the next reset()
+        check_static_size(width, height);
+        board_width = width;
+        board_height = height;
+    }
+
+    // advance the game by one tick, commands[i] is player i + 1's, Direction::None means no command
+    int step(Direction const* commands) {
+        if (winner != NO_WINNER)
+            return winner; // game already over
+        SNAKE_PROFILE_SCOPE(Phase::Step);
+
+        const std::size_t count = player_count();
+        for (std::size_t i = 0; i < count; ++i) {
+            if (!alive[i]) {
+                const Coordinates head = players[i]->get_snake().get_head();
+                moves[i] = { head, head, false }; // crashed snakes stay put
+                continue;
+            }
+            players[i]->change_direction(commands[i]);
+            if (food_count > 0)
+                moves[i] = players[i]->template update<typename Config::Border>(); // grows by eating instead
+            else
+                moves[i] = players[i]->template update<typename Config::Border>(frame_count, tick_growth_interval());
+        }
+        ++frame_count;
+        const bool any_crashed = resolve_collisions();
+        if (food_count > 0)
+            spawn_food(); // replaces the pellets eaten
+        if (!any_crashed)
+            return winner;
+
+        int last_moving = NO_WINNER;
+        for (std::size_t i = 0; i < count; ++i) {
+            if (crashed[i]) {
+                crashed[i] = 0;
+                alive[i] = 0;
+                collision_pos.push_back(moves[i].head);
+            } else if (alive[i]) {
+                last_moving = players[i]->id();
+            }
+        }
+        if (alive_count == 0)
+            winner = DRAW; // everyone still moving crashed at once
+        else if (alive_count == 1)
+            winner = last_moving;
+        return winner;
+    }
+
+    int step(Direction p1_cmd = Direction::None, Direction p2_cmd = Direction::None) {
+        Direction commands[MAX_PLAYERS] = { p1_cmd, p2_cmd }; // anyone else goes straight on
+        return step(commands);
+    }
+
+    int get_winner() const {
+        return winner;
+    }
+
+    bool is_over() const {
+        return winner != NO_WINNER;
+    }
+
+    unsigned long get_frame_count() const {
+        return frame_count;
+    }
+
+    int get_width() const {
+        if constexpr (Config::IS_STATIC)
+            return Config::WIDTH;
+        else
+            return board_width;
+    }
+
+    int get_height() const {
+        if constexpr (Config::IS_STATIC)
+            return Config::HEIGHT;
+        else
+            return board_height;
+    }
+
+    BoardType const& get_board() const {
+        return board;
+    }
+
+    std::size_t get_player_count() const {
+        return player_count();
+    }
+
+    // index = id - 1
+    Player const& get_player(std::size_t const index) const {
+        return *players[index];
+    }
+
+    SnakeMove get_move(std::size_t const index) const {
+        return moves[index];
+    }
+
+    bool is_alive(std::size_t const index) const {
+        return alive[index] != 0;
+    }
+
+    int get_alive_count() const {
+        return alive_count;
+    }
+
+    Player const& get_player1() const {
+        return *players[0];
+    }
+
+    Player const& get_player2() const {
+        return *players[1];
+    }
+
+    SnakeMove get_player1_move() const {
+        return moves[0];
+    }
+
+    SnakeMove get_player2_move() const {
+        return moves[1];
+    }
+
+    vector<Coordinates> const& get_collisions() const {
+        return collision_pos;
+    }
+
+    // the pellets on the board, empty unless in food mode
+    vector<Coordinates> const& get_food() const {
+        return food;
+    }
+
+    std::size_t get_food_count() const {
+        return food_count;
+    }
+
+    // food mode: the empty cells without a pellet
+    FreeCells const& get_free_cells() const {
+        return free_cells;
+    }
+};
+
+using Simulation = BasicSimulation<RuntimeConfig<Board>>;
+using ArenaSimulation = BasicSimulation<RuntimeConfig<ChunkedBoard>>; // for arenas bigger than the screen
+// compile time configured games are BasicSimulation<StaticConfig<...>>, see config.h
+}
+
+#endif
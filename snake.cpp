@@ -1,16 +1,207 @@
+#include "server.h"
 #include "snake.h"
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <exception>
+#include <thread>
 
 using namespace snake;
 
 using std::exception;
 
-int main() {
+namespace {
+
+GameOptions parse_options(int argc, char** argv) {
+    GameOptions options;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--tick-rate") && i + 1 < argc) {
+            const int rate = atoi(argv[++i]);
+            if (rate <= 0)
+                throw runtime_error("--tick-rate must be a positive number");
+            options.tick_rate = static_cast<unsigned>(rate);
+        } else if (!strcmp(argv[i], "--render-rate") && i + 1 < argc) {
+            const int rate = atoi(argv[++i]);
+            if (rate <= 0)
+                throw runtime_error("--render-rate must be a positive number");
+            options.render_rate = static_cast<unsigned>(rate);
+        } else if (!strcmp(argv[i], "--catch-up")) {
+            options.missed_tick_policy = MissedTickPolicy::CatchUp;
+        } else if (!strcmp(argv[i], "--timing")) {
+            options.print_timing = true;
+        } else if (!strcmp(argv[i], "--p1-bot")) {
+            options.p1_bot = true;
+        } else if (!strcmp(argv[i], "--p2-bot")) {
+            options.p2_bot = true;
+        } else if (!strcmp(argv[i], "--players") && i + 1 < argc) {
+            const int players = atoi(argv[++i]);
+            if (players < 2 || players > static_cast<int>(MAX_PLAYERS))
+                throw runtime_error("--players must be between 2 and " + std::to_string(MAX_PLAYERS));
+            options.players = static_cast<std::size_t>(players);
+        } else if (!strcmp(argv[i], "--humans") && i + 1 < argc) {
+            const int humans = atoi(argv[++i]);
+            if (humans < 0 || humans > 4)
+                throw runtime_error("--humans must be between 0 and 4");
+            options.humans = static_cast<std::size_t>(humans);
+        } else if (!strcmp(argv[i], "--arena") && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &options.arena_width, &options.arena_height) != 2 ||
+                options.arena_width < 8 || options.arena_height < 8 || options.arena_width > (1 << 30) || options.arena_height > (1 << 30))
+                throw runtime_error("--arena must be WIDTHxHEIGHT, each 8 to 2^30");
+        } else if (!strcmp(argv[i], "--follow") && i + 1 < argc) {
+            const int follow = atoi(argv[++i]);
+            if (follow < 1 || follow > static_cast<int>(MAX_PLAYERS))
+                throw runtime_error("--follow must be a player number");
+            options.follow = static_cast<std::size_t>(follow - 1);
+        } else if (!strcmp(argv[i], "--ansi")) {
+            options.output = OutputBackend::Ansi;
+        } else if (!strcmp(argv[i], "--hud")) {
+            options.hud = true;
+        } else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+            options.trace_path = argv[++i];
+        } else if (!strcmp(argv[i], "--record") && i + 1 < argc) {
+            options.record_path = argv[++i];
+        } else if (!strcmp(argv[i], "--no-record")) {
+            options.record_path.clear();
+        } else if (!strcmp(argv[i], "--history") && i + 1 < argc) {
+            options.history_path = argv[++i];
+        } else if (!strcmp(argv[i], "--no-history")) {
+            options.history_path.clear();
+        } else if (!strcmp(argv[i], "--food") && i + 1 < argc) {
+            const int food = atoi(argv[++i]);
+            if (food <= 0)
+                throw runtime_error("--food must be a positive number of pellets");
+            options.food = static_cast<std::size_t>(food);
+        } else if (!strcmp(argv[i], "--replay") && i + 1 < argc) {
+            options.replay_path = argv[++i];
+        } else if (!strcmp(argv[i], "--host") && i + 1 < argc) {
+            options.host_address = argv[++i];
+        } else if (!strcmp(argv[i], "--join") && i + 1 < argc) {
+            options.join_address = argv[++i];
+        } else if (!strcmp(argv[i], "--broadcast") && i + 1 < argc) {
+            options.broadcast_name = argv[++i];
+        } else if (!strcmp(argv[i], "--spectate") && i + 1 < argc) {
+            options.spectate_name = argv[++i];
+        } else if (!strcmp(argv[i], "--serve") && i + 1 < argc) {
+            options.serve_address = argv[++i];
+        } else if (!strcmp(argv[i], "--board") && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &options.serve_width, &options.serve_height) != 2 ||
+                options.serve_width < 8 || options.serve_height < 8 || options.serve_width > 4096 || options.serve_height > 4096)
+                throw runtime_error("--board must be WIDTHxHEIGHT, each 8 to 4096");
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            const int threads = atoi(argv[++i]);
+            if (threads <= 0)
+                throw runtime_error("--threads must be a positive number");
+            options.serve_threads = static_cast<std::size_t>(threads);
+        } else if (!strcmp(argv[i], "--bot-budget") && i + 1 < argc) {
+            const int budget = atoi(argv[++i]);
+            if (budget <= 0)
+                throw runtime_error("--bot-budget must be a positive number of microseconds");
+            options.bot_budget = std::chrono::microseconds(budget);
+        } else {
+            throw runtime_error(std::string("unknown argument: ") + argv[i]);
+        }
+    }
+    if (!options.host_address.empty() && !options.join_address.empty())
+        throw runtime_error("--host and --join can't be used together");
+    if (!PROFILING && (options.hud || !options.trace_path.empty()))
+        throw runtime_error("--hud and --trace need a profiling build (make profile)");
+    if (PROFILING && options.render_rate > 0)
+        throw runtime_error("--render-rate can't be used in a profiling build, the profiler times a single thread");
+    if (PROFILING && !options.serve_address.empty())
+        throw runtime_error("--serve can't be used in a profiling build, the profiler times a single thread");
+    if (options.render_rate > 0 && (options.arena_width > 0 || !options.host_address.empty() || !options.join_address.empty()))
+        throw runtime_error("--render-rate can't be used in an arena or remotely");
+    if (options.follow >= options.players)
+        throw runtime_error("--follow must be a player number up to --players");
+    if (options.arena_width > 0 && (!options.replay_path.empty() || !options.host_address.empty() || !options.join_address.empty()))
+        throw runtime_error("arenas can't be replayed or played remotely");
+    if (!options.broadcast_name.empty() && (options.arena_width > 0 || !options.spectate_name.empty()))
+        throw runtime_error("--broadcast can't be used in an arena or while spectating");
+    if (!options.spectate_name.empty() && (options.arena_width > 0 || !options.replay_path.empty() || !options.host_address.empty() || !options.join_address.empty()))
+        throw runtime_error("--spectate only watches, it can't be combined with an arena, a replay or remote play");
+    if (options.food > 0 && (options.arena_width > 0 || !options.replay_path.empty() || !options.host_address.empty() || !options.join_address.empty() ||
+                             !options.broadcast_name.empty() || !options.spectate_name.empty()))
+        throw runtime_error("--food can't be used in an arena, a replay, remote play or a broadcast");
+    if (!options.serve_address.empty() && (options.arena_width > 0 || !options.replay_path.empty() || !options.host_address.empty() ||
+                                           !options.join_address.empty() || !options.broadcast_name.empty() || !options.spectate_name.empty() ||
+                                           options.food > 0 || options.render_rate > 0))
+        throw runtime_error("--serve only hosts matches, it can't be combined with an arena, a replay, --host, --join, --food or spectating");
+    if (options.players != 2 && (!options.serve_address.empty() || !options.replay_path.empty() || !options.host_address.empty() || !options.join_address.empty()))
+        throw runtime_error("replays and remote play are 2 player only");
+    return options;
+}
+
+volatile std::sig_atomic_t stop_serving = 0;
+
+void on_stop_signal(int) {
+    stop_serving = 1;
+}
+
+// --serve: hosts matches until SIGINT or SIGTERM, with a line of stats every SERVE_REPORT_PERIOD
+constexpr std::chrono::seconds SERVE_REPORT_PERIOD{ 10 };
+
+int serve(GameOptions const& options) {
+    ServerConfig config;
+    config.address = options.serve_address;
+    config.width = options.serve_width;
+    config.height = options.serve_height;
+    config.tick_rate = options.tick_rate;
+    config.threads = options.serve_threads;
+    config.bot = options.p1_bot ? BotKind::FloodFill : BotKind::Random;
+    config.bot_budget = options.bot_budget;
+    GameServer server(config);
+    std::signal(SIGINT, on_stop_signal);
+    std::signal(SIGTERM, on_stop_signal);
+    std::signal(SIGPIPE, SIG_IGN);
+    fprintf(stderr, "snake: serving %dx%d matches at %u ticks/s on %s with %zu workers, join with snake.o --join %s\n",
+        config.width, config.height, config.tick_rate, config.address.c_str(), server.get_threads(), config.address.c_str());
+
+    ServerStats total;
+    auto last_report = std::chrono::steady_clock::now();
+    while (!stop_serving) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (std::chrono::steady_clock::now() - last_report < SERVE_REPORT_PERIOD)
+            continue;
+        last_report = std::chrono::steady_clock::now();
+        const ServerStats window = server.take_stats();
+        fprintf(stderr, "snake: %zu sessions, %lu ticks, %lu deadline misses (%.2f%%), p99 tick latency %.1fus\n",
+            window.sessions, window.ticks, window.missed + window.skipped, window.miss_rate(), window.tick_latency.percentile_ns(99) / 1000.0);
+        if (options.print_timing)
+            window.print(stderr);
+        total.merge(window);
+    }
+    total.merge(server.take_stats());
+    total.sessions = server.get_sessions();
+    total.print(stderr);
+    return 0;
+}
+
+}
+
+int main(int argc, char** argv) {
+    GameOptions options;
+    try {
+        options = parse_options(argc, argv);
+    } catch (const exception& err) {
+        fprintf(stderr, "snake: %s\n", err.what());
+        fprintf(stderr, "usage: snake.o [--tick-rate N] [--render-rate N] [--catch-up] [--timing] [--p1-bot] [--p2-bot] [--bot-budget US]\n"
+                        "                [--players N] [--humans K] [--arena WxH] [--follow N] [--food N] [--ansi] [--hud]\n"
+                        "                [--trace FILE] [--record FILE | --no-record] [--history FILE | --no-history] [--replay FILE]\n"
+                        "                [--host ADDRESS | --join ADDRESS] [--broadcast NAME | --spectate NAME]\n"
+                        "       snake.o --serve ADDRESS [--board WxH] [--threads N] [--tick-rate N] [--p1-bot] [--bot-budget US] [--timing]\n");
+        return -1;
+    }
     try {
-        Game game;
+        if (!options.serve_address.empty())
+            return serve(options);
+        Game game(options);
         game.play();
-    } catch (const exception&) {
+    } catch (const exception& err) {
+        // the game has ended curses by now
+        fprintf(stderr, "snake: %s\n", err.what());
         return -1;
     }
     return 0;
-}
\ No newline at end of file
+}
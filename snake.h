@@ -1,217 +1,75 @@
 #ifndef SNAKE_H
 #define SNAKE_H
 
+#include "bots.h"
+#include "broadcast.h"
+#include "history.h"
+#include "input_queue.h"
+#include "netplay.h"
+#include "profiler.h"
+#include "reactor.h"
+#include "replay.h"
+#include "scheduler.h"
+#include "screen.h"
+#include "simulation.h"
+#include "snapshot.h"
 #include <algorithm>
+#include <array>
 #include <atomic>
-#include <cctype>
 #include <chrono>
-#include <deque>
-#include <future>
-#include <map>
+#include <cstring>
 #include <memory>
-#include <mutex>
 #include <ncurses.h>
-#include <shared_mutex>
 #include <stdexcept>
 #include <string>
 #include <thread>
 #include <vector>
 
-using std::shared_ptr;
-using std::make_shared;
-using std::shared_mutex;
-using std::shared_lock;
-using std::unique_lock;
 using std::exception;
 using std::exception_ptr;
 using std::current_exception;
 using std::rethrow_exception;
 using std::runtime_error;
 using std::to_string;
-using std::find;
 using std::vector;
 
 namespace snake {
 
-inline constexpr int NO_WINNER = -1;
-inline constexpr int DRAW      =  0;
-inline constexpr int PLAYER1   =  1;
-inline constexpr int PLAYER2   =  2;
-inline constexpr unsigned FRAMES_PER_SECOND = 20;
-
-using Scoreboard = std::map<int, int>;
-
-enum class Direction {
-    None, Up, Down, Left, Right
-};
-
-Direction get_opposite(Direction dir) {
-    if (dir == Direction::Up) return Direction::Down;
-    else if (dir == Direction::Down) return Direction::Up;
-    else if (dir == Direction::Left) return Direction::Right;
-    else if (dir == Direction::Right) return Direction::Left;
-    else return Direction::None;
-}
-
-struct Coordinates {
-    int x, y;
-    friend bool operator==(Coordinates const& lhs, Coordinates const& rhs);
-    bool operator<(Coordinates const& rhs) {
-        if (y != rhs.y) return y < rhs.y;
-        else return x < rhs.x;
-    }
-};
-
-using CoordinatesQueue = std::deque<Coordinates>;
-
-bool operator==(Coordinates const& lhs, Coordinates const& rhs){
-    if ((lhs.x == rhs.x) && (lhs.y == rhs.y)) {
-        return true;
-    }
-    return false;
-}
-
-class Snake {
-    CoordinatesQueue snake_body;
-    Direction current_dir, next_dir;
-    mutable shared_mutex direction_mutex;
-    int length;
-
-    Coordinates get_next_pos() {
-        unique_lock ulock(direction_mutex); // only one current_dir writer allowed
-        current_dir = next_dir;
-        auto next_pos = get_head();
-        switch (current_dir) {
-            case Direction::Up:
-                next_pos.y --;
-                break;
-            case Direction::Down:
-                next_pos.y ++;
-                break;
-            case Direction::Left:
-                next_pos.x --;
-                break;
-            case Direction::Right:
-                next_pos.x ++;
-                break;
-            default:
-                // do nothing (don't move)
-                break;
-        }
-        return next_pos;
-    }
-
-public:
-    Snake(Coordinates start_pos, Direction start_dir, int len) :length(len), current_dir(start_dir), next_dir(start_dir) {
-        snake_body.push_front(start_pos);
-    }
-
-    Coordinates const& get_head() const {
-        return snake_body.front();
-    }
-
-    CoordinatesQueue const& get_body() const {
-        // body includes head
-        return snake_body;
-    }
-
-    void change_direction(Direction next) {
-        shared_lock slock(direction_mutex); // multiple current_dir readers allowed
-        if (next != get_opposite(current_dir)) { 
-            next_dir = next;
-            // splitting direction into current and next prevents the user pressing very quickly
-            // and changing direction twice so that the snake turns in on itself and crashes in 1 move
-        }
-    }
-
-    void move() { // does not increase length of snake
-        if(snake_body.size() == length) {
-            snake_body.pop_back();
-        }
-        snake_body.push_front(get_next_pos());
-    }
-
-    void move(int const frames_elapsed) {// increases length of snake
-        if ((frames_elapsed % (2*FRAMES_PER_SECOND)) == 0) {
-            // 2 * 20fps, every 2 seconds increase length by 1
-            ++length;
-        }
-        move(); // move the snake like usual
-    }
-};
-
-class Player {
-    int identifier; // Player 1, Player 2 etc.
-    Snake my_snake;
-    int key_up, key_down, key_left, key_right;
-
-public:
-    Player(
-        int num,
-        Coordinates snake_start_pos,
-        Direction snake_start_dir,
-        int up,
-        int down,
-        int left,
-        int right,
-        int snake_len = 10
-        ) :
-        identifier(num),
-        my_snake(snake_start_pos, snake_start_dir, snake_len),
-        key_up(up),
-        key_down(down),
-        key_left(left),
-        key_right(right) 
-    {}
-    
-    void handle_key_press(int const input_ch) {
-        if(input_ch == key_up || input_ch == toupper(key_up)) {
-            my_snake.change_direction(Direction::Up);
-        } else if (input_ch == key_down || input_ch == toupper(key_down)) {
-            my_snake.change_direction(Direction::Down);
-        } else if (input_ch == key_left || input_ch == toupper(key_left)) {
-            my_snake.change_direction(Direction::Left);
-        } else if (input_ch == key_right || input_ch == toupper(key_right)) {
-            my_snake.change_direction(Direction::Right);
-        }
-    }
-
-    CoordinatesQueue const& update() {
-        my_snake.move();
-        return my_snake.get_body();
-    }
-
-    CoordinatesQueue const& update(int const frames_elapsed) {
-        my_snake.move(frames_elapsed);
-        return my_snake.get_body();
-    }
-
-    int id() const {
-        return identifier;
-    }
-};
-
 class GameWindow
 {
     Coordinates player1_start, player2_start;
     int initial_height, initial_width;
-    std::thread input_thread;
-    inline static std::atomic<bool> read_usr_input;
-    std::future<int> last_char_typed_f;
-    shared_ptr<Player> player_1, player_2;
+    int board_width, board_height; // the cells drawn on screen: the whole board, or the viewport into an arena
+    Coordinates camera; // board position of the top left screen cell, only moves in an arena
+    bool follow_camera; // arena only
+    std::size_t camera_target; // index of the player the camera follows
+    SpscQueue<KeyEvent, 64> key_events; // read from the keyboard, not yet sorted into turns by the game loop
+    Screen output; // everything is drawn through it, by ncurses or as ansi sequences
     vector<Coordinates> collision_pos;
+    vector<std::uint8_t> drawn_cells; // color pair last drawn in each cell, UNKNOWN_COLOR_PAIR if not known
+    unsigned frames_since_repaint;
+    int hud_length; // characters of the last render_hud()
+    static const unsigned FULL_REPAINT_INTERVAL = 10 * FRAMES_PER_SECOND; // repaint everything every 10 seconds
+    static const int UNKNOWN_COLOR_PAIR = 0;
     static const int P1_COLOR_PAIR = 1;
     static const int P2_COLOR_PAIR = 2;
     static const int BACKGROUND_COLOR_PAIR = 3;
     static const int BORDER_COLOR_PAIR = 4;
     static const int COLLISION_COLOR_PAIR = 5;
     static const int ERROR_COLOR_PAIR = 6;
+    static const int P3_COLOR_PAIR = 7; // players 3 to MAX_PLAYERS follow on
+    static const int FOOD_COLOR_PAIR = P3_COLOR_PAIR + MAX_PLAYERS - 2;
+    std::array<char, FOOD_COLOR_PAIR + 1> pair_glyphs; // drawn in each cell of that color pair
+    std::array<std::string, MAX_PLAYERS> player_names;
 
-    GameWindow() : player_1(nullptr), player_2(nullptr) {
+    GameWindow() : camera{ 0, 0 }, follow_camera(false), camera_target(0), frames_since_repaint(0), hud_length(0) {
         // Initalize curses
         initscr(); // start curses mode
         cbreak(); // disable line buffering
         keypad(stdscr, TRUE); // allow arrow & fn keys
+        nodelay(stdscr, TRUE); // keys are read when poll() says there are some, wgetch must not wait for more
+        typeahead(-1); // wrefresh must not read keys into ncurses' buffer behind poll()'s back
+        set_escdelay(25); // nor wait long for the rest of an escape sequence
         noecho(); // turn off echoing
         curs_set(0); // hide the cursor
 
@@ -219,16 +77,21 @@ class GameWindow
         if (has_colors() == FALSE) 
             throw runtime_error("Your terminal does not support color");
         start_color();
-        init_pair(P1_COLOR_PAIR, COLOR_GREEN, COLOR_GREEN); // (index, foreground, background)
-        init_pair(P2_COLOR_PAIR, COLOR_BLUE, COLOR_BLUE);
-        init_pair(BACKGROUND_COLOR_PAIR, COLOR_WHITE, COLOR_BLACK);
-        init_pair(BORDER_COLOR_PAIR, COLOR_BLACK, COLOR_WHITE);
-        init_pair(COLLISION_COLOR_PAIR, COLOR_WHITE, COLOR_RED);
-        init_pair(ERROR_COLOR_PAIR, COLOR_WHITE, COLOR_RED);
+        output.define_pair(P1_COLOR_PAIR, COLOR_GREEN, COLOR_GREEN); // (index, foreground, background)
+        output.define_pair(P2_COLOR_PAIR, COLOR_BLUE, COLOR_BLUE);
+        output.define_pair(BACKGROUND_COLOR_PAIR, COLOR_WHITE, COLOR_BLACK);
+        output.define_pair(BORDER_COLOR_PAIR, COLOR_BLACK, COLOR_WHITE);
+        output.define_pair(COLLISION_COLOR_PAIR, COLOR_WHITE, COLOR_RED);
+        output.define_pair(ERROR_COLOR_PAIR, COLOR_WHITE, COLOR_RED);
+        init_player_styles();
+        output.define_pair(FOOD_COLOR_PAIR, COLOR_RED, COLOR_BLACK);
+        pair_glyphs[FOOD_COLOR_PAIR] = '*';
         wbkgd(stdscr, COLOR_PAIR(BACKGROUND_COLOR_PAIR)); // set window to background color
 
         // Calculate player 1 & 2 starting pos + playable area dimensions
         calculate_starting_positions();
+        forget_drawn_cells();
+        collision_pos.reserve(MAX_PLAYERS); // so copying a simulation's collisions never allocates
     };
 
     GameWindow(const GameWindow&) = delete;
@@ -237,42 +100,109 @@ class GameWindow
     GameWindow& operator=(GameWindow&&) = delete;
 
     ~GameWindow() {
-        read_usr_input.store(false); // if true, thread will never join
-        if (input_thread.joinable())
-            input_thread.detach(); // detach is used over join because join will wait for a final key press
         endwin(); // end curses mode
     }
 
-    void input_handler(std::promise<int>&& final_ch_promise) const {
-        /*
-        Originally each player had its own input_handler & input_thread. 
-        However, ncurses is not thread safe, and calling wgetch() from 
-        multiple threads led to weird results. Therefore, I moved input 
-        handling into the GameWindow class.
-        */
-        int ch;
-        while (read_usr_input.load()) {
-            ch = wgetch(stdscr);
-            player_1->handle_key_press(ch);
-            player_2->handle_key_press(ch);
-        }
-        final_ch_promise.set_value(ch);
-    }
-
-    void draw_border() {
-        attron(COLOR_PAIR(BORDER_COLOR_PAIR));
-        wborder(
-            stdscr, // window to draw border on
-            ' ', // left side
-            ' ', // right side
-            ' ', // top side
-            ' ', // bottom side
-            ' ', // top left corner
-            ' ', // top right corner
-            ' ', // bottom left corner
-            ' '  // bottom right corner
-        );
-        attroff(COLOR_PAIR(BORDER_COLOR_PAIR));
+    static int player_color_pair(int const id) {
+        return id == PLAYER1 ? P1_COLOR_PAIR : id == PLAYER2 ? P2_COLOR_PAIR : P3_COLOR_PAIR + id - 3;
+    }
+
+    void init_player_styles() {
+        // green & blue as before, then 3 more colors, then the same 5 again in bright colors or with a pattern
+        static const short colors[] = { COLOR_GREEN, COLOR_BLUE, COLOR_YELLOW, COLOR_MAGENTA, COLOR_CYAN };
+        static const char* const color_names[] = { "GREEN", "BLUE", "YELLOW", "MAGENTA", "CYAN" };
+        static const char patterns[] = { '#', '+', ':' };
+        const bool bright = COLORS >= 16;
+        pair_glyphs.fill(' ');
+        for (int id = 1; id <= static_cast<int>(MAX_PLAYERS); ++id) {
+            const int color = (id - 1) % 5, round = (id - 1) / 5;
+            short foreground = colors[color], background = colors[color];
+            std::string name = color_names[color];
+            if (bright && round % 2 == 1) {
+                foreground = background = static_cast<short>(colors[color] + 8);
+                name = "LIGHT " + name;
+            }
+            const int pattern = bright ? round / 2 : round; // 0 = solid
+            if (pattern > 0) {
+                foreground = COLOR_BLACK;
+                pair_glyphs[player_color_pair(id)] = patterns[pattern - 1];
+                name += std::string(" ") + patterns[pattern - 1];
+            }
+            output.define_pair(player_color_pair(id), foreground, background);
+            player_names[id - 1] = name;
+        }
+    }
+
+    int cell_color_pair(std::uint8_t const owner) const {
+        switch (owner) {
+            case CELL_EMPTY:
+                return BACKGROUND_COLOR_PAIR;
+            case CELL_BORDER:
+                return BORDER_COLOR_PAIR;
+            case CELL_FOOD:
+                return FOOD_COLOR_PAIR;
+            default:
+                return player_color_pair(owner);
+        }
+    }
+
+    Coordinates to_screen(Coordinates const& pos) const {
+        return { pos.x - camera.x, pos.y - camera.y };
+    }
+
+    void draw_cell(Coordinates const& pos, int const color_pair) {
+        // cells outside the viewport are skipped, only cells whose color actually changed are drawn
+        const Coordinates screen = to_screen(pos);
+        if (screen.x < 0 || screen.y < 0 || screen.x >= board_width || screen.y >= board_height)
+            return;
+        std::uint8_t& drawn = drawn_cells[static_cast<std::size_t>(screen.y) * board_width + screen.x];
+        if (drawn != color_pair) {
+            const char glyph = static_cast<std::size_t>(color_pair) < pair_glyphs.size() ? pair_glyphs[color_pair] : ' ';
+            output.cell(screen.y, screen.x, glyph, color_pair);
+            drawn = color_pair;
+        }
+    }
+
+    template <typename View>
+    void draw_view(View const& view, vector<Coordinates> const& collisions) {
+        collision_pos.assign(collisions.begin(), collisions.end());
+        draw_full_board(view);
+        for (Coordinates pos : collision_pos)
+            draw_cell(pos, COLLISION_COLOR_PAIR);
+    }
+
+    template <typename BoardType>
+    void draw_full_board(BoardType const& board) {
+        // O(viewport), used for the first frame, after the camera moves and periodically to repair anything
+        // drawn over the cells
+        for (int y = camera.y; y < camera.y + board_height; ++y) {
+            for (int x = camera.x; x < camera.x + board_width; ++x) {
+                draw_cell({x, y}, cell_color_pair(board.owner({x, y})));
+            }
+        }
+        frames_since_repaint = 0;
+    }
+
+    // recentres the viewport on target once it gets within a quarter of the screen of the viewport's edge,
+    // returns true if the camera moved
+    bool move_camera(Coordinates const& target, int const arena_width, int const arena_height) {
+        const int margin_x = board_width / 4, margin_y = board_height / 4;
+        const Coordinates screen = to_screen(target);
+        if (screen.x >= margin_x && screen.x < board_width - margin_x && screen.y >= margin_y && screen.y < board_height - margin_y)
+            return false;
+        const Coordinates moved{
+            std::clamp(target.x - board_width / 2, 0, std::max(arena_width - board_width, 0)),
+            std::clamp(target.y - board_height / 2, 0, std::max(arena_height - board_height, 0))
+        };
+        if (moved == camera)
+            return false;
+        camera = moved;
+        return true;
+    }
+
+    void forget_drawn_cells() {
+        // text (game over screen, errors) is drawn over cells, so after a reset nothing on screen can be trusted
+        drawn_cells.assign(static_cast<std::size_t>(board_width) * board_height, UNKNOWN_COLOR_PAIR);
     }
 
     void calculate_starting_positions() {
@@ -280,50 +210,25 @@ class GameWindow
         int max_x;
         int max_y;
         getmaxyx(stdscr, max_y, max_x); // get terminal dimensions
-        int half_y = max_y/2;
-        int quarter_x = max_x / 4;
-        int three_quarter_x = quarter_x*3;
+        board_width = max_x;
+        board_height = max_y;
+        output.resize(max_x, max_y);
+        const StartingPositions start = snake::calculate_starting_positions(max_x, max_y);
         // set player start positions
-        player1_start = {quarter_x, half_y};
-        player2_start = {three_quarter_x, half_y};
+        player1_start = start.player1_start;
+        player2_start = start.player2_start;
 
         // set initial height & width (width used to calculate starting snake length)
-        initial_height = max_y - 3; // (x axis-1) -2 [border height]
-        initial_width = max_x - 3; // (y axis-1) - 2 [border width]
-    }
-
-    bool did_player_collide(CoordinatesQueue const& player_pos, CoordinatesQueue const& other_player_pos) {
-        bool did_collide = false;
-        const Coordinates next_pos = player_pos.front();
-        const int next_square_color = mvwinch(stdscr, next_pos.y, next_pos.x) & A_COLOR;
-        
-        // check if collided with a border square
-        if (next_square_color == COLOR_PAIR(BORDER_COLOR_PAIR)) {
-            did_collide = true;
-        }
-        // check if collided with self
-        if (find(player_pos.begin()+1, player_pos.end(), next_pos) != player_pos.end()) {
-            did_collide = true;
-        }
-        // check if collided with other player
-        if (find(other_player_pos.begin(), other_player_pos.end(), next_pos) != other_player_pos.end()) {
-            did_collide = true;
-        }
-        // else player did not collide
-        if (did_collide) {
-            collision_pos.push_back(next_pos);
-        }
-        return did_collide;
+        initial_height = start.initial_height;
+        initial_width = start.initial_width;
     }
 
     void display_error(const char* msg) {
         // prints an error in red to the bottom left corner of the screen
-        attron(COLOR_PAIR(ERROR_COLOR_PAIR));
         const Coordinates btm_left = get_bottom_left();
-        std::string err_msg = "ERROR: ";
-        err_msg += msg;
-        mvwprintw(stdscr, btm_left.y, btm_left.x + 1, err_msg.c_str()); // print error to the screen
-        attroff(COLOR_PAIR(ERROR_COLOR_PAIR));
+        char err_msg[256];
+        const int length = std::snprintf(err_msg, sizeof(err_msg), "ERROR: %s", msg);
+        output.text(btm_left.y, btm_left.x + 1, err_msg, std::min(length, static_cast<int>(sizeof(err_msg)) - 1), ERROR_COLOR_PAIR); // print error to the screen
     }
 public:
     static GameWindow& get_instance() {
@@ -331,35 +236,49 @@ public:
         return single_instance;
     }
 
-    void set_players(shared_ptr<Player> p1, shared_ptr<Player> p2) {
-        player_1 = p1;
-        player_2 = p2;
-    }
-
     void start() {
-        if (player_1 == nullptr || player_2 == nullptr)
-            throw runtime_error("game_window::start called before setting players");
-
-        // start reading user keyboard input
-        read_usr_input.store(true);
-        if (!input_thread.joinable()) {
-            std::promise<int> last_char_input_p;
-            last_char_typed_f = last_char_input_p.get_future();
-            input_thread = std::thread(&GameWindow::input_handler, this, std::move(last_char_input_p));
-        }
+        // forget anything typed before the game started
+        flushinp();
+        key_events.clear();
+        nodelay(stdscr, TRUE);
     }
 
     void end() {
-        read_usr_input.store(false); // if true, thread will never join
-        if (input_thread.joinable())
-            input_thread.detach(); // detach is used over join because join will wait for a final key press
+        output.finish();
         endwin(); // end curses mode
     }
 
+    /*
+    Originally each player had its own input_handler & input_thread, and
+    later GameWindow had one thread blocking in wgetch(). Now the game loop
+    calls this whenever its EventReactor sees the keyboard is readable, so
+    ncurses is only ever used from one thread. Key presses are only
+    timestamped and queued here, the game loop decides what they mean.
+    */
+    void read_keys() {
+        int ch;
+        while ((ch = wgetch(stdscr)) != ERR)
+            key_events.try_push({ ch, std::chrono::steady_clock::now() }); // dropped if the game loop is 64 keys behind
+    }
+
+    // draw with escape sequences composed by Screen instead of through ncurses, before anything is drawn
+    void use_ansi_output() {
+        wrefresh(stdscr); // ncurses clears the screen on its first refresh, it must not come after ours
+        output.set_backend(OutputBackend::Ansi);
+        forget_drawn_cells();
+    }
+
+    OutputBackend get_output_backend() const {
+        return output.get_backend();
+    }
+
+    OutputStats const& get_output_stats() const {
+        return output.get_stats();
+    }
+
     bool play_again() {
-        read_usr_input.store(false);
-        int last_char_typed = last_char_typed_f.get();
-        input_thread.join();
+        nodelay(stdscr, FALSE); // nothing else to do until a key is pressed
+        int last_char_typed = wgetch(stdscr);
         do {
             // keep reading ignoring input until user quits or restarts game
             switch (last_char_typed) {
@@ -369,6 +288,8 @@ public:
                 case 'R':
                 case 'r':
                     return true; // restart
+                case ERR:
+                    return false; // the keyboard is gone
                 default:
                     break; // do nothing
             }
@@ -392,6 +313,29 @@ public:
         return initial_width;
     }
 
+    int get_board_width() const {
+        return board_width;
+    }
+
+    int get_board_height() const {
+        return board_height;
+    }
+
+    // draws a board of a replay's (or a broadcast's) size instead of the terminal's, it has to fit on screen
+    void fit_board(int const width, int const height) {
+        int max_x, max_y;
+        getmaxyx(stdscr, max_y, max_x); // get terminal dimensions
+        if (width > max_x || height > max_y)
+            throw runtime_error("a " + to_string(width) + "x" + to_string(height) + " board needs a bigger terminal");
+        board_width = width;
+        board_height = height;
+        forget_drawn_cells();
+    }
+
+    std::size_t get_board_area() const {
+        return body_capacity(board_width, board_height);
+    }
+
     Coordinates get_top_left() const {
         return { 0, 0 };
     }
@@ -414,123 +358,158 @@ public:
         return { max_x - 1, max_y - 1 };
     }
 
-    int update(CoordinatesQueue const& p1_pos, CoordinatesQueue const& p2_pos) {
-        // check for collisions
-        bool p1_collided = did_player_collide(p1_pos, p2_pos);
-        bool p2_collided = did_player_collide(p2_pos, p1_pos);
+    // the screen becomes a viewport into a bigger board that follows player index target
+    void follow(std::size_t const target) {
+        follow_camera = true;
+        camera_target = target;
+    }
 
-        wclear(stdscr); // clear the screen
-        draw_border(); // draw screen border
+    template <typename Config>
+    void update(BasicSimulation<Config> const& simulation) {
+        SNAKE_PROFILE_SCOPE(Phase::Draw);
+        // drawing only, the simulation has already decided who (if anyone) collided
+        collision_pos = simulation.get_collisions();
 
-        // must redraw every player position every update
-        // as wclear copies blanks to every position in the window
-        attron(COLOR_PAIR(P1_COLOR_PAIR));
-        for (Coordinates pos: p1_pos) {
-            mvwaddch(stdscr, pos.y, pos.x, ' '); // draw new p1 positions
+        const bool camera_moved = follow_camera &&
+            move_camera(simulation.get_player(camera_target).get_snake().get_head(), simulation.get_width(), simulation.get_height());
+        if (camera_moved || ++frames_since_repaint >= FULL_REPAINT_INTERVAL || simulation.get_frame_count() <= 1) {
+            draw_full_board(simulation.get_board());
+        } else {
+            // only ~2 cells per player change per tick: erase the tails that were popped, then draw the new heads
+            for (std::size_t i = 0; i < simulation.get_player_count(); ++i) {
+                const SnakeMove move = simulation.get_move(i);
+                if (move.tail_popped)
+                    draw_cell(move.tail, BACKGROUND_COLOR_PAIR);
+            }
+            for (std::size_t i = 0; i < simulation.get_player_count(); ++i) {
+                const Coordinates head = simulation.get_move(i).head;
+                draw_cell(head, cell_color_pair(simulation.get_board().owner(head)));
+            }
         }
-        attroff(COLOR_PAIR(P1_COLOR_PAIR));
-        attron(COLOR_PAIR(P2_COLOR_PAIR));
-        for (Coordinates pos: p2_pos) {
-            mvwaddch(stdscr, pos.y, pos.x, ' '); // draw new p2 positions
+        // a handful of pellets, only those just spawned are actually drawn
+        for (Coordinates pos : simulation.get_food())
+            draw_cell(pos, FOOD_COLOR_PAIR);
+
+        // draw collisions
+        for (Coordinates pos : collision_pos) {
+            draw_cell(pos, COLLISION_COLOR_PAIR); // draw collision square red
         }
-        attroff(COLOR_PAIR(P2_COLOR_PAIR));
+    }
 
-        // draw collision and return winner if a player collided
-        if (p1_collided || p2_collided) {
-            for (Coordinates pos : collision_pos) {
-                attron(COLOR_PAIR(COLLISION_COLOR_PAIR));
-                mvwaddch(stdscr, pos.y, pos.x, ' '); // draw collision square red
-                attroff(COLOR_PAIR(COLLISION_COLOR_PAIR));
-            }
+    // draws a snapshot published by a simulation on another thread: every cell is compared with what is on screen,
+    // so it doesn't matter how many ticks went by since the last snapshot drawn
+    void update(FrameSnapshot const& snapshot) {
+        draw_view(snapshot, snapshot.collisions);
+    }
 
-            if (p1_collided && p2_collided) {
-                return 0; // draw
-            } else if (p1_collided && !p2_collided) {
-                return 2; // p1 lost, winner is p2
-            } else if (p2_collided && !p1_collided) {
-                return 1; // p2 lost, winner is p1
-            }
-        }
-        return -1; // no winner yet
+    // draws another process' game as its broadcast has it, the same way
+    void update(BroadcastReader const& feed) {
+        draw_view(feed, feed.get_collisions());
     }
 
     void render() {
-        wrefresh(stdscr);
+        SNAKE_PROFILE_SCOPE(Phase::Refresh);
+        output.flush();
+    }
+
+    // a line of text over the bottom row of the board, redrawn every frame
+    void render_hud(const char* text) {
+        const int y = board_height - 1;
+        const int length = std::min(static_cast<int>(std::strlen(text)), board_width - 2);
+        output.text(y, 1, text, length, BORDER_COLOR_PAIR);
+        for (int x = length + 1; x <= hud_length; ++x)
+            output.cell(y, x, ' ', BORDER_COLOR_PAIR); // the end of a longer previous line
+        // whatever the text covers has to be drawn again when the board is next repainted
+        for (int x = 1; x <= std::max(length, hud_length); ++x)
+            drawn_cells[static_cast<std::size_t>(y) * board_width + x] = UNKNOWN_COLOR_PAIR;
+        hud_length = length;
     }
 
-    void render_game_over_screen(int winner, Scoreboard score, exception_ptr except_ptr = nullptr) {
-        std::string winner_text;
+    // the next update() checks every cell, for when the simulation jumped rather than stepped (rollback)
+    void repaint() {
+        frames_since_repaint = FULL_REPAINT_INTERVAL;
+    }
+
+    void render_message(std::string const& text) {
+        output.text(0, 1, text, BORDER_COLOR_PAIR);
+        output.flush();
+    }
+
+    // called by the game loop, returns false once every queued key press has been read
+    bool next_key_event(KeyEvent& event) {
+        return key_events.try_pop(event);
+    }
+
+    void render_game_over_screen(int winner, Scoreboard const& score, exception_ptr except_ptr = nullptr, MatchTotals const* lifetime = nullptr) {
+        // fixed buffers, the end of a match doesn't allocate either
+        char winner_text[64];
         switch (winner) {
-            case 2:
-                winner_text = "BLUE WON!";
-                break;
-            case 1:
-                winner_text = "GREEN WON!";
-                 break;
             case 0:
-                winner_text = "IT WAS A DRAW!";
+                std::snprintf(winner_text, sizeof(winner_text), "IT WAS A DRAW!");
+                break;
+            case NO_WINNER:
+                std::snprintf(winner_text, sizeof(winner_text), "THE GAME ENDED WITH NO WINNER.");
                 break;
             default:
-                winner_text = "THE GAME ENDED WITH NO WINNER.";
+                std::snprintf(winner_text, sizeof(winner_text), "%s WON!", player_names[winner - 1].c_str());
                 break;
         }
-        std::string helper_text = "PRESS 'r' TO RESTART, PRESS 'q' TO QUIT";
-        std::string scoreboard_text = 
-            "SCOREBOARD: GREEN " + to_string(score.at(PLAYER1)) + ", BLUE " + to_string(score.at(PLAYER2));
+        static const char helper_text[] = "PRESS 'r' TO RESTART, PRESS 'q' TO QUIT";
+        // every player up to 4, beyond that only the ones who won something so it fits on one line
+        const std::size_t player_count = score.size() - 2; // minus no winner & draw
+        char scoreboard_text[512];
+        int scoreboard_length = std::snprintf(scoreboard_text, sizeof(scoreboard_text), "SCOREBOARD:");
+        const auto append_score = [&](const char* name, int const points) {
+            const std::size_t room = sizeof(scoreboard_text) - scoreboard_length;
+            const int written = std::snprintf(scoreboard_text + scoreboard_length, room, "%s%s %d",
+                scoreboard_text[scoreboard_length - 1] == ':' ? " " : ", ", name, points);
+            scoreboard_length = std::min(scoreboard_length + written, static_cast<int>(sizeof(scoreboard_text)) - 1);
+        };
+        for (int id = 1; id <= static_cast<int>(player_count); ++id) {
+            if (player_count <= 4 || score.at(id) > 0)
+                append_score(player_names[id - 1].c_str(), score.at(id));
+        }
         if (score.at(DRAW) > 0)
-            scoreboard_text += ", DRAW " + to_string(score.at(DRAW));
+            append_score("DRAW", score.at(DRAW));
+        // every match ever logged, the same players as the scoreboard, unless an error needs the corner
+        char lifetime_text[512];
+        int lifetime_length = 0;
+        if (lifetime != nullptr && except_ptr == nullptr) {
+            lifetime_length = std::snprintf(lifetime_text, sizeof(lifetime_text), "LIFETIME %llu GAMES:", static_cast<unsigned long long>(lifetime->matches));
+            for (std::size_t id = 1; id <= player_count && lifetime_length < static_cast<int>(sizeof(lifetime_text)) - 1; ++id) {
+                if (player_count <= 4 || lifetime->wins[id - 1] > 0)
+                    lifetime_length += std::snprintf(lifetime_text + lifetime_length, sizeof(lifetime_text) - lifetime_length, "%s%s %llu",
+                        lifetime_text[lifetime_length - 1] == ':' ? " " : ", ", player_names[id - 1].c_str(), static_cast<unsigned long long>(lifetime->wins[id - 1]));
+            }
+            if (lifetime->draws > 0 && lifetime_length < static_cast<int>(sizeof(lifetime_text)) - 1)
+                lifetime_length += std::snprintf(lifetime_text + lifetime_length, sizeof(lifetime_text) - lifetime_length, ", DRAW %llu", static_cast<unsigned long long>(lifetime->draws));
+            lifetime_length = std::min(lifetime_length, static_cast<int>(sizeof(lifetime_text)) - 1);
+        }
 
+        const int text_lengths[] = { static_cast<int>(std::strlen(winner_text)), static_cast<int>(sizeof(helper_text)) - 1, scoreboard_length, lifetime_length };
         Coordinates winner_text_pos = get_top_left(); // top left corner
         winner_text_pos.x++;
         Coordinates helper_text_pos = get_bottom_right(); // bottom right corner
-        helper_text_pos.x-=helper_text.length();
+        helper_text_pos.x -= text_lengths[1];
         Coordinates scoreboard_text_pos = get_top_right(); // top right corner
-        scoreboard_text_pos.x-=scoreboard_text.length();
+        scoreboard_text_pos.x -= text_lengths[2];
+        Coordinates lifetime_text_pos = get_bottom_left(); // bottom left corner
+        lifetime_text_pos.x++;
 
         // print text to the corners of the screen
-        attron(COLOR_PAIR(BORDER_COLOR_PAIR));
-        mvwprintw(stdscr, winner_text_pos.y, winner_text_pos.x, winner_text.c_str());
-        mvwprintw(stdscr, helper_text_pos.y, helper_text_pos.x, helper_text.c_str());
-        mvwprintw(stdscr, scoreboard_text_pos.y, scoreboard_text_pos.x, scoreboard_text.c_str());
-        attroff(COLOR_PAIR(BORDER_COLOR_PAIR));
+        const char* const texts[] = { winner_text, helper_text, scoreboard_text, lifetime_text };
+        const Coordinates text_positions[] = { winner_text_pos, helper_text_pos, scoreboard_text_pos, lifetime_text_pos };
+        const int text_count = lifetime_length > 0 ? 4 : 3;
+        for (int t = 0; t < text_count; ++t)
+            output.text(text_positions[t].y, text_positions[t].x, texts[t], text_lengths[t], BORDER_COLOR_PAIR);
 
         // check for text overlapping with a collision in the border and change its color if appropriate
-        for (Coordinates collision : collision_pos) {
-            // check for overlap with the winner text
-            if (collision.y == winner_text_pos.y) {
-                for(int i=0; i< winner_text.length(); i++) {
-                    int x = winner_text_pos.x + i;
-                    if (x == collision.x) {
-                        char overlapping_ch = winner_text.at(i);
-                        attron(COLOR_PAIR(COLLISION_COLOR_PAIR));
-                        mvwaddch(stdscr, winner_text_pos.y, x, overlapping_ch);
-                        attroff(COLOR_PAIR(COLLISION_COLOR_PAIR));
-                    }
-                }
-            }
-            // check for overlap with helper text
-            if (collision.y == helper_text_pos.y) {
-                for(int i=0; i< helper_text.length(); i++) {
-                    int x = helper_text_pos.x + i;
-                    if (x == collision.x) {
-                        char overlapping_ch = helper_text.at(i);
-                        attron(COLOR_PAIR(COLLISION_COLOR_PAIR));
-                        mvwaddch(stdscr, helper_text_pos.y, x, overlapping_ch);
-                        attroff(COLOR_PAIR(COLLISION_COLOR_PAIR));
-                    }
-                }
-            }
-            // check for overlap with scoreboard text
-            if (collision.y == scoreboard_text_pos.y) {
-                for(int i=0; i< scoreboard_text.length(); i++) {
-                    int x = scoreboard_text_pos.x + i;
-                    if (x == collision.x) {
-                        char overlapping_ch = scoreboard_text.at(i);
-                        attron(COLOR_PAIR(COLLISION_COLOR_PAIR));
-                        mvwaddch(stdscr, scoreboard_text_pos.y, x, overlapping_ch);
-                        attroff(COLOR_PAIR(COLLISION_COLOR_PAIR));
-                    }
-                }
+        for (Coordinates const& collision_cell : collision_pos) {
+            const Coordinates collision = to_screen(collision_cell);
+            for (int t = 0; t < text_count; ++t) {
+                const int i = collision.x - text_positions[t].x;
+                if (collision.y == text_positions[t].y && i >= 0 && i < text_lengths[t])
+                    output.cell(collision.y, collision.x, texts[t][i], COLLISION_COLOR_PAIR);
             }
         }
 
@@ -542,121 +521,661 @@ public:
                 display_error(err.what());
             }
         }
-        wrefresh(stdscr); // refresh the window
+        output.flush(); // refresh the window
     }
 
     void reset() {
         collision_pos.clear(); // reset saved collision info
+        camera = { 0, 0 };
+        follow_camera = false;
+        hud_length = 0;
         calculate_starting_positions(); // re-calculate start pos
+        forget_drawn_cells(); // next update repaints the whole board
     }
 };
 
+struct GameOptions {
+    unsigned tick_rate = FRAMES_PER_SECOND; // simulation ticks per second
+    MissedTickPolicy missed_tick_policy = MissedTickPolicy::Skip;
+    bool print_timing = false; // print frame timing telemetry to stderr when the game ends
+    bool p1_bot = false, p2_bot = false; // let a FloodFillBot steer instead of the keyboard
+    std::size_t players = 2; // snakes on the board, 2 to MAX_PLAYERS
+    std::size_t humans = 2; // players after the first `humans` are always bots, at most 4 share the keyboard
+    int arena_width = 0, arena_height = 0; // 0 = the board is the terminal, otherwise the terminal is a viewport into it
+    std::size_t follow = 0; // index of the player the viewport follows in an arena
+    unsigned render_rate = 0; // frames drawn per second by the game loop while the simulation ticks on its own thread, 0 = draw every tick
+    OutputBackend output = OutputBackend::Ncurses; // --ansi composes each frame itself and writes it in one go
+    bool hud = false; // profiling builds: frame time percentiles in the bottom row
+    std::string trace_path; // profiling builds: Chrome trace of the last frames written here at exit
+    std::chrono::microseconds bot_budget = std::chrono::microseconds(1000); // per bot decision
+    std::string record_path = "snake_replays.bin"; // every finished game is appended here, empty = don't record
+    std::string replay_path; // watch the games in this archive instead of playing
+    std::string history_path = "snake_history.bin"; // every finished match is logged here for lifetime totals, empty = no history
+    std::size_t food = 0; // pellets on the board, snakes grow by eating them rather than every 2 seconds, 0 = no food
+    std::string host_address, join_address; // play green against a remote blue / blue against a remote green
+    std::string broadcast_name; // every tick is published to this shared memory feed for spectators, empty = none
+    std::string spectate_name; // draw the game another snake.o broadcasts under this name instead of playing
+    std::string serve_address; // host a match against a bot for everyone who joins here, with no terminal
+    int serve_width = 80, serve_height = 24; // --serve: the board every match is played on
+    std::size_t serve_threads = 0; // --serve: workers ticking the matches, 0 = one per core
+};
+
 class Game {
+    GameOptions options;
     GameWindow& game_window;
-    shared_ptr<Player> player_1;
-    shared_ptr<Player> player_2;
+    MatchArena match_arena; // the players of a terminal sized match, given back in bulk by reset()
+    vector<shared_ptr<Player>> players;
+    Simulation simulation;
+    std::unique_ptr<ArenaSimulation> arena; // set when playing on an arena bigger than the terminal, used instead of simulation
+    FixedTimestepScheduler scheduler;
+    EventReactor reactor; // the keyboard & the tick timer
+    vector<TurnBuffer> turns; // one per player
+    vector<FloodFillBot> ais; // one per player, only used by bots
+    vector<Direction> commands; // this tick's, one per player
+    ReplayRecorder recorder;
+    std::unique_ptr<ReplayPlayer> replay; // set while watching a replay, commands come from it instead of the keyboard
+    // remote play, set once connected: the opponent's commands arrive through the session
+    std::unique_ptr<SocketTransport> connection;
+    std::unique_ptr<RollbackSession<SocketTransport>> session;
+    int local_player;
+    NetHello net_board; // the host's board, both sides play on it
+    vector<std::pair<Direction, Direction>> confirmed_commands; // this match so far, recorded once it is over
+    std::unique_ptr<BroadcastWriter> broadcast; // --broadcast
+    std::unique_ptr<BroadcastReader> spectating; // --spectate
+    std::unique_ptr<MatchHistory> history; // every finished match that was played, not watched
+    unsigned long rollbacks_drawn;
+    // key press timestamps of turns applied since the last render, for key to screen latency
+    AppliedTurns applied_turns;
+    std::size_t applied_turn_count;
+    LatencyHistogram key_to_screen;
+    // --render-rate: the simulation runs on its own thread and publishes a snapshot of every frame for the game loop
+    TripleBuffer<FrameSnapshot> snapshots;
+    std::uint64_t snapshots_published;
+    std::atomic<bool> stop_simulation; // set by the game loop if it has to leave before the game is over
+    exception_ptr simulation_error;
+    RenderStats render_stats;
     Scoreboard scoreboard;
     bool game_over, play_again, started;
     int winner; // -1 = none, 0 = draw, 1 = player_1, 2 = player_2 etc.
-    unsigned long frame_count;
 
     void render() {
         if (game_over) {
-            game_window.render_game_over_screen(winner, scoreboard);
+            MatchTotals lifetime;
+            const bool loaded = history && history->lifetime_totals(lifetime); // left out rather than waited for
+            game_window.render_game_over_screen(winner, scoreboard, nullptr, loaded ? &lifetime : nullptr);
         } else {
+#ifdef SNAKE_PROFILING
+            if (options.hud) {
+                char hud[160];
+                Profiler::instance().format_hud(hud, sizeof(hud));
+                game_window.render_hud(hud);
+            }
+#endif
             game_window.render();
         }
+        // every turn applied since the last frame is now visible
+        const auto now = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < applied_turn_count; ++i)
+            key_to_screen.record(now - applied_turns[i]);
+        applied_turn_count = 0;
+    }
+
+    void read_input() {
+        SNAKE_PROFILE_SCOPE(Phase::Input);
+        // sort queued key presses into each player's pending turns
+        KeyEvent event;
+        while (game_window.next_key_event(event)) {
+            if (session) {
+                // either set of keys steers the local snake
+                Direction dir = players[0]->key_direction(event.ch);
+                if (dir == Direction::None)
+                    dir = players[1]->key_direction(event.ch);
+                turns[local_player - 1].push({ dir, event.time }, players[local_player - 1]->get_direction());
+                continue;
+            }
+            for (std::size_t i = 0; i < players.size(); ++i)
+                turns[i].push({ players[i]->key_direction(event.ch), event.time }, players[i]->get_direction());
+        }
+    }
+
+    bool is_bot(std::size_t const i) const {
+        return i >= options.humans || (i == 0 && options.p1_bot) || (i == 1 && options.p2_bot);
+    }
+
+    // wasd, arrows, ijkl & tfgh steer the first 4 players, the rest have no keys. On an arena bigger than the
+    // terminal the players start in the middle as they would on a terminal sized board. Given a MatchArena the players
+    // and their bodies are allocated from it
+    vector<shared_ptr<Player>> make_players(int const width, int const height, int const view_x = 0, int const view_y = 0, MatchArena* const from = nullptr) const {
+        static const int keys[4][4] = {
+            { 'w', 's', 'a', 'd' },
+            { KEY_UP, KEY_DOWN, KEY_LEFT, KEY_RIGHT },
+            { 'i', 'k', 'j', 'l' },
+            { 't', 'g', 'f', 'h' }
+        };
+        const int x = view_x > 0 ? std::min(view_x, width) : width, y = view_y > 0 ? std::min(view_y, height) : height;
+        const vector<StartingPosition> start = calculate_starting_positions(width, height, options.players, x, y);
+        const int length = calculate_starting_positions(x, y).initial_width / 5;
+        vector<shared_ptr<Player>> match_players;
+        for (std::size_t i = 0; i < options.players; ++i) {
+            int const* k = i < 4 ? keys[i] : nullptr;
+            match_players.push_back(make_player(from, static_cast<int>(i) + 1, start[i].pos, start[i].dir,
+                k ? k[0] : 0, k ? k[1] : 0, k ? k[2] : 0, k ? k[3] : 0, length, body_capacity(width, height)));
+        }
+        return match_players;
+    }
+
+    Direction next_turn(TurnBuffer& turns) {
+        // at most one turn per player per tick
+        TurnBuffer::Turn turn;
+        if (!turns.pop(turn))
+            return Direction::None;
+        if (applied_turn_count < applied_turns.size())
+            applied_turns[applied_turn_count++] = turn.typed;
+        return turn.dir;
+    }
+
+    bool recording() const {
+        // the archive holds 2 player games that grow on the timer
+        return !replay && !session && !arena && !options.record_path.empty() && options.players == 2 && options.food == 0;
+    }
+
+    // a remote match is recorded from its confirmed commands once it is over, re-simulated from the start
+    void record_remote_match() {
+        const StartingPositions start = calculate_starting_positions(net_board.width, net_board.height);
+        const ReplaySetup setup{ net_board.width, net_board.height, start.player1_start, start.player2_start, start.initial_width / 5, net_board.tick_rate };
+        Simulation recorded = make_replay_simulation(setup);
+        recorder.begin(setup);
+        for (auto const& commands : confirmed_commands) {
+            recorder.record_tick(recorded, commands.first, commands.second);
+            recorded.step(commands.first, commands.second);
+        }
+        append_replay(options.record_path, recorder.finish(static_cast<std::uint32_t>(recorded.get_frame_count()), recorded.get_winner()));
+    }
+
+    void update_remote() {
+        read_input();
+        session->poll();
+        if (session->can_step()) {
+            const std::size_t i = local_player - 1;
+            session->step(is_bot(i) ? ais[i].next_command(simulation, local_player) : next_turn(turns[i]));
+        }
+        Direction p1_cmd, p2_cmd;
+        while (session->pop_confirmed(p1_cmd, p2_cmd))
+            confirmed_commands.emplace_back(p1_cmd, p2_cmd);
+
+        const bool rolled_back = session->get_stats().rollbacks != rollbacks_drawn;
+        if (rolled_back) {
+            rollbacks_drawn = session->get_stats().rollbacks;
+            game_window.repaint();
+        }
+        game_window.update(simulation);
+        winner = session->confirmed_winner(); // a predicted ending may still be rolled back
+        if (winner != NO_WINNER) {
+            game_over = true;
+            ++scoreboard.at(winner);
+            if (!options.record_path.empty())
+                record_remote_match();
+            if (history)
+                history->append(summarize_match(simulation, winner));
+        }
+        if (broadcast)
+            broadcast->publish(simulation, scoreboard, winner, rolled_back); // a rollback is sent as a keyframe
+    }
+
+    template <typename SimulationType>
+    void next_commands(SimulationType const& sim) {
+        SNAKE_PROFILE_SCOPE(Phase::Bots);
+        for (std::size_t i = 0; i < commands.size(); ++i) {
+            if (!sim.is_alive(i))
+                commands[i] = Direction::None; // crashed snakes stay where they are
+            else
+                commands[i] = is_bot(i) ? ais[i].next_command(sim, static_cast<int>(i) + 1) : next_turn(turns[i]);
+        }
     }
 
     void update() {
-        CoordinatesQueue const& p1_pos = player_1->update(frame_count);
-        CoordinatesQueue const& p2_pos = player_2->update(frame_count);
-        winner = game_window.update(p1_pos, p2_pos);
+        SNAKE_PROFILE_SCOPE(Phase::Update);
+        if (session) {
+            update_remote();
+            return;
+        }
+        read_input();
+        if (arena) {
+            next_commands(*arena);
+            winner = arena->step(commands.data());
+            game_window.update(*arena);
+        } else {
+            if (replay)
+                replay->commands(static_cast<std::uint32_t>(simulation.get_frame_count()), commands[0], commands[1]);
+            else
+                next_commands(simulation);
+            if (recording())
+                recorder.record_tick(simulation, commands[0], commands[1]);
+            winner = simulation.step(commands.data()); // update player positions
+            if (options.render_rate == 0)
+                game_window.update(simulation); // otherwise the game loop draws the published snapshots
+        }
         if (winner != NO_WINNER) {
             game_over = true;
             ++scoreboard.at(winner);
+            if (recording())
+                append_replay(options.record_path, recorder.finish(static_cast<std::uint32_t>(simulation.get_frame_count()), winner));
+            if (history && !replay)
+                history->append(arena ? summarize_match(*arena, winner) : summarize_match(simulation, winner));
         }
+        if (broadcast)
+            broadcast->publish(simulation, scoreboard, winner);
     }
 
     void reset() {
         game_over = false;
         winner = NO_WINNER; // reset winner
-        frame_count = 0; // reset frame count
 
         // reset players
         game_window.reset();
-        player_1 = make_shared<Player>(1, game_window.get_player1_start(), Direction::Right, 'w', 's', 'a', 'd', game_window.get_initial_width() / 5);
-        player_2 = make_shared<Player>(2, game_window.get_player2_start(), Direction::Left, KEY_UP, KEY_DOWN, KEY_LEFT, KEY_RIGHT, game_window.get_initial_width() / 5);
-        game_window.set_players(player_1, player_2);
+        if (arena) {
+            players = make_players(options.arena_width, options.arena_height, game_window.get_board_width(), game_window.get_board_height());
+            arena->reset(players);
+            game_window.follow(options.follow);
+        } else {
+            // nothing may point into the arena once it is reset
+            simulation.release_players();
+            players.clear();
+            const int width = game_window.get_board_width(), height = game_window.get_board_height();
+            match_arena.reset(match_arena_bytes(options.players, body_capacity(width, height)));
+            players = make_players(width, height, 0, 0, &match_arena);
+            simulation.resize(width, height);
+            simulation.reset(players);
+        }
+        clear_turns();
+    }
+
+    // bots size their search for the board before the first tick rather than during it
+    void prepare_bots() {
+        for (std::size_t i = 0; i < ais.size(); ++i) {
+            if (!is_bot(i))
+                continue;
+            if (arena)
+                ais[i].prepare(*arena);
+            else
+                ais[i].prepare(simulation);
+        }
+    }
+
+    void clear_turns() {
+        for (TurnBuffer& buffer : turns)
+            buffer.clear();
+    }
+
+    // host: waits for the opponent and sends it our board, joiner: plays on the host's board
+    void connect() {
+        if (!options.host_address.empty()) {
+            game_window.render_message("WAITING FOR AN OPPONENT ON " + options.host_address);
+            connection = std::make_unique<SocketTransport>(SocketTransport::listen(options.host_address));
+            std::memcpy(net_board.magic, NET_MAGIC, sizeof(net_board.magic));
+            net_board.version = NET_VERSION;
+            net_board.width = static_cast<std::uint16_t>(game_window.get_board_width());
+            net_board.height = static_cast<std::uint16_t>(game_window.get_board_height());
+            net_board.tick_rate = static_cast<std::uint16_t>(options.tick_rate);
+            connection->send_hello(net_board);
+            local_player = PLAYER1;
+        } else {
+            connection = std::make_unique<SocketTransport>(SocketTransport::connect(options.join_address));
+            net_board = connection->receive_hello();
+            local_player = PLAYER2;
+        }
+        session = std::make_unique<RollbackSession<SocketTransport>>(simulation, *connection, local_player);
+        confirmed_commands.reserve(1 << 16);
+    }
+
+    void reset_remote() {
+        game_over = false;
+        winner = NO_WINNER;
+
+        game_window.reset();
+        game_window.fit_board(net_board.width, net_board.height);
+        players = make_players(net_board.width, net_board.height);
+        simulation = Simulation(net_board.width, net_board.height, players, net_board.tick_rate);
+        scheduler.set_tick_rate(net_board.tick_rate);
+        session->reset();
+        confirmed_commands.clear();
+        rollbacks_drawn = session->get_stats().rollbacks;
+        clear_turns();
+    }
+
+    void load_replay(ReplayView const& view) {
+        game_over = false;
+        winner = NO_WINNER;
+
+        const ReplaySetup setup = view.get_setup();
+        game_window.reset();
+        game_window.fit_board(setup.width, setup.height);
+        simulation = make_replay_simulation(setup);
+        scheduler.set_tick_rate(setup.tick_rate);
+        replay = std::make_unique<ReplayPlayer>(view);
+    }
+
+    // plays one game, returns true if the user wants another
+    template <typename Setup>
+    bool play_round(Setup&& setup) {
+        try {
+            setup();
+            start();
+        } catch (const exception& err) {
+            // if game has already started, display error on screen and allow user to play again
+            if (started) {
+                if (!game_over) {
+                    // error occured before game finished, so manually end the game
+                    game_over = true;
+                    ++scoreboard.at(NO_WINNER);
+                }
+                // display error on the screen
+                game_window.render_game_over_screen(winner, scoreboard, current_exception());
+            } else {
+                // if game has not started yet, rethrow error
+                throw;
+            }
+        }
+        return game_window.play_again(); // check if user wants to play again
     }
 public:
-    Game() :
+    Game(GameOptions game_options = GameOptions()) :
+        options(game_options),
         game_window(GameWindow::get_instance()),
-        player_1(make_shared<Player>(PLAYER1, game_window.get_player1_start(), Direction::Right, 'w', 's', 'a', 'd', game_window.get_initial_width() / 5)),
-        player_2(make_shared<Player>(PLAYER2, game_window.get_player2_start(), Direction::Left, KEY_UP, KEY_DOWN, KEY_LEFT, KEY_RIGHT, game_window.get_initial_width() / 5)),
+        match_arena(match_arena_bytes(options.players, body_capacity(game_window.get_board_width(), game_window.get_board_height()))),
+        players(make_players(game_window.get_board_width(), game_window.get_board_height(), 0, 0, &match_arena)),
+        simulation(game_window.get_board_width(), game_window.get_board_height(), players, options.tick_rate),
+        scheduler(options.tick_rate, options.missed_tick_policy),
+        turns(options.players),
+        ais(options.players, FloodFillBot(options.bot_budget)),
+        commands(options.players, Direction::None),
+        local_player(NO_WINNER),
+        net_board{},
+        rollbacks_drawn(0),
+        applied_turns{},
+        applied_turn_count(0),
+        snapshots_published(0),
+        stop_simulation(false),
         scoreboard{
             { NO_WINNER     , 0 },  // no winner
-            { DRAW          , 0 },  // draw
-            { player_1->id(), 0 },  // player 1
-            { player_2->id(), 0 }   // player 2
+            { DRAW          , 0 }   // draw
         },
         game_over(false),
         play_again(false),
         started(false),
-        winner(NO_WINNER),
-        frame_count(0)
+        winner(NO_WINNER)
     {
-        game_window.set_players(player_1, player_2);
+        try {
+            if (options.output == OutputBackend::Ansi)
+                game_window.use_ansi_output();
+            if (!options.broadcast_name.empty())
+                broadcast = std::make_unique<BroadcastWriter>(options.broadcast_name, game_window.get_board_width(), game_window.get_board_height());
+            if (!options.history_path.empty() && options.replay_path.empty() && options.spectate_name.empty()) {
+                try {
+                    history = std::make_unique<MatchHistory>(options.history_path); // the lifetime totals load meanwhile
+                } catch (const exception&) {
+                    // the history is a nicety (e.g. the directory isn't writable), play without it
+                }
+            }
+            if (options.arena_width > 0) {
+                players = make_players(options.arena_width, options.arena_height, game_window.get_board_width(), game_window.get_board_height());
+                arena = std::make_unique<ArenaSimulation>(options.arena_width, options.arena_height, players, options.tick_rate);
+                game_window.follow(options.follow);
+            }
+            if (options.food > 0)
+                simulation.set_food(options.food, static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()));
+            for (auto const& player : players)
+                scoreboard[player->id()] = 0;
+        } catch (...) {
+            game_window.end(); // ~Game won't run, curses has to end before the error is printed
+            throw;
+        }
     }
 
     ~Game() {
         game_window.end(); // GameWindow is a singleton, need to explicitly call "cleanup" code
+        if (options.print_timing) {
+            // curses has ended, safe to write to the terminal
+            scheduler.get_timing().print(stderr);
+            reactor.get_stats().print(stderr);
+            if (options.render_rate > 0)
+                render_stats.print(stderr);
+            key_to_screen.print(stderr, "key to screen");
+            if (game_window.get_output_backend() == OutputBackend::Ansi)
+                game_window.get_output_stats().print(stderr);
+            if (broadcast)
+                broadcast->get_stats().print(stderr);
+            if (spectating)
+                spectating->get_stats().print(stderr);
+            if (history)
+                history->get_stats().print(stderr);
+            for (std::size_t i = 0; i < players.size(); ++i) {
+                if (is_bot(i))
+                    ais[i].get_decision_time().print(stderr, ("player " + to_string(i + 1) + " bot decision").c_str());
+            }
+            if (session)
+                session->get_stats().print(stderr);
+#ifdef SNAKE_PROFILING
+            Profiler::instance().print(stderr);
+#endif
+        }
+#ifdef SNAKE_PROFILING
+        if (!options.trace_path.empty()) {
+            try {
+                Profiler::instance().write_trace(options.trace_path);
+            } catch (const exception& err) {
+                fprintf(stderr, "snake: %s\n", err.what());
+            }
+        }
+#endif
+    }
+
+    // called on the simulation thread after every frame, the snapshot handed back is 2 publishes old and is overwritten
+    void publish_snapshot(bool const over) {
+        FrameSnapshot& snapshot = snapshots.write_buffer();
+        snapshot.sequence = ++snapshots_published;
+        std::copy_n(simulation.get_board().data(), snapshot.cells.size(), snapshot.cells.data());
+        for (Coordinates pos : simulation.get_food())
+            snapshot.cells[static_cast<std::size_t>(pos.y) * snapshot.width + pos.x] = CELL_FOOD;
+        snapshot.collisions.assign(simulation.get_collisions().begin(), simulation.get_collisions().end());
+        snapshot.applied_turns = applied_turns;
+        snapshot.applied_turn_count = applied_turn_count;
+        applied_turn_count = 0;
+        snapshot.game_over = over;
+        snapshot.published = std::chrono::steady_clock::now();
+        snapshots.publish();
+    }
+
+    // the simulation thread: ticks at the tick rate until the game is over, publishing a snapshot after every frame
+    void run_simulation() {
+        try {
+            EventReactor timer(-1); // no keyboard, the game loop reads it
+            scheduler.start();
+            timer.arm(scheduler.get_next_deadline(), scheduler.get_period());
+            while (!game_over && !stop_simulation.load(std::memory_order_relaxed)) {
+                timer.wait_for_tick([] {});
+                const unsigned due_ticks = scheduler.tick_arrived();
+                for (unsigned ticks = due_ticks; ticks > 0 && !game_over; --ticks)
+                    update();
+                publish_snapshot(game_over);
+                scheduler.frame_done();
+            }
+        } catch (...) {
+            simulation_error = current_exception();
+            publish_snapshot(true); // the game loop stops at the first snapshot that says the game is over
+        }
+    }
+
+    /*
+    With --render-rate the simulation ticks on its own thread and the game
+    loop only reads the keyboard (passing key presses on through the
+    SpscQueue in GameWindow) and draws the newest snapshot at the render
+    rate. A slow terminal only delays drawing, snapshots it has no time
+    for are dropped and the simulation never waits for it.
+    */
+    int start_decoupled() {
+        snapshots.clear();
+        snapshots.for_each_slot([this](FrameSnapshot& snapshot) {
+            snapshot.resize(simulation.get_width(), simulation.get_height());
+        });
+        snapshots_published = 0;
+        stop_simulation.store(false);
+        simulation_error = nullptr;
+        std::thread simulation_thread([this] { run_simulation(); });
+        try {
+            reactor.arm(std::chrono::steady_clock::now(), std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::seconds(1)) / options.render_rate);
+            std::uint64_t last_shown = 0;
+            for (bool over = false; !over;) {
+                reactor.wait_for_tick([this] { game_window.read_keys(); });
+                ++render_stats.frames;
+                if (!snapshots.update()) {
+                    ++render_stats.idle;
+                    continue;
+                }
+                FrameSnapshot const& snapshot = snapshots.read_buffer();
+                render_stats.dropped += snapshot.sequence - last_shown - 1;
+                last_shown = snapshot.sequence;
+                over = snapshot.game_over;
+                game_window.update(snapshot);
+                if (over)
+                    break; // the game over screen goes on top once the simulation thread is done
+                game_window.render();
+                const auto now = std::chrono::steady_clock::now();
+                for (std::size_t i = 0; i < snapshot.applied_turn_count; ++i)
+                    key_to_screen.record(now - snapshot.applied_turns[i]);
+                render_stats.snapshot_age.record(now - snapshot.published);
+                ++render_stats.shown;
+            }
+        } catch (...) {
+            stop_simulation.store(true);
+            simulation_thread.join();
+            reactor.disarm();
+            throw;
+        }
+        simulation_thread.join();
+        reactor.disarm();
+        if (simulation_error)
+            rethrow_exception(simulation_error);
+        render();
+        return winner;
     }
 
     // play one game then end
     int start() {
-        game_window.start(); // spin up input thread
+        game_window.start();
         started = true;
+        if (recording()) {
+            recorder.begin({ simulation.get_width(), simulation.get_height(),
+                game_window.get_player1_start(), game_window.get_player2_start(),
+                game_window.get_initial_width() / 5, options.tick_rate });
+        }
+        prepare_bots();
+        if (broadcast)
+            broadcast->begin_match();
+        if (options.render_rate > 0)
+            return start_decoupled();
+        scheduler.start();
+        reactor.arm(scheduler.get_next_deadline(), scheduler.get_period());
         while (!game_over) // main game loop
         {
-            auto start_time = std::chrono::steady_clock::now();
-            update(); // update player positions
-            render(); // render updated player positions
-            auto finish_time = std::chrono::steady_clock::now();
-            auto time_taken = finish_time-start_time;
-            auto time_taken_milliseconds = std::chrono::duration_cast<std::chrono::milliseconds>(time_taken);
-            std::this_thread::sleep_for(std::chrono::milliseconds(1000)/FRAMES_PER_SECOND - time_taken_milliseconds); // run loop every 50ms
-            ++frame_count;
+            // wait for the next tick (more than 1 tick if catching up), key presses are read as they arrive meanwhile
+            reactor.wait_for_tick([this] {
+                game_window.read_keys();
+                read_input();
+            });
+            const unsigned due_ticks = scheduler.tick_arrived();
+            {
+                SNAKE_PROFILE_SCOPE(Phase::Frame);
+                for (unsigned ticks = due_ticks; ticks > 0 && !game_over; --ticks) {
+                    update(); // update player positions
+                }
+                render(); // render updated player positions
+            }
+            scheduler.frame_done();
         }
+        reactor.disarm();
         return winner;
     }
 
     // play game continuously until user quits
     Scoreboard play() {
+        if (!options.spectate_name.empty())
+            return spectate();
+        if (!options.replay_path.empty())
+            return watch();
+        if (!options.host_address.empty() || !options.join_address.empty())
+            return play_remote();
         do {
-            try {
+            play_again = play_round([this] {
                 if (started)
                     reset();
-                start();
-            } catch (const exception& err) {
-                // if game has already started, display error on screen and allow user to play again
+            });
+        } while (play_again);
+        return scoreboard;
+    }
+
+    // play against another snake.o over a socket until either side quits, both have to press 'r' to play again
+    Scoreboard play_remote() {
+        connect();
+        do {
+            play_again = play_round([this] {
                 if (started) {
-                    if (!game_over) {
-                        // error occured before game finished, so manually end the game
-                        game_over = true;
-                        ++scoreboard.at(NO_WINNER);
-                    }
-                    // display error on the screen
-                    game_window.render_game_over_screen(winner, scoreboard, current_exception());
-                } else {
-                    // if game has not started yet, rethrow error
-                    throw;
+                    game_window.render_message("WAITING FOR THE OPPONENT TO RESTART");
+                    session->restart();
                 }
-            }
-            play_again = game_window.play_again(); // check if user wants to play again
+                reset_remote();
+            });
         } while (play_again);
         return scoreboard;
     }
+
+    // draw another snake.o's game from its broadcast until 'q', at the tick rate (or the render rate if given). Reading
+    // the feed never holds the other game up: if this falls a ring behind it picks up again at the newest keyframe
+    Scoreboard spectate() {
+        spectating = std::make_unique<BroadcastReader>(options.spectate_name);
+        BroadcastReader& feed = *spectating;
+        game_window.start();
+        started = true;
+        const unsigned rate = options.render_rate > 0 ? options.render_rate : options.tick_rate;
+        reactor.arm(std::chrono::steady_clock::now(), std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::seconds(1)) / rate);
+        std::uint32_t match = 0;
+        bool game_over_drawn = false;
+        for (bool quit = false; !quit;) {
+            reactor.wait_for_tick([this] { game_window.read_keys(); });
+            KeyEvent event;
+            while (game_window.next_key_event(event))
+                quit = quit || event.ch == 'q';
+            if (!feed.update())
+                continue;
+            if (feed.get_match() != match || feed.get_width() != game_window.get_board_width() || feed.get_height() != game_window.get_board_height()) {
+                match = feed.get_match();
+                game_window.reset();
+                game_window.fit_board(feed.get_width(), feed.get_height());
+                game_over_drawn = false;
+            }
+            game_window.update(feed);
+            if (!feed.is_game_over()) {
+                game_window.render();
+            } else if (!game_over_drawn) {
+                game_window.render_game_over_screen(feed.get_winner(), feed.get_scoreboard());
+                game_over_drawn = true;
+            }
+        }
+        reactor.disarm();
+        return feed.get_scoreboard();
+    }
+
+    // watch every game in the replay archive at the speed it was played, 'r' moves on to the next one
+    Scoreboard watch() {
+        const ReplayArchive archive(options.replay_path);
+        play_again = true;
+        archive.for_each([this](ReplayView const& view) {
+            if (play_again)
+                play_again = play_round([&] { load_replay(view); });
+        });
+        replay.reset();
+        return scoreboard;
+    }
 };
 }
 
@@ -0,0 +1,76 @@
+#include "snake_env.h"
+#include "env.h"
+#include <exception>
+#include <string>
+
+using namespace snake;
+
+struct snake_env {
+    VectorEnv env;
+
+    explicit snake_env(EnvConfig const& config) : env(config) {}
+};
+
+namespace {
+
+thread_local std::string last_error;
+
+// runs f, turning an exception into its message and a failure return
+template <typename F>
+int guarded(F&& f) {
+    try {
+        f();
+        return 0;
+    } catch (const std::exception& err) {
+        last_error = err.what();
+        return -1;
+    }
+}
+
+}
+
+extern "C" {
+
+snake_env* snake_env_create(int width, int height, size_t players, size_t batch, size_t threads) {
+    snake_env* env = nullptr;
+    guarded([&] {
+        EnvConfig config;
+        config.width = width;
+        config.height = height;
+        config.players = players;
+        config.batch = batch;
+        config.threads = threads;
+        env = new snake_env(config);
+    });
+    return env;
+}
+
+void snake_env_destroy(snake_env* env) {
+    delete env;
+}
+
+int snake_env_reset(snake_env* env, uint8_t* observations) {
+    return guarded([&] { env->env.reset(observations); });
+}
+
+int snake_env_step(snake_env* env, const int8_t* actions, uint8_t* observations, float* rewards, uint8_t* dones) {
+    return guarded([&] { env->env.step(actions, observations, rewards, dones); });
+}
+
+size_t snake_env_action_count(const snake_env* env) {
+    return env->env.action_count();
+}
+
+size_t snake_env_observation_size(const snake_env* env) {
+    return env->env.observation_size();
+}
+
+size_t snake_env_reward_count(const snake_env* env) {
+    return env->env.reward_count();
+}
+
+const char* snake_env_last_error(void) {
+    return last_error.c_str();
+}
+
+}
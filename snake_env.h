@@ -0,0 +1,39 @@
+#ifndef SNAKE_ENV_H
+#define SNAKE_ENV_H
+
+/*
+C interface to VectorEnv (env.h) for training code in other languages,
+built as libsnake_env.so by `make env`. Buffer layouts are the ones
+documented on BasicVectorEnv. Functions that can fail return NULL or -1
+and leave a message for snake_env_last_error().
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct snake_env snake_env;
+
+/* width & height are the full board dimensions, border included, threads <= 1 steps on the calling thread */
+snake_env* snake_env_create(int width, int height, size_t players, size_t batch, size_t threads);
+void snake_env_destroy(snake_env* env);
+
+int snake_env_reset(snake_env* env, uint8_t* observations);
+int snake_env_step(snake_env* env, const int8_t* actions, uint8_t* observations, float* rewards, uint8_t* dones);
+
+/* elements in each buffer */
+size_t snake_env_action_count(const snake_env* env);
+size_t snake_env_observation_size(const snake_env* env);
+size_t snake_env_reward_count(const snake_env* env);
+
+/* the message of the last failure on this thread, "" if none */
+const char* snake_env_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
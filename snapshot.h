@@ -0,0 +1,125 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "core.h"
+#include "scheduler.h"
+#include "stats.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+using std::vector;
+
+namespace snake {
+
+/*
+Lock free triple buffer: one writer publishes values, one reader takes the
+newest one published. Each side owns one of the three slots and the third
+is in the middle, handed over by exchanging indices, so neither side ever
+waits for the other. Values published faster than the reader takes them
+are overwritten: the reader only ever sees the latest.
+*/
+template <typename T>
+class TripleBuffer {
+    static constexpr std::uint8_t INDEX_MASK = 3;
+    static constexpr std::uint8_t FRESH = 4; // the middle slot holds a value the reader hasn't taken
+
+    std::array<T, 3> slots;
+    alignas(64) std::atomic<std::uint8_t> middle;
+    alignas(64) std::uint8_t back; // the writer's
+    alignas(64) std::uint8_t front; // the reader's
+
+public:
+    TripleBuffer() : middle(1), back(0), front(2) {}
+
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    // writer & reader both stopped: forget anything published
+    void clear() {
+        middle.store(1, std::memory_order_relaxed);
+        back = 0;
+        front = 2;
+    }
+
+    // writer side: fill in write_buffer() completely (it holds an old value), then publish() it
+    T& write_buffer() {
+        return slots[back];
+    }
+
+    void publish() {
+        back = middle.exchange(static_cast<std::uint8_t>(back | FRESH), std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // reader side: returns false if nothing was published since the last call, otherwise read_buffer() is the newest
+    bool update() {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH))
+            return false;
+        front = middle.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+    T const& read_buffer() const {
+        return slots[front];
+    }
+
+    // both stopped: for setting every slot up before they start
+    template <typename F>
+    void for_each_slot(F&& f) {
+        for (T& slot : slots)
+            f(slot);
+    }
+};
+
+// key press timestamps of turns applied since the last frame was drawn, for key to screen latency
+using AppliedTurns = std::array<std::chrono::steady_clock::time_point, 2 * FixedTimestepScheduler::MAX_CATCH_UP_TICKS + 2>;
+
+// what a simulation thread publishes after each frame, everything the renderer needs to draw it
+struct FrameSnapshot {
+    std::uint64_t sequence = 0; // counts from 1
+    std::chrono::steady_clock::time_point published;
+    int width = 0, height = 0;
+    vector<std::uint8_t> cells; // the board's owners, row major
+    vector<Coordinates> collisions;
+    AppliedTurns applied_turns{};
+    std::size_t applied_turn_count = 0;
+    bool game_over = false;
+
+    // sized once per game, so publishing never allocates
+    void resize(int const board_width, int const board_height) {
+        width = board_width;
+        height = board_height;
+        cells.assign(static_cast<std::size_t>(width) * height, CELL_EMPTY);
+        collisions.clear();
+        collisions.reserve(2 * MAX_PLAYERS);
+        applied_turn_count = 0;
+        game_over = false;
+    }
+
+    // as Board::owner, so the snapshot can be drawn like a board
+    std::uint8_t owner(Coordinates const& pos) const {
+        if (pos.x < 0 || pos.y < 0 || pos.x >= width || pos.y >= height)
+            return CELL_BORDER;
+        return cells[static_cast<std::size_t>(pos.y) * width + pos.x];
+    }
+};
+
+struct RenderStats {
+    unsigned long frames = 0;  // times the renderer woke up
+    unsigned long shown = 0;   // snapshots drawn
+    unsigned long idle = 0;    // wake ups with no new snapshot to draw
+    unsigned long dropped = 0; // snapshots replaced by a newer one before the renderer got to them
+    LatencyHistogram snapshot_age; // from publishing a snapshot to having it on screen
+
+    void print(std::FILE* out) const {
+        std::fprintf(out, "render frames %lu, snapshots shown %lu, idle %lu, dropped %lu\n", frames, shown, idle, dropped);
+        snapshot_age.print(out, "snapshot age");
+    }
+};
+}
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+
+namespace snake {
+
+/*
+Fixed size log-linear histogram of durations in nanoseconds. Every power of
+two range is split into 8 buckets, so percentiles are accurate to ~12%.
+Recording is a couple of instructions and never allocates, so it is safe
+to use inside the game loop.
+*/
+class LatencyHistogram {
+    static constexpr int SUB_BUCKETS = 8; // per power of two
+    static constexpr int LINEAR_BUCKETS = 16; // values below 16ns get a bucket each
+    static constexpr int BUCKETS = LINEAR_BUCKETS + (64 - 4) * SUB_BUCKETS;
+
+    std::array<std::uint64_t, BUCKETS> counts;
+    std::uint64_t samples, sum_ns, max_ns;
+
+    static int bucket_of(std::uint64_t const ns) {
+        if (ns < LINEAR_BUCKETS)
+            return static_cast<int>(ns);
+        const int msb = 63 - __builtin_clzll(ns);
+        const int sub = static_cast<int>((ns >> (msb - 3)) & (SUB_BUCKETS - 1));
+        return LINEAR_BUCKETS + (msb - 4) * SUB_BUCKETS + sub;
+    }
+
+    static std::uint64_t bucket_upper_bound(int const bucket) {
+        if (bucket < LINEAR_BUCKETS)
+            return bucket;
+        const int msb = (bucket - LINEAR_BUCKETS) / SUB_BUCKETS + 4;
+        const int sub = (bucket - LINEAR_BUCKETS) % SUB_BUCKETS;
+        return ((static_cast<std::uint64_t>(SUB_BUCKETS + sub + 1)) << (msb - 3)) - 1;
+    }
+
+public:
+    LatencyHistogram() {
+        reset();
+    }
+
+    void reset() {
+        counts.fill(0);
+        samples = 0;
+        sum_ns = 0;
+        max_ns = 0;
+    }
+
+    void record(std::chrono::nanoseconds const duration) {
+        record_ns(duration.count() < 0 ? 0 : static_cast<std::uint64_t>(duration.count()));
+    }
+
+    void record_ns(std::uint64_t const ns) {
+        ++counts[bucket_of(ns)];
+        ++samples;
+        sum_ns += ns;
+        if (ns > max_ns)
+            max_ns = ns;
+    }
+
+    void merge(LatencyHistogram const& other) {
+        for (int i = 0; i < BUCKETS; ++i)
+            counts[i] += other.counts[i];
+        samples += other.samples;
+        sum_ns += other.sum_ns;
+        if (other.max_ns > max_ns)
+            max_ns = other.max_ns;
+    }
+
+    // p in [0, 100]
+    std::uint64_t percentile_ns(double const p) const {
+        if (samples == 0)
+            return 0;
+        std::uint64_t rank = static_cast<std::uint64_t>(p / 100.0 * samples);
+        if (rank >= samples)
+            rank = samples - 1;
+        std::uint64_t seen = 0;
+        for (int i = 0; i < BUCKETS; ++i) {
+            seen += counts[i];
+            if (seen > rank)
+                return bucket_upper_bound(i) < max_ns ? bucket_upper_bound(i) : max_ns;
+        }
+        return max_ns;
+    }
+
+    std::uint64_t count() const {
+        return samples;
+    }
+
+    double mean_ns() const {
+        return samples == 0 ? 0.0 : static_cast<double>(sum_ns) / samples;
+    }
+
+    std::uint64_t max() const {
+        return max_ns;
+    }
+
+    // one line summary in microseconds
+    void print(std::FILE* out, const char* name) const {
+        std::fprintf(out, "%-22s n=%-9llu mean %9.1fus  p50 %9.1fus  p99 %9.1fus  max %9.1fus\n",
+            name,
+            static_cast<unsigned long long>(samples),
+            mean_ns() / 1000.0,
+            percentile_ns(50) / 1000.0,
+            percentile_ns(99) / 1000.0,
+            max_ns / 1000.0);
+    }
+};
+}
+
+#endif
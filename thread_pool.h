@@ -0,0 +1,157 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using std::vector;
+
+namespace snake {
+
+/*
+Fixed size pool of worker threads with one task deque per worker. A worker
+runs tasks from the back of its own deque and, once that is empty, steals
+from the front of the others, so uneven tasks (matches that last 20 ticks
+next to ones that last 20000) still keep every core busy. Tasks are
+expected to be coarse (a batch of matches, a tick of a game), a mutex per
+deque is cheap at that granularity.
+*/
+class WorkStealingPool {
+    using Task = std::function<void()>;
+
+    struct alignas(64) WorkerQueue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    vector<std::unique_ptr<WorkerQueue>> queues;
+    vector<std::thread> workers;
+    std::atomic<std::size_t> next_queue; // round robin target for tasks submitted from outside the pool
+    std::atomic<std::size_t> queued;     // submitted but not yet picked up by a worker
+    std::atomic<std::size_t> pending;    // submitted but not finished
+    std::atomic<bool> stopping;
+    std::mutex sleep_mutex;
+    std::condition_variable work_available, all_done;
+
+    inline static thread_local int worker_index = -1;
+
+    bool pop_own(std::size_t const self, Task& task) {
+        WorkerQueue& queue = *queues[self];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty())
+            return false;
+        task = std::move(queue.tasks.back());
+        queue.tasks.pop_back();
+        queued.fetch_sub(1);
+        return true;
+    }
+
+    bool steal(std::size_t const self, Task& task) {
+        for (std::size_t i = 1; i < queues.size(); ++i) {
+            WorkerQueue& victim = *queues[(self + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                queued.fetch_sub(1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void worker_loop(std::size_t const self) {
+        worker_index = static_cast<int>(self);
+        Task task;
+        while (true) {
+            if (pop_own(self, task) || steal(self, task)) {
+                task();
+                task = nullptr;
+                if (pending.fetch_sub(1) == 1) {
+                    std::lock_guard<std::mutex> lock(sleep_mutex);
+                    all_done.notify_all();
+                }
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_mutex);
+            if (stopping.load())
+                return;
+            // re-check under the lock so a submit between the steal and the wait isn't missed
+            work_available.wait(lock, [this] { return stopping.load() || queued.load() > 0; });
+            if (stopping.load())
+                return;
+        }
+    }
+
+public:
+    explicit WorkStealingPool(std::size_t thread_count) :
+        next_queue(0),
+        queued(0),
+        pending(0),
+        stopping(false)
+    {
+        if (thread_count == 0)
+            thread_count = 1;
+        for (std::size_t i = 0; i < thread_count; ++i)
+            queues.push_back(std::make_unique<WorkerQueue>());
+        for (std::size_t i = 0; i < thread_count; ++i)
+            workers.emplace_back(&WorkStealingPool::worker_loop, this, i);
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex);
+            stopping.store(true);
+        }
+        work_available.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    // from a worker the task goes on the back of that worker's own deque, run next, otherwise on the front of one
+    // round robin, so tasks from outside (a match's tick, due before the ticks submitted after it) run in order
+    void submit(Task task) {
+        const std::size_t target = worker_index >= 0
+            ? static_cast<std::size_t>(worker_index)
+            : next_queue.fetch_add(1) % queues.size();
+        pending.fetch_add(1);
+        {
+            std::lock_guard<std::mutex> lock(queues[target]->mutex);
+            if (worker_index >= 0)
+                queues[target]->tasks.push_back(std::move(task));
+            else
+                queues[target]->tasks.push_front(std::move(task));
+            queued.fetch_add(1);
+        }
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        work_available.notify_one();
+    }
+
+    // blocks until every submitted task has finished, must not be called from a worker
+    void wait_idle() {
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        all_done.wait(lock, [this] { return pending.load() == 0; });
+    }
+
+    std::size_t size() const {
+        return workers.size();
+    }
+
+    // index of the calling worker in [0, size()), -1 if not called from a worker
+    static int current_worker() {
+        return worker_index;
+    }
+};
+}
+
+#endif
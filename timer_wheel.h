@@ -0,0 +1,157 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+using std::runtime_error;
+using std::vector;
+
+namespace snake {
+
+/*
+Hierarchical timer wheel: LEVELS wheels of SLOTS slots, each level's slot
+spanning a whole turn of the level below. A timer due within SLOTS ticks
+goes straight into a level 0 slot, one due later into the slot of the
+first level whose turn reaches that far, and is moved down a level when
+the wheel gets round to its slot (cascading), so scheduling, cancelling
+and expiring a timer are all O(1) however many are pending: thousands of
+matches each ticking on their own phase cost the same per wake up as one.
+
+Timers are identified by small integers (a session slot) and linked
+through arrays indexed by them, so a wheel sized for its timers never
+allocates. Time is in wheel ticks, whatever duration the owner picks.
+*/
+class TimerWheel {
+public:
+    static constexpr int LEVEL_BITS = 6;
+    static constexpr std::size_t SLOTS = std::size_t(1) << LEVEL_BITS;
+    static constexpr int LEVELS = 4; // 2^24 ticks ahead, over 4 hours at 1ms
+    static constexpr std::uint32_t NONE = UINT32_MAX;
+
+private:
+    struct Node {
+        std::uint64_t expiry;
+        std::uint32_t next, prev;
+        std::uint32_t* head; // the slot the timer is in, nullptr if not scheduled
+    };
+
+    std::array<std::array<std::uint32_t, SLOTS>, LEVELS> slots;
+    vector<Node> nodes;
+    std::uint64_t current; // every tick up to and including this one has expired
+    std::size_t scheduled;
+
+    void link(std::uint32_t const id) {
+        Node& node = nodes[id];
+        const std::uint64_t delta = node.expiry - current;
+        int level = 0;
+        while (level < LEVELS - 1 && delta >= (std::uint64_t(1) << (LEVEL_BITS * (level + 1))))
+            ++level;
+        std::uint32_t& head = slots[level][(node.expiry >> (LEVEL_BITS * level)) & (SLOTS - 1)];
+        node.head = &head;
+        node.prev = NONE;
+        node.next = head;
+        if (head != NONE)
+            nodes[head].prev = id;
+        head = id;
+    }
+
+    void unlink(std::uint32_t const id) {
+        Node& node = nodes[id];
+        if (node.prev != NONE)
+            nodes[node.prev].next = node.next;
+        else
+            *node.head = node.next;
+        if (node.next != NONE)
+            nodes[node.next].prev = node.prev;
+        node.head = nullptr;
+    }
+
+    // moves every timer in a slot of a higher level down to where it now belongs
+    void cascade(int const level) {
+        std::uint32_t& head = slots[level][(current >> (LEVEL_BITS * level)) & (SLOTS - 1)];
+        std::uint32_t id = head;
+        head = NONE;
+        while (id != NONE) {
+            const std::uint32_t next = nodes[id].next;
+            link(id);
+            id = next;
+        }
+    }
+
+public:
+    // timer ids 0 to capacity - 1, time starts at now
+    explicit TimerWheel(std::size_t const capacity = 0, std::uint64_t const now = 0) : current(now), scheduled(0) {
+        for (auto& level : slots)
+            level.fill(NONE);
+        nodes.assign(capacity, Node{ 0, NONE, NONE, nullptr });
+    }
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // timer ids 0 to capacity - 1 from now on, timers already scheduled stay as they are
+    void reserve(std::size_t const capacity) {
+        if (capacity > nodes.size())
+            nodes.resize(capacity, Node{ 0, NONE, NONE, nullptr });
+    }
+
+    // (re)schedules timer id to expire at tick expiry, a tick already gone by expires on the next advance()
+    void schedule(std::uint32_t const id, std::uint64_t expiry) {
+        cancel(id);
+        if (expiry <= current)
+            expiry = current + 1;
+        if (expiry - current >= (std::uint64_t(1) << (LEVEL_BITS * LEVELS)))
+            throw runtime_error("timer scheduled too far ahead for the wheel");
+        nodes[id].expiry = expiry;
+        link(id);
+        ++scheduled;
+    }
+
+    void cancel(std::uint32_t const id) {
+        if (nodes[id].head == nullptr)
+            return;
+        unlink(id);
+        --scheduled;
+    }
+
+    bool is_scheduled(std::uint32_t const id) const {
+        return nodes[id].head != nullptr;
+    }
+
+    std::uint64_t get_expiry(std::uint32_t const id) const {
+        return nodes[id].expiry;
+    }
+
+    // expires every timer due up to and including tick now, in tick order, calling expired(id, expiry) for each. A
+    // timer expired may be scheduled again from the callback
+    template <typename Expired>
+    void advance(std::uint64_t const now, Expired&& expired) {
+        while (current < now) {
+            ++current;
+            for (int level = 1; level < LEVELS && (current & ((std::uint64_t(1) << (LEVEL_BITS * level)) - 1)) == 0; ++level)
+                cascade(level);
+            std::uint32_t& head = slots[0][current & (SLOTS - 1)];
+            while (head != NONE) {
+                const std::uint32_t id = head;
+                unlink(id);
+                --scheduled;
+                expired(id, nodes[id].expiry);
+            }
+        }
+    }
+
+    std::uint64_t get_current() const {
+        return current;
+    }
+
+    std::size_t size() const {
+        return scheduled;
+    }
+};
+}
+
+#endif
@@ -0,0 +1,161 @@
+#ifndef TOURNAMENT_H
+#define TOURNAMENT_H
+
+#include "bots.h"
+#include "replay.h"
+#include "simulation.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+using std::vector;
+
+namespace snake {
+
+struct MatchConfig {
+    int width = 200, height = 60; // full board dimensions, border included
+    unsigned tick_rate = FRAMES_PER_SECOND;
+    unsigned long max_ticks = 100000; // matches still running after this many ticks end with NO_WINNER
+    BotKind p1_bot = BotKind::Random, p2_bot = BotKind::Random;
+    std::chrono::microseconds bot_budget = std::chrono::microseconds(1000); // per FloodFillBot decision
+    std::string record_path; // append every match to this replay archive, empty = don't record
+};
+
+struct MatchResult {
+    int winner;
+    unsigned long ticks;
+};
+
+// key bindings are irrelevant for players nobody is typing for
+inline shared_ptr<Player> make_bot_player(int const id, StartingPositions const& start, std::size_t const area) {
+    if (id == PLAYER1)
+        return make_shared<Player>(PLAYER1, start.player1_start, Direction::Right, 0, 0, 0, 0, start.initial_width / 5, area);
+    return make_shared<Player>(PLAYER2, start.player2_start, Direction::Left, 0, 0, 0, 0, start.initial_width / 5, area);
+}
+
+// plays complete matches one after another, reusing one Simulation (and its board) between them
+class MatchRunner {
+    MatchConfig config;
+    StartingPositions start;
+    std::size_t area;
+    Simulation simulation;
+    Bot p1_bot, p2_bot;
+    ReplayRecorder recorder;
+
+public:
+    explicit MatchRunner(MatchConfig const& match_config) :
+        config(match_config),
+        start(calculate_starting_positions(config.width, config.height)),
+        area(body_capacity(config.width, config.height)),
+        simulation(config.width, config.height, make_bot_player(PLAYER1, start, area), make_bot_player(PLAYER2, start, area), config.tick_rate),
+        p1_bot(config.p1_bot, 0, config.bot_budget),
+        p2_bot(config.p2_bot, 0, config.bot_budget)
+    {}
+
+    // one complete match, fully determined by config & seed
+    MatchResult play(std::uint64_t const seed) {
+        simulation.reset(make_bot_player(PLAYER1, start, area), make_bot_player(PLAYER2, start, area));
+        p1_bot.reseed(seed * 2 + 1);
+        p2_bot.reseed(seed * 2 + 2);
+
+        const bool recording = !config.record_path.empty();
+        if (recording)
+            recorder.begin({ config.width, config.height, start.player1_start, start.player2_start, start.initial_width / 5, config.tick_rate });
+
+        int winner = NO_WINNER;
+        while (winner == NO_WINNER && simulation.get_frame_count() < config.max_ticks) {
+            const Direction p1_cmd = p1_bot.next_command(simulation, PLAYER1);
+            const Direction p2_cmd = p2_bot.next_command(simulation, PLAYER2);
+            if (recording)
+                recorder.record_tick(simulation, p1_cmd, p2_cmd);
+            winner = simulation.step(p1_cmd, p2_cmd);
+        }
+        if (recording)
+            append_replay(config.record_path, recorder.finish(static_cast<std::uint32_t>(simulation.get_frame_count()), winner));
+        return { winner, simulation.get_frame_count() };
+    }
+
+    // how long FloodFillBot decisions took, for either side
+    LatencyHistogram bot_decision_time() const {
+        LatencyHistogram total;
+        total.merge(p1_bot.get_flood_fill_bot().get_decision_time());
+        total.merge(p2_bot.get_flood_fill_bot().get_decision_time());
+        return total;
+    }
+
+    unsigned long bot_budget_overruns() const {
+        return p1_bot.get_flood_fill_bot().get_budget_overruns() + p2_bot.get_flood_fill_bot().get_budget_overruns();
+    }
+};
+
+struct TournamentResult {
+    Scoreboard scoreboard;
+    unsigned long matches = 0;
+    unsigned long ticks = 0;
+    double seconds = 0;
+    LatencyHistogram bot_decision_time; // FloodFillBot only
+    unsigned long bot_budget_overruns = 0;
+
+    double matches_per_second() const {
+        return seconds > 0 ? matches / seconds : 0.0;
+    }
+};
+
+/*
+Plays matches seeded first_seed, first_seed + 1, ... on a WorkStealingPool.
+Each worker keeps its own Scoreboard and counters (no sharing while
+matches run), they are merged once every match has finished.
+*/
+inline TournamentResult run_tournament(MatchConfig const& config, unsigned long const matches, std::size_t const threads, std::uint64_t const first_seed = 1) {
+    static constexpr unsigned long MATCHES_PER_TASK = 64;
+
+    struct alignas(64) WorkerTotals {
+        Scoreboard scoreboard{ { NO_WINNER, 0 }, { DRAW, 0 }, { PLAYER1, 0 }, { PLAYER2, 0 } };
+        unsigned long matches = 0;
+        unsigned long ticks = 0;
+        std::unique_ptr<MatchRunner> runner; // created by the worker on first use
+    };
+
+    WorkStealingPool pool(threads);
+    vector<WorkerTotals> totals(pool.size());
+
+    auto start_time = std::chrono::steady_clock::now();
+    for (unsigned long first = 0; first < matches; first += MATCHES_PER_TASK) {
+        const unsigned long last = std::min(matches, first + MATCHES_PER_TASK);
+        pool.submit([&config, &totals, first, last, first_seed] {
+            WorkerTotals& mine = totals[WorkStealingPool::current_worker()];
+            if (!mine.runner)
+                mine.runner = std::make_unique<MatchRunner>(config);
+            for (unsigned long i = first; i < last; ++i) {
+                const MatchResult result = mine.runner->play(first_seed + i);
+                ++mine.scoreboard.at(result.winner);
+                ++mine.matches;
+                mine.ticks += result.ticks;
+            }
+        });
+    }
+    pool.wait_idle();
+    auto finish_time = std::chrono::steady_clock::now();
+
+    TournamentResult result;
+    result.scoreboard = { { NO_WINNER, 0 }, { DRAW, 0 }, { PLAYER1, 0 }, { PLAYER2, 0 } };
+    for (WorkerTotals const& worker : totals) {
+        for (auto const& [winner, count] : worker.scoreboard)
+            result.scoreboard[winner] += count;
+        result.matches += worker.matches;
+        result.ticks += worker.ticks;
+        if (worker.runner) {
+            result.bot_decision_time.merge(worker.runner->bot_decision_time());
+            result.bot_budget_overruns += worker.runner->bot_budget_overruns();
+        }
+    }
+    result.seconds = std::chrono::duration<double>(finish_time - start_time).count();
+    return result;
+}
+}
+
+#endif